@@ -0,0 +1,535 @@
+// Layout Converter Benchmarks
+// Microbenchmarks for conversion, detection and layout loading. Inputs are
+// generated deterministically from the in-tree corpora, so runs on
+// different machines measure the same work.
+
+#include "../core/include/key_system.h"
+#include "../core/include/batch_converter.h"
+#include "../core/include/incremental_detector.h"
+#include "../core/include/ngram_model.h"
+#include "../core/include/word_dictionary.h"
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Heap allocations, counted to report allocations per operation. The
+// replacements are kept out of line so the compiler does not pair an
+// inlined free() with a `new` expression and warn about the mismatch.
+static std::atomic<size_t> allocation_count{0};
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+using layout_converter::KeyBasedLayoutLibrary;
+
+constexpr size_t SHORT_TEXT = 32;
+constexpr size_t LONG_TEXT = 4 << 20;
+
+std::string layout_path(const std::string& layout_id) {
+    return std::string(LAYOUT_DATA_DIR) + "/" + layout_id + ".json";
+}
+
+std::vector<std::string> read_words(const std::string& language) {
+    std::ifstream in(std::string(CORPUS_DATA_DIR) + "/" + language + ".txt");
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// Text of exactly `size` bytes (or just under, to keep UTF-8 whole) made of
+// corpus words drawn with a fixed seed. mt19937 output is specified by the
+// standard, unlike the distributions, so the text is the same everywhere.
+std::string synthetic_text(const std::vector<const std::vector<std::string>*>& vocabularies, size_t size,
+                           unsigned seed = 42) {
+    std::mt19937 random(seed);
+    std::string text;
+    text.reserve(size + 64);
+    for (size_t n = 0; text.size() < size; ++n) {
+        const auto& words = *vocabularies[n % vocabularies.size()];
+        if (!text.empty()) text += ' ';
+        text += words[random() % words.size()];
+    }
+    size_t end = size;
+    while (end > 0 && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80) --end;
+    text.resize(end);
+    return text;
+}
+
+enum Script { ASCII, CYRILLIC, MIXED };
+
+std::vector<const std::vector<std::string>*> vocabularies(Script script) {
+    static const std::vector<std::string> en = read_words("en");
+    static const std::vector<std::string> ru = read_words("ru");
+    switch (script) {
+        case ASCII: return {&en};
+        case CYRILLIC: return {&ru};
+        default: return {&en, &ru};
+    }
+}
+
+const std::string& corpus_text(Script script, size_t size) {
+    static std::map<std::pair<int, size_t>, std::string> cache;
+    auto& text = cache[{script, size}];
+    if (text.empty()) {
+        text = synthetic_text(vocabularies(script), size);
+    }
+    return text;
+}
+
+// `count` short texts, each from its own seed
+std::vector<std::string> short_texts(Script script, size_t count) {
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < count; ++i) {
+        texts.push_back(synthetic_text(vocabularies(script), SHORT_TEXT, static_cast<unsigned>(i)));
+    }
+    return texts;
+}
+
+const char* script_name(Script script) {
+    return script == ASCII ? "ascii" : script == CYRILLIC ? "cyrillic" : "mixed";
+}
+
+KeyBasedLayoutLibrary& shared_library() {
+    static KeyBasedLayoutLibrary library;
+    static bool loaded = library.load_directory(LAYOUT_DATA_DIR) > 0;
+    (void)loaded;
+    return library;
+}
+
+// Library with `count` layouts: the in-tree ones plus copies of them with
+// deterministically shuffled letter keys, so each copy is a distinct layout
+std::unique_ptr<KeyBasedLayoutLibrary> library_with_layouts(size_t count) {
+    auto library = std::make_unique<KeyBasedLayoutLibrary>();
+    library->load_directory(LAYOUT_DATA_DIR);
+    std::vector<std::string> base = library->get_loaded_layouts();
+    std::mt19937 random(7);
+    for (size_t i = base.size(); i < count; ++i) {
+        auto layout = library->get_layout(base[i % base.size()]);
+        std::array<char32_t, 26> letters;
+        for (int position = 1; position <= 26; ++position) letters[position - 1] = layout->key_to_char[position];
+        for (size_t j = letters.size() - 1; j > 0; --j) std::swap(letters[j], letters[random() % (j + 1)]);
+        
+        auto shuffled = std::make_shared<layout_converter::LayoutDefinition>();
+        shuffled->id = layout->id;
+        shuffled->name = layout->name;
+        shuffled->family_id = layout->family_id;
+        shuffled->layout_id = layout->layout_id;
+        shuffled->language = layout->language;
+        shuffled->frequency_score = layout->frequency_score;
+        shuffled->common_words = layout->common_words;
+        for (int position = 1; position <= layout_converter::KeyID::MAX_KEY_POSITION; ++position) {
+            // Shift levels of the letters are filled in again on registration
+            bool letter = layout_converter::KeyID::physical_key(position) <= 26;
+            char32_t c = position <= 26 ? letters[position - 1]
+                       : letter && layout_converter::KeyID::level(position) == layout_converter::KeyID::LEVEL_SHIFT
+                           ? 0 : layout->key_to_char[position];
+            if (c) shuffled->set_key(position, c);
+        }
+        library->add_layout(base[i % base.size()] + "_" + std::to_string(i), shuffled);
+    }
+    return library;
+}
+
+// Report throughput and heap allocations per iteration
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State& state) : state_(state), start_(allocation_count.load()) {}
+
+    ~AllocationCounter() {
+        state_.counters["allocs/op"] = benchmark::Counter(
+            static_cast<double>(allocation_count.load() - start_), benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state_;
+    size_t start_;
+};
+
+// convert_text by layout ID, allocating the result string
+void BM_ConvertText(benchmark::State& state, Script script, const char* from, const char* to) {
+    KeyBasedLayoutLibrary& library = shared_library();
+    const std::string& text = corpus_text(script, static_cast<size_t>(state.range(0)));
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(library.convert_text(text, from, to));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+// convert_text by handle into a reused buffer (the zero-allocation path)
+void BM_ConvertInto(benchmark::State& state, Script script, const char* from, const char* to) {
+    KeyBasedLayoutLibrary& library = shared_library();
+    const std::string& text = corpus_text(script, static_cast<size_t>(state.range(0)));
+    auto from_layout = library.resolve_layout(from);
+    auto to_layout = library.resolve_layout(to);
+    std::string out;
+    library.convert_text(text, from_layout, to_layout, out);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        out.clear();
+        library.convert_text(text, from_layout, to_layout, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+void register_conversions() {
+    struct Case {
+        Script script;
+        const char* from;
+        const char* to;
+    };
+    for (const Case& c : {Case{ASCII, "qwerty", "workman"}, Case{ASCII, "qwerty", "russian"},
+                          Case{CYRILLIC, "russian", "qwerty"}, Case{MIXED, "qwerty", "russian"}}) {
+        std::string suffix = std::string("/") + script_name(c.script) + "/" + c.from + "->" + c.to;
+        benchmark::RegisterBenchmark(("BM_ConvertText" + suffix).c_str(), BM_ConvertText, c.script, c.from, c.to)
+            ->Arg(SHORT_TEXT)->Arg(LONG_TEXT);
+        benchmark::RegisterBenchmark(("BM_ConvertInto" + suffix).c_str(), BM_ConvertInto, c.script, c.from, c.to)
+            ->Arg(SHORT_TEXT)->Arg(LONG_TEXT);
+    }
+}
+
+// Thousands of short strings through one layout pair
+void BM_ConvertBatch(benchmark::State& state) {
+    KeyBasedLayoutLibrary& library = shared_library();
+    std::vector<std::string> storage = short_texts(ASCII, 4096);
+    std::vector<std::string_view> inputs(storage.begin(), storage.end());
+    size_t bytes = 0;
+    for (const std::string& input : storage) bytes += input.size();
+    layout_converter::StringBatch batch;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        library.convert_batch(inputs, "qwerty", "russian", batch);
+        benchmark::DoNotOptimize(batch.arena.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * inputs.size()));
+}
+BENCHMARK(BM_ConvertBatch);
+
+// One range(1)-byte text into range(0) target layouts: a single fan-out
+// pass against one conversion per target
+void BM_ConvertFanout(benchmark::State& state) {
+    auto library = library_with_layouts(static_cast<size_t>(state.range(0)));
+    std::string text = corpus_text(MIXED, static_cast<size_t>(state.range(1)));
+    std::vector<layout_converter::LayoutHandle> targets;
+    for (const std::string& layout_id : library->get_loaded_layouts()) {
+        targets.push_back(library->resolve_layout(layout_id));
+    }
+    auto from = library->resolve_layout("qwerty");
+    layout_converter::StringBatch batch;
+    library->convert_fanout(text, from, targets, batch);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        library->convert_fanout(text, from, targets, batch);
+        benchmark::DoNotOptimize(batch.arena.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_ConvertFanout)->ArgsProduct({{10}, {SHORT_TEXT, 4096}});
+
+void BM_ConvertEachTarget(benchmark::State& state) {
+    auto library = library_with_layouts(static_cast<size_t>(state.range(0)));
+    std::string text = corpus_text(MIXED, static_cast<size_t>(state.range(1)));
+    std::vector<layout_converter::LayoutHandle> targets;
+    for (const std::string& layout_id : library->get_loaded_layouts()) {
+        targets.push_back(library->resolve_layout(layout_id));
+    }
+    auto from = library->resolve_layout("qwerty");
+    std::string out;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        out.clear();
+        for (auto to : targets) {
+            library->convert_text(text, from, to, out);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_ConvertEachTarget)->ArgsProduct({{10}, {SHORT_TEXT, 4096}});
+
+// detect_likely_layouts over range(0) layouts and range(1)-byte texts of
+// Russian typed on QWERTY
+void BM_DetectLikelyLayouts(benchmark::State& state) {
+    auto library = library_with_layouts(static_cast<size_t>(state.range(0)));
+    std::string text = library->convert_text(corpus_text(CYRILLIC, static_cast<size_t>(state.range(1))),
+                                             "russian", "qwerty");
+    library->detect_likely_layouts(text);  // Build the models outside the timing
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(library->detect_likely_layouts(text));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_DetectLikelyLayouts)->ArgsProduct({{3, 10, 30, 100}, {16, 256, 4096}});
+
+void BM_DetectBatch(benchmark::State& state) {
+    auto library = library_with_layouts(static_cast<size_t>(state.range(0)));
+    std::vector<std::string> storage = short_texts(MIXED, 1024);
+    for (std::string& text : storage) {
+        text = library->convert_text(text, "russian", "qwerty");  // Russian words come out mistyped
+    }
+    std::vector<std::string_view> inputs(storage.begin(), storage.end());
+    layout_converter::DetectionBatch batch;
+    library->detect_batch(inputs, "en", batch);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        library->detect_batch(inputs, "en", batch, 3);
+        benchmark::DoNotOptimize(batch.hypotheses.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * inputs.size()));
+}
+BENCHMARK(BM_DetectBatch)->Arg(3)->Arg(30);
+
+// Cases of data/evaluation/detection.tsv: the intended text typed on the
+// typed layout, and the hypothesis detection should rank first
+struct EvaluationCase {
+    std::string text;
+    layout_converter::LayoutHandle typed;
+    layout_converter::LayoutHandle intended;
+};
+
+std::vector<EvaluationCase> evaluation_cases(KeyBasedLayoutLibrary& library) {
+    std::ifstream in(std::string(EVALUATION_DATA_DIR) + "/detection.tsv");
+    std::vector<EvaluationCase> cases;
+    for (std::string line; std::getline(in, line);) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string typed, intended, text;
+        std::getline(fields, typed, '\t');
+        std::getline(fields, intended, '\t');
+        std::getline(fields, text);
+        cases.push_back({library.convert_text(text, intended, typed), library.resolve_layout(typed),
+                         library.resolve_layout(intended)});
+    }
+    return cases;
+}
+
+// Detection on the evaluation set with models trained from data/corpora
+// and quantized to range(0) bits per value in 2^range(1) trigram buckets
+// (0 = the models built at load time), reporting top-1 accuracy on phrases and on their first words,
+// and the size of the model files
+void BM_DetectTrainedModel(benchmark::State& state) {
+    KeyBasedLayoutLibrary library;
+    library.load_directory(LAYOUT_DATA_DIR);
+    double model_bytes = 0;
+    if (state.range(0)) {
+        layout_converter::NgramTrainOptions options;
+        options.bits = static_cast<unsigned>(state.range(0));
+        options.trigram_bits = static_cast<unsigned>(state.range(1));
+        for (const std::string language : {"en", "ru"}) {
+            std::string path = (std::filesystem::temp_directory_path() /
+                                ("layout_converter_bench_" + language + ".lcmodel")).string();
+            std::string corpus = std::string(CORPUS_DATA_DIR) + "/" + language + ".txt";
+            layout_converter::NgramModel::train(path, language, {corpus}, options);
+            model_bytes += static_cast<double>(std::filesystem::file_size(path));
+            library.load_language_model(path);
+            std::filesystem::remove(path);  // The mapping stays valid
+        }
+    }
+    std::vector<EvaluationCase> cases = evaluation_cases(library);
+    // Whole phrases, and their first word alone (a harder, shorter text)
+    size_t correct = 0, correct_words = 0;
+    auto detected = [&](const std::string& text, const EvaluationCase& c) {
+        auto best = library.detect_hypotheses(text, "", 1);
+        return !best.empty() && best[0].typed_layout == c.typed && best[0].intended_layout == c.intended;
+    };
+    for (const EvaluationCase& c : cases) {
+        correct += detected(c.text, c);
+        correct_words += detected(c.text.substr(0, c.text.find(' ')), c);
+    }
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        for (const EvaluationCase& c : cases) {
+            benchmark::DoNotOptimize(library.detect_hypotheses(c.text, "", 1));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * cases.size()));
+    state.counters["accuracy"] = static_cast<double>(correct) / cases.size();
+    state.counters["word_accuracy"] = static_cast<double>(correct_words) / cases.size();
+    state.counters["model_bytes"] = model_bytes;
+}
+BENCHMARK(BM_DetectTrainedModel)->Args({0, 0})->ArgsProduct({{32, 16, 8, 4}, {10, 16}});
+
+// fix_mistyped over a range(0)-byte mix of English words and Russian words
+// typed on QWERTY
+void BM_FixMistyped(benchmark::State& state) {
+    KeyBasedLayoutLibrary& library = shared_library();
+    std::string text = library.convert_text(corpus_text(MIXED, static_cast<size_t>(state.range(0))),
+                                            "russian", "qwerty");
+    std::vector<layout_converter::LayoutHandle> candidates = {library.resolve_layout("qwerty"),
+                                                              library.resolve_layout("russian")};
+    std::string out;
+    library.fix_mistyped(text, candidates, out);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        out.clear();
+        library.fix_mistyped(text, candidates, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_FixMistyped)->Arg(SHORT_TEXT)->Arg(64 << 10);
+
+// Keystroke-by-keystroke detection of a range(0)-byte text: appending to
+// an IncrementalDetector and ranking after every character
+void BM_IncrementalDetect(benchmark::State& state) {
+    KeyBasedLayoutLibrary& library = shared_library();
+    std::string text = library.convert_text(corpus_text(CYRILLIC, static_cast<size_t>(state.range(0))),
+                                            "russian", "qwerty");
+    auto detector = library.create_incremental_detector("en");
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        detector.reset();
+        for (char c : text) {
+            detector.append(std::string_view(&c, 1));
+            benchmark::DoNotOptimize(detector.ranking(1));
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_IncrementalDetect)->Arg(16)->Arg(256);
+
+// Synthetic Russian word forms: random stems, each with every ending of a
+// noun/adjective/verb paradigm, like a real word-form list. Misses are
+// forms of other random stems.
+std::vector<std::string> word_forms(size_t count, unsigned seed) {
+    static const char* const endings[] = {"", "а", "у", "ом", "е", "ы", "ов", "ам", "ами", "ах",
+                                          "ый", "ая", "ое", "ые", "ого", "ому", "ым", "ой", "ую", "ых",
+                                          "ить", "ил", "ила", "или", "ит", "ят"};
+    const std::string alphabet = "абвгдежзийклмнопрстуфхцчшщъыьэюя";  // Two bytes per letter
+    std::mt19937 random(seed);
+    std::vector<std::string> words;
+    while (words.size() < count) {
+        std::string stem;
+        for (size_t length = 3 + random() % 5; stem.size() < 2 * length;) {
+            stem += alphabet.substr(2 * (random() % 32), 2);
+        }
+        for (const char* ending : endings) {
+            words.push_back(stem + ending);
+        }
+    }
+    words.resize(count);
+    return words;
+}
+
+// WordDictionary::contains over 500k words, with range(0) Bloom filter bits
+// per word (0 = none); range(1) = 1 looks up words in the dictionary, 0
+// words that are not
+void BM_DictionaryLookup(benchmark::State& state) {
+    constexpr size_t WORDS = 500000;
+    static const std::vector<std::string> words = word_forms(WORDS, 1);
+    static const std::vector<std::string> others = word_forms(WORDS, 2);
+    std::string path = (std::filesystem::temp_directory_path() / "layout_converter_bench.lcdict").string();
+    layout_converter::WordDictionary::write(path, "ru", words, static_cast<unsigned>(state.range(0)));
+    auto dictionary = layout_converter::WordDictionary::open(path);
+    std::filesystem::remove(path);  // The mapping stays valid
+    const std::vector<std::string>& queries = state.range(1) ? words : others;
+    
+    std::mt19937 random(42);
+    std::vector<std::string_view> sample;
+    for (size_t i = 0; i < 4096; ++i) {
+        sample.push_back(queries[random() % queries.size()]);
+    }
+    size_t found = 0;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        for (std::string_view word : sample) {
+            found += dictionary->contains(word);
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * sample.size()));
+    state.counters["bytes_per_word"] = static_cast<double>(dictionary->size_bytes()) / dictionary->word_count();
+    state.counters["found"] = static_cast<double>(found) / (state.iterations() * sample.size());
+}
+BENCHMARK(BM_DictionaryLookup)->ArgsProduct({{0, 10}, {1, 0}});
+
+// Startup: one JSON layout, the whole layout directory, the compiled-in
+// layouts and a binary pack
+void BM_LoadLayout(benchmark::State& state) {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        KeyBasedLayoutLibrary library;
+        benchmark::DoNotOptimize(library.load_layout("russian", layout_path("russian")));
+    }
+}
+BENCHMARK(BM_LoadLayout);
+
+void BM_LoadDirectory(benchmark::State& state) {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        KeyBasedLayoutLibrary library;
+        benchmark::DoNotOptimize(library.load_directory(LAYOUT_DATA_DIR));
+    }
+}
+BENCHMARK(BM_LoadDirectory);
+
+void BM_LoadBuiltinLayouts(benchmark::State& state) {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        KeyBasedLayoutLibrary library;
+        benchmark::DoNotOptimize(library.load_builtin_layouts());
+    }
+}
+BENCHMARK(BM_LoadBuiltinLayouts);
+
+void BM_LoadPack(benchmark::State& state) {
+    std::string pack = (std::filesystem::temp_directory_path() / "layout_converter_bench.lcpk").string();
+    shared_library().save_pack(pack);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        KeyBasedLayoutLibrary library;
+        benchmark::DoNotOptimize(library.load_pack(pack));
+    }
+    std::filesystem::remove(pack);
+}
+BENCHMARK(BM_LoadPack);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    register_conversions();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
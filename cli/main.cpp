@@ -1,7 +1,17 @@
 // Layout Converter CLI Tool
 // Command-line interface for the key ID system
 
+#include "../core/include/batch_converter.h"
 #include "../core/include/key_system.h"
+#include "../core/include/ngram_model.h"
+#include "../core/include/stats.h"
+#include "../core/include/stream_converter.h"
+#include "../core/include/word_dictionary.h"
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -10,20 +20,107 @@
 void print_usage(const char* program_name) {
     std::cout << "Layout Converter - Convert text between keyboard layouts\n\n";
     std::cout << "Usage:\n";
-    std::cout << "  " << program_name << " <text> [options]\n\n";
+    std::cout << "  " << program_name << " <text> [options]\n";
+    std::cout << "  " << program_name << " --from <layout> --to <layout> (--stdin | --input <file>) [--output <file>]\n";
+    std::cout << "  " << program_name << " pack [--layouts <dir>] [--output <file>]\n";
+    std::cout << "  " << program_name << " dict --language <code> --input <words> [--output <file>] [--bloom <bits>]\n";
+    std::cout << "  " << program_name << " train --language <code> --input <corpus>... [--output <file>] [--bits <n>]\n";
+    std::cout << "        [--trigram-bits <n>] [--threads <n>]\n\n";
+    std::cout << "Commands:\n";
+    std::cout << "  pack                Compile layout JSON files into a binary pack (default: layouts.lcpack)\n";
+    std::cout << "  dict                Compile a word list (one word per line) into a dictionary for\n";
+    std::cout << "                      detection (default: <code>.lcdict); --bloom adds a Bloom filter\n";
+    std::cout << "                      of that many bits per word to reject absent words faster\n";
+    std::cout << "  train               Build a character n-gram model from text corpora (default:\n";
+    std::cout << "                      <code>.lcmodel), counting on --threads threads. --bits (4, 8, 16\n";
+    std::cout << "                      or 32; default 8) sets the quantization, --trigram-bits (8-18;\n";
+    std::cout << "                      default 16) the number of trigram buckets\n\n";
     std::cout << "Options:\n";
-    std::cout << "  --from <layout>     Source layout (qwerty, workman, russian)\n";
-    std::cout << "  --to <layout>       Target layout (qwerty, workman, russian)\n";
+    std::cout << "  --from <layout>     Source layout (qwerty, workman, dvorak, russian)\n";
+    std::cout << "  --to <layout>       Target layout (qwerty, workman, dvorak, russian)\n";
     std::cout << "  --detect            Auto-detect possible layouts\n";
+    std::cout << "  --fix <layouts>     Convert only the words typed on the wrong one of a comma-separated\n";
+    std::cout << "                      list of layouts (with --stdin or --input: line by line)\n";
+    std::cout << "  --stdin             Stream text from standard input\n";
+    std::cout << "  --input <file>      Stream text from a file\n";
+    std::cout << "  --output <file>     Write streamed or fixed output to a file (default: stdout)\n";
+    std::cout << "  --threads <n>       Convert --input to --output memory-mapped on n threads (0 = all cores)\n";
+    std::cout << "  --layouts <dir>     Also load layout JSON files from a directory\n";
+    std::cout << "  --pack <file>       Load layouts from a binary pack instead of JSON\n";
+    std::cout << "  --dict <file>       Load a word dictionary for --detect and --fix (repeatable)\n";
+    std::cout << "  --model <file>      Load a trained n-gram model for --detect and --fix (repeatable)\n";
+    std::cout << "  --stats             Print library counters and latencies to stderr on exit\n";
     std::cout << "  --help, -h          Show this help message\n\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << " \"hello\" --from qwerty --to workman\n";
     std::cout << "  " << program_name << " \"привет\" --detect\n";
-    std::cout << "  " << program_name << " \"ywoo;\" --from workman --to qwerty\n\n";
+    std::cout << "  " << program_name << " \"ywoo;\" --from workman --to qwerty\n";
+    std::cout << "  " << program_name << " \"hello ghbdtn world\" --fix qwerty,russian\n";
+    std::cout << "  " << program_name << " --from qwerty --to russian --input in.txt --output out.txt\n\n";
     std::cout << "Available layouts:\n";
-    std::cout << "  qwerty, workman, russian\n";
+    std::cout << "  qwerty, workman, dvorak, russian\n";
 }
 
+// Open --input and --output when given; streams default to stdin/stdout
+bool open_stream_files(const std::string& input_path, std::ifstream& input,
+                       const std::string& output_path, std::ofstream& output) {
+    if (!input_path.empty()) {
+        input.open(input_path, std::ios::binary);
+        if (!input.is_open()) {
+            std::cerr << "Error: Cannot open input file '" << input_path << "'\n";
+            return false;
+        }
+    }
+    if (!output_path.empty()) {
+        output.open(output_path, std::ios::binary);
+        if (!output.is_open()) {
+            std::cerr << "Error: Cannot open output file '" << output_path << "'\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Counters and latency histograms recorded by the library (see stats.h)
+void print_stats() {
+    namespace Stats = layout_converter::Stats;
+    Stats::Snapshot stats = Stats::snapshot();
+    if (!stats.enabled) {
+        std::cerr << "Statistics are not compiled in (configure with -DLAYOUT_CONVERTER_ENABLE_STATS=ON)\n";
+        return;
+    }
+    
+    std::cerr << "\nCounters:\n";
+    for (size_t c = 0; c < Stats::COUNTER_COUNT; ++c) {
+        auto counter = static_cast<Stats::Counter>(c);
+        std::cerr << "  " << std::left << std::setw(24) << Stats::counter_name(counter) << stats[counter] << "\n";
+    }
+    std::cerr << "Latency (calls, mean, p50, p99 in ns; percentiles are bucket upper bounds):\n";
+    for (size_t o = 0; o < Stats::OPERATION_COUNT; ++o) {
+        auto operation = static_cast<Stats::Operation>(o);
+        const Stats::Histogram& histogram = stats[operation];
+        std::cerr << "  " << std::left << std::setw(12) << Stats::operation_name(operation)
+                  << histogram.count << ", " << static_cast<uint64_t>(histogram.mean_ns()) << ", "
+                  << histogram.quantile_ns(0.5) << ", " << histogram.quantile_ns(0.99) << "\n";
+    }
+}
+
+// Parse a whole argument as a non-negative integer no larger than `max`
+bool parse_unsigned(const char* text, unsigned& value, unsigned max = 1u << 16) {
+    const char* end = text + std::strlen(text);
+    auto [rest, error] = std::from_chars(text, end, value);
+    return error == std::errc() && rest == end && rest != text && value <= max;
+}
+
+// Prints the statistics when main returns, whichever way it exits
+struct StatsReport {
+    bool enabled = false;
+    
+    ~StatsReport() {
+        if (enabled) print_stats();
+    }
+};
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         print_usage(argv[0]);
@@ -33,10 +130,27 @@ int main(int argc, char* argv[]) {
     std::string text;
     std::string from_layout;
     std::string to_layout;
+    std::string input_path;
+    std::string output_path;
+    std::string layouts_dir;
+    std::string pack_path;
+    std::string language;
+    std::vector<std::string> dictionary_paths;
+    std::vector<std::string> model_paths;
+    std::vector<std::string> corpus_paths;  // Every --input, for train
+    std::vector<std::string> fix_layouts;
+    bool pack_command = std::string(argv[1]) == "pack";
+    bool dict_command = std::string(argv[1]) == "dict";
+    bool train_command = std::string(argv[1]) == "train";
+    unsigned bloom_bits = 0;
+    layout_converter::NgramTrainOptions train_options;
     bool detect_mode = false;
+    bool stdin_mode = false;
+    int threads = -1;  // -1 = stream instead of bulk file conversion
+    StatsReport stats_report;
 
     // Parse command line arguments
-    for (int i = 1; i < argc; ++i) {
+    for (int i = pack_command || dict_command || train_command ? 2 : 1; i < argc; ++i) {
         std::string arg = argv[i];
         
         if (arg == "--help" || arg == "-h") {
@@ -48,6 +162,57 @@ int main(int argc, char* argv[]) {
             to_layout = argv[++i];
         } else if (arg == "--detect") {
             detect_mode = true;
+        } else if (arg == "--fix" && i + 1 < argc) {
+            std::string list = argv[++i];
+            for (size_t start = 0, comma; start <= list.size(); start = comma + 1) {
+                comma = std::min(list.find(',', start), list.size());
+                if (comma > start) fix_layouts.push_back(list.substr(start, comma - start));
+            }
+        } else if (arg == "--stdin") {
+            stdin_mode = true;
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_path = argv[++i];
+            corpus_paths.push_back(input_path);
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            if (!parse_unsigned(argv[++i], train_options.threads)) {
+                std::cerr << "Error: --threads needs a thread count (0 = all cores), got '" << argv[i] << "'\n";
+                return 1;
+            }
+            threads = static_cast<int>(train_options.threads);
+        } else if (arg == "--layouts" && i + 1 < argc) {
+            layouts_dir = argv[++i];
+        } else if (arg == "--pack" && i + 1 < argc) {
+            pack_path = argv[++i];
+        } else if (arg == "--dict" && i + 1 < argc) {
+            dictionary_paths.push_back(argv[++i]);
+        } else if (arg == "--language" && i + 1 < argc) {
+            language = argv[++i];
+        } else if (arg == "--model" && i + 1 < argc) {
+            model_paths.push_back(argv[++i]);
+        } else if (arg == "--bits" && i + 1 < argc) {
+            unsigned& bits = train_options.bits;
+            if (!parse_unsigned(argv[++i], bits) || (bits != 4 && bits != 8 && bits != 16 && bits != 32)) {
+                std::cerr << "Error: --bits must be 4, 8, 16 or 32, got '" << argv[i] << "'\n";
+                return 1;
+            }
+        } else if (arg == "--trigram-bits" && i + 1 < argc) {
+            using layout_converter::NgramModel;
+            if (!parse_unsigned(argv[++i], train_options.trigram_bits, NgramModel::MAX_TRIGRAM_BITS) ||
+                train_options.trigram_bits < NgramModel::MIN_TRIGRAM_BITS) {
+                std::cerr << "Error: --trigram-bits must be " << NgramModel::MIN_TRIGRAM_BITS << " to "
+                          << NgramModel::MAX_TRIGRAM_BITS << ", got '" << argv[i] << "'\n";
+                return 1;
+            }
+        } else if (arg == "--bloom" && i + 1 < argc) {
+            if (!parse_unsigned(argv[++i], bloom_bits, 64)) {
+                std::cerr << "Error: --bloom needs Bloom filter bits per word (0-64, 0 = none), got '" << argv[i]
+                          << "'\n";
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            stats_report.enabled = true;
         } else if (text.empty()) {
             text = arg;
         } else {
@@ -57,16 +222,181 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (text.empty()) {
+    if (pack_command) {
+        layout_converter::KeyBasedLayoutLibrary library;
+        size_t loaded = library.load_directory(layouts_dir.empty() ? "data/layouts" : layouts_dir);
+        if (loaded == 0) {
+            std::cerr << "Error: No layouts found in '" << layouts_dir << "'\n";
+            return 1;
+        }
+        std::string pack_output = output_path.empty() ? "layouts.lcpack" : output_path;
+        if (!library.save_pack(pack_output)) {
+            std::cerr << "Error: Cannot write pack '" << pack_output << "'\n";
+            return 1;
+        }
+        std::cout << "Packed " << loaded << " layouts into '" << pack_output << "'\n";
+        return 0;
+    }
+
+    if (dict_command) {
+        std::ifstream input(input_path);
+        if (language.empty() || !input) {
+            std::cerr << "Error: dict needs --language and a readable --input word list\n";
+            return 1;
+        }
+        std::vector<std::string> words;
+        for (std::string line; std::getline(input, line);) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            words.push_back(std::move(line));
+        }
+        std::string dict_output = output_path.empty() ? language + ".lcdict" : output_path;
+        if (!layout_converter::WordDictionary::write(dict_output, language, std::move(words), bloom_bits)) {
+            std::cerr << "Error: Cannot write dictionary '" << dict_output << "'\n";
+            return 1;
+        }
+        auto dictionary = layout_converter::WordDictionary::open(dict_output);
+        if (!dictionary) {
+            std::cerr << "Error: Cannot read back dictionary '" << dict_output << "'\n";
+            return 1;
+        }
+        std::cout << "Wrote " << dictionary->word_count() << " words (" << dictionary->size_bytes()
+                  << " bytes) into '" << dict_output << "'\n";
+        return 0;
+    }
+
+    if (train_command) {
+        if (language.empty() || corpus_paths.empty()) {
+            std::cerr << "Error: train needs --language and at least one --input corpus\n";
+            return 1;
+        }
+        std::string model_output = output_path.empty() ? language + ".lcmodel" : output_path;
+        if (!layout_converter::NgramModel::train(model_output, language, corpus_paths, train_options)) {
+            std::cerr << "Error: Cannot train model '" << model_output << "' (unreadable corpus or write error)\n";
+            return 1;
+        }
+        auto model = layout_converter::NgramModel::open(model_output);
+        if (!model) {
+            std::cerr << "Error: Cannot read back model '" << model_output << "'\n";
+            return 1;
+        }
+        std::cout << "Wrote a model of " << model->symbol_count() - 1 << " letters at " << model->bits()
+                  << " bits per value (" << model->size_bytes() << " bytes) into '" << model_output << "'\n";
+        return 0;
+    }
+
+    bool fix_mode = !fix_layouts.empty();
+    bool stream_mode = stdin_mode || !input_path.empty();
+    if (text.empty() && !stream_mode) {
         std::cerr << "Error: No text provided\n";
         print_usage(argv[0]);
         return 1;
     }
+    std::error_code same_file_error;
+    if (!input_path.empty() && !output_path.empty() &&
+        std::filesystem::equivalent(input_path, output_path, same_file_error)) {
+        std::cerr << "Error: --input and --output name the same file\n";
+        return 1;
+    }
 
     try {
         layout_converter::KeyBasedLayoutLibrary library;
+        library.load_builtin_layouts();
+        if (!pack_path.empty() && !library.load_pack(pack_path)) {
+            std::cerr << "Error: Cannot load layout pack '" << pack_path << "'\n";
+            return 1;
+        }
+        if (!layouts_dir.empty()) {
+            library.load_directory(layouts_dir);
+        }
+        for (const std::string& path : model_paths) {
+            if (!library.load_language_model(path)) {
+                std::cerr << "Error: Cannot load language model '" << path << "'\n";
+                return 1;
+            }
+        }
+        for (const std::string& path : dictionary_paths) {
+            if (!library.load_dictionary(path)) {
+                std::cerr << "Error: Cannot load dictionary '" << path << "'\n";
+                return 1;
+            }
+        }
+
+        if (fix_mode) {
+            // Auto-correct mode: only mistyped words change
+            for (const std::string& layout : fix_layouts) {
+                if (!library.get_layout(layout)) {
+                    std::cerr << "Error: Unknown layout '" << layout << "'\n";
+                    return 1;
+                }
+            }
+            std::vector<layout_converter::LayoutHandle> candidates;
+            for (const std::string& layout : fix_layouts) {
+                candidates.push_back(library.resolve_layout(layout));
+            }
+            std::ios::sync_with_stdio(false);
+            std::ifstream input_file;
+            std::ofstream output_file;
+            if (!open_stream_files(input_path, input_file, output_path, output_file)) {
+                return 1;
+            }
+            std::istream& in = input_path.empty() ? std::cin : static_cast<std::istream&>(input_file);
+            std::ostream& out = output_path.empty() ? std::cout : static_cast<std::ostream&>(output_file);
+            std::string line, fixed;
+            if (!stream_mode) {
+                library.fix_mistyped(text, candidates, fixed);
+                out << fixed << '\n';
+            }
+            while (stream_mode && std::getline(in, line)) {
+                fixed.clear();
+                library.fix_mistyped(line, candidates, fixed);
+                fixed += '\n';
+                out << fixed;
+            }
+            if (!out.flush() || (stream_mode && in.bad())) {
+                std::cerr << "Error: I/O failure while streaming\n";
+                return 1;
+            }
+        } else if (stream_mode) {
+            // Streaming mode: constant memory regardless of input size
+            if (from_layout.empty() || to_layout.empty()) {
+                std::cerr << "Error: Streaming requires --from <layout> and --to <layout>\n";
+                return 1;
+            }
+            auto plan = library.compile(from_layout, to_layout);
+            if (!plan) {
+                std::cerr << "Error: Unknown layout '" << (library.get_layout(from_layout) ? to_layout : from_layout) << "'\n";
+                return 1;
+            }
 
-        if (detect_mode) {
+            if (threads >= 0) {
+                // Bulk mode: mmap input and output, convert chunks in parallel
+                if (input_path.empty() || output_path.empty()) {
+                    std::cerr << "Error: --threads requires --input <file> and --output <file>\n";
+                    return 1;
+                }
+                if (!library.convert_file(input_path, output_path, from_layout, to_layout,
+                                          static_cast<unsigned>(threads))) {
+                    std::cerr << "Error: Failed to convert '" << input_path << "'\n";
+                    return 1;
+                }
+                return 0;
+            }
+
+            std::ios::sync_with_stdio(false);
+            std::ifstream input_file;
+            std::ofstream output_file;
+            if (!open_stream_files(input_path, input_file, output_path, output_file)) {
+                return 1;
+            }
+
+            layout_converter::StreamConverter converter(plan);
+            std::istream& in = input_path.empty() ? std::cin : static_cast<std::istream&>(input_file);
+            std::ostream& out = output_path.empty() ? std::cout : static_cast<std::ostream&>(output_file);
+            if (!converter.convert(in, out)) {
+                std::cerr << "Error: I/O failure while streaming\n";
+                return 1;
+            }
+        } else if (detect_mode) {
             // Auto-detect mode
             std::cout << "Text: '" << text << "'\n\n";
             
@@ -81,18 +411,26 @@ int main(int argc, char* argv[]) {
                 }
                 std::cout << "\n\n";
                 
-                // Show possible conversions
-                if (detected_layouts.size() >= 2) {
-                    std::cout << "Possible conversions:\n";
-                    for (size_t i = 0; i < detected_layouts.size(); ++i) {
-                        for (size_t j = 0; j < detected_layouts.size(); ++j) {
-                            if (i != j) {
-                                std::string converted = library.convert_text(text, detected_layouts[i], detected_layouts[j]);
-                                std::cout << "  " << detected_layouts[i] << " → " << detected_layouts[j] << ": '" << converted << "'\n";
-                            }
-                        }
+                // Show the most likely readings of the text, all converted
+                // in one fan-out pass
+                auto hypotheses = library.detect_hypotheses(text, "en", 5);
+                std::vector<layout_converter::LayoutHandle> targets;
+                for (const auto& hypothesis : hypotheses) {
+                    if (std::find(targets.begin(), targets.end(), hypothesis.intended_layout) == targets.end()) {
+                        targets.push_back(hypothesis.intended_layout);
                     }
                 }
+                layout_converter::StringBatch readings;
+                library.convert_fanout(text, targets, readings);
+                
+                std::cout << "Most likely readings:\n";
+                for (const auto& hypothesis : hypotheses) {
+                    size_t target = std::find(targets.begin(), targets.end(), hypothesis.intended_layout) - targets.begin();
+                    std::cout << "  " << library.get_layout_id(hypothesis.typed_layout) << " → "
+                              << library.get_layout_id(hypothesis.intended_layout) << ": '"
+                              << readings[hypothesis.typed_layout * targets.size() + target]
+                              << "' (score " << hypothesis.score << ")\n";
+                }
             }
         } else {
             // Direct conversion mode
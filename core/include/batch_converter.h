@@ -0,0 +1,49 @@
+// Batch Converter
+// Conversion of many short strings into one contiguous arena
+
+#ifndef BATCH_CONVERTER_H
+#define BATCH_CONVERTER_H
+
+#include "key_system.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace layout_converter {
+
+constexpr size_t DEFAULT_MIN_BATCH_CHUNK = 64 * 1024;  // Input bytes per work item
+
+// Column of strings stored back to back in one buffer (Arrow string column
+// layout): string i is arena[offsets[i], offsets[i + 1]). Reusing a batch
+// across calls reuses its storage.
+struct StringBatch {
+    std::string arena;
+    std::vector<size_t> offsets;  // size() + 1 entries
+    
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    
+    std::string_view operator[](size_t i) const {
+        return std::string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+// Convert `count` strings with one plan into `out`, replacing its contents.
+// Each string is converted straight into the arena, with no per-string
+// allocation. Batches of at least two `min_chunk_size` chunks of input are
+// split across `threads` workers (0 = hardware concurrency).
+void convert_batch(const ConversionPlan& plan, const std::string_view* inputs, size_t count,
+                   StringBatch& out, unsigned threads = 1,
+                   size_t min_chunk_size = DEFAULT_MIN_BATCH_CHUNK);
+
+// Convert one text as typed on each of `sources` into each of `targets`,
+// replacing the contents of `out` with source_count * target_count strings,
+// source-major: string s * target_count + t is the text typed on sources[s]
+// and read on targets[t]. The text is decoded once and looked up
+// once per source; every output is then a single table load per character,
+// written straight into the arena. A null layout copies the text.
+void convert_fanout(std::string_view text, const LayoutDefinition* const* sources, size_t source_count,
+                    const LayoutDefinition* const* targets, size_t target_count, StringBatch& out);
+
+} // namespace layout_converter
+
+#endif // BATCH_CONVERTER_H
@@ -0,0 +1,194 @@
+// Built-in Layouts
+// Layouts compiled into the library as constexpr tables, plus compile-time
+// specialized conversion between them
+
+#ifndef BUILTIN_LAYOUTS_H
+#define BUILTIN_LAYOUTS_H
+
+#include "key_system.h"
+#include "utf8.h"
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace layout_converter {
+namespace Builtin {
+
+// Compile-time form of a layout JSON file
+struct LayoutData {
+    const char* layout_key;      // ID the layout is registered under (file name)
+    const char* id;
+    const char* name;
+    const char* language;
+    int family_id;
+    int layout_id;
+    double frequency_score;
+    const char* const* common_words;
+    size_t common_word_count;
+    std::array<char32_t, KeyID::MAX_KEY_POSITION + 1> keys;  // Key position -> codepoint (0 = unused)
+};
+
+} // namespace Builtin
+} // namespace layout_converter
+
+// Generated at build time from data/layouts/*.json: defines Builtin::Layout,
+// Builtin::LAYOUT_COUNT and Builtin::LAYOUTS
+#include "builtin_layouts_data.h"
+
+namespace layout_converter {
+namespace Builtin {
+
+constexpr const LayoutData& data(Layout layout) {
+    return LAYOUTS[static_cast<size_t>(layout)];
+}
+
+namespace detail {
+
+using KeyTable = std::array<char32_t, KeyID::MAX_KEY_POSITION + 1>;
+
+// Same rule as LayoutDefinition::set_key: a character on several keys
+// resolves to the last one
+constexpr int key_position_for(const KeyTable& keys, char32_t c) {
+    for (int position = KeyID::MAX_KEY_POSITION; position >= 1; --position) {
+        if (keys[position] == c) return position;
+    }
+    return 0;
+}
+
+// Mirrors LayoutDefinition::complete_shift_levels
+constexpr KeyTable complete_shift_levels(KeyTable keys) {
+    for (int level : {KeyID::LEVEL_BASE, KeyID::LEVEL_ALTGR}) {
+        for (int key = 1; key <= KeyID::PHYSICAL_KEY_COUNT; ++key) {
+            char32_t unshifted = keys[KeyID::key_position(key, level)];
+            char32_t upper = utf8::to_upper(unshifted);
+            int shifted = KeyID::key_position(key, level | KeyID::LEVEL_SHIFT);
+            if (upper != unshifted && !keys[shifted] && !key_position_for(keys, upper)) {
+                keys[shifted] = upper;
+            }
+        }
+    }
+    return keys;
+}
+
+// Calls visit(source, target) for every mapping of the pair, mirroring
+// ConversionPlan compilation
+template <typename Visit>
+constexpr void for_each_mapping(const KeyTable& from, const KeyTable& to, Visit visit) {
+    for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+        char32_t source = from[position];
+        char32_t target = to[position];
+        if (source && target && key_position_for(from, source) == position) {
+            visit(source, target);
+        }
+    }
+}
+
+struct CodepointRange {
+    char32_t first = 0;
+    char32_t last = 0;
+    constexpr size_t size() const { return last >= first && last ? last - first + 1 : 0; }
+};
+
+} // namespace detail
+
+// Compile-time counterpart of ConversionPlan for two built-in layouts
+template <Layout From, Layout To>
+struct StaticPlan {
+    static constexpr detail::KeyTable from = detail::complete_shift_levels(data(From).keys);
+    static constexpr detail::KeyTable to = detail::complete_shift_levels(data(To).keys);
+
+    static constexpr std::array<utf8::EncodedChar, 128> build_ascii_table() {
+        std::array<utf8::EncodedChar, 128> table{};
+        for (char32_t b = 0; b < 128; ++b) {
+            table[b] = utf8::encode(b);
+        }
+        detail::for_each_mapping(from, to, [&](char32_t source, char32_t target) {
+            if (source < 0x80) table[source] = utf8::encode(target);
+        });
+        return table;
+    }
+
+    // Span of non-ASCII source codepoints, so they fit one dense table
+    static constexpr detail::CodepointRange build_range() {
+        detail::CodepointRange range;
+        detail::for_each_mapping(from, to, [&](char32_t source, char32_t) {
+            if (source < 0x80) return;
+            if (!range.last || source < range.first) range.first = source;
+            if (source > range.last) range.last = source;
+        });
+        return range;
+    }
+
+    static constexpr std::array<utf8::EncodedChar, 128> ascii_table = build_ascii_table();
+    static constexpr detail::CodepointRange range = build_range();
+
+    static constexpr std::array<utf8::EncodedChar, range.size()> build_codepoint_table() {
+        std::array<utf8::EncodedChar, range.size()> table{};
+        detail::for_each_mapping(from, to, [&](char32_t source, char32_t target) {
+            if (source >= 0x80) table[source - range.first] = utf8::encode(target);
+        });
+        return table;
+    }
+
+    static constexpr bool build_byte_only() {
+        for (const auto& e : ascii_table) {
+            if (e.length != 1) return false;
+        }
+        return range.size() == 0;
+    }
+
+    static constexpr std::array<utf8::EncodedChar, range.size()> codepoint_table = build_codepoint_table();
+    static constexpr bool byte_only = build_byte_only();
+};
+
+// Convert text between two built-in layouts. The tables are constants, so
+// the loop is fully specialized for the pair and can be inlined.
+template <Layout From, Layout To>
+std::string convert(std::string_view text) {
+    using Plan = StaticPlan<From, To>;
+
+    if constexpr (Plan::byte_only) {
+        std::string result(text.size(), '\0');
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char b = static_cast<unsigned char>(text[i]);
+            result[i] = b < 0x80 ? Plan::ascii_table[b].bytes[0] : text[i];
+        }
+        return result;
+    } else {
+        // Targets are at most 4 bytes per character; +4 slack for fixed stores
+        std::string result(text.size() * 4 + 4, '\0');
+        char* out = &result[0];
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            const utf8::EncodedChar* target = nullptr;
+            size_t length = 1;
+            if (static_cast<unsigned char>(*p) < 0x80) {
+                target = &Plan::ascii_table[static_cast<unsigned char>(*p)];
+            } else {
+                char32_t cp;
+                length = utf8::decode(p, end, cp);
+                if (cp >= Plan::range.first && cp - Plan::range.first < Plan::codepoint_table.size() &&
+                    Plan::codepoint_table[cp - Plan::range.first].length) {
+                    target = &Plan::codepoint_table[cp - Plan::range.first];
+                }
+            }
+            if (target) {
+                std::memcpy(out, target->bytes, 4);
+                out += target->length;
+            } else {
+                std::memcpy(out, p, length);
+                out += length;
+            }
+            p += length;
+        }
+        result.resize(static_cast<size_t>(out - result.data()));
+        return result;
+    }
+}
+
+} // namespace Builtin
+} // namespace layout_converter
+
+#endif // BUILTIN_LAYOUTS_H
@@ -0,0 +1,30 @@
+// File Converter
+// Memory-mapped, multithreaded conversion of whole files
+
+#ifndef FILE_CONVERTER_H
+#define FILE_CONVERTER_H
+
+#include "key_system.h"
+#include <memory>
+#include <string>
+
+namespace layout_converter {
+
+constexpr size_t DEFAULT_MIN_FILE_CHUNK = 1 << 20;  // 1 MiB per work item
+
+// Convert `input_path` into `output_path` using `plan`. The input is
+// mmapped and split into chunks on UTF-8 character boundaries, which are
+// converted in parallel by `threads` workers (0 = hardware concurrency)
+// straight into a pre-sized mmapped output. Width-changing plans run a
+// sizing pass first and place chunks by prefix sum.
+// Returns false on any I/O error, or if both paths name the same file
+// (which is left untouched).
+bool convert_file(const std::shared_ptr<const ConversionPlan>& plan,
+                  const std::string& input_path,
+                  const std::string& output_path,
+                  unsigned threads = 0,
+                  size_t min_chunk_size = DEFAULT_MIN_FILE_CHUNK);
+
+} // namespace layout_converter
+
+#endif // FILE_CONVERTER_H
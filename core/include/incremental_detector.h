@@ -0,0 +1,70 @@
+// Incremental Detector
+// Layout detection for text that arrives a few keystrokes at a time
+
+#ifndef INCREMENTAL_DETECTOR_H
+#define INCREMENTAL_DETECTOR_H
+
+#include "key_system.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace layout_converter {
+
+class DetectionEngine;
+
+// Keeps running n-gram and common-word state for every (typed, intended)
+// hypothesis, so each appended character costs a constant amount of work
+// per hypothesis instead of rescoring the whole text. The ranking at any
+// point equals what detect_hypotheses returns for the text appended so far.
+// Created by KeyBasedLayoutLibrary::create_incremental_detector; it keeps
+// using the layouts loaded at creation, also across reloads. A detector is
+// used by one thread at a time, ranking() and decide() included.
+class IncrementalDetector {
+public:
+    static constexpr double DEFAULT_CONFIDENCE = 0.99;
+
+    // Outcome of decide(): `best` is only meaningful when `decided`
+    struct Decision {
+        bool decided = false;
+        LayoutHypothesis best{INVALID_LAYOUT_HANDLE, INVALID_LAYOUT_HANDLE, 0.0, 0};
+        double confidence = 0.0;  // Share of the probability mass held by `best`
+    };
+
+    IncrementalDetector(IncrementalDetector&&) noexcept;
+    IncrementalDetector& operator=(IncrementalDetector&&) noexcept;
+    ~IncrementalDetector();
+
+    // Add the next piece of text. An incomplete UTF-8 sequence at the end
+    // is held back and completed by the next call.
+    void append(std::string_view text);
+
+    // Forget all text appended so far
+    void reset();
+
+    // Current hypotheses, best first, as detect_hypotheses would rank the
+    // text so far. `max_results` = 0 returns all hypotheses.
+    std::vector<LayoutHypothesis> ranking(size_t max_results = 0) const;
+
+    // Decide early once the best hypothesis holds at least `confidence` of
+    // the probability mass. Scores are per-character log-probabilities, so
+    // the mass of a hypothesis grows with exp(score * characters) and the
+    // decision firms up as text arrives.
+    Decision decide(double confidence = DEFAULT_CONFIDENCE) const;
+
+    // Characters appended so far, boundaries excluded
+    size_t size() const;
+
+private:
+    friend class KeyBasedLayoutLibrary;
+    class Impl;
+
+    IncrementalDetector(std::shared_ptr<const DetectionEngine> engine, const std::string& user_language);
+
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace layout_converter
+
+#endif // INCREMENTAL_DETECTOR_H
@@ -4,63 +4,108 @@
 #ifndef KEY_SYSTEM_H
 #define KEY_SYSTEM_H
 
+#include "utf8.h"
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 namespace layout_converter {
 
-// Key ID constants
+// Key model. A key position is a small dense index over every physical key
+// of the main block at every modifier level, so per-layout tables are flat
+// arrays indexed by it. Layouts themselves are indexed by LayoutHandle;
+// family and layout numbers are descriptive only.
 namespace KeyID {
-    // Family IDs (first digit)
+    // Family IDs
     constexpr int FAMILY_LATIN = 1;
     constexpr int FAMILY_CYRILLIC = 2;
     constexpr int FAMILY_HINDI = 3;
     constexpr int FAMILY_ARABIC = 4;
     constexpr int FAMILY_CHINESE = 5;
     
-    // Layout IDs (second digit)
+    // Layout numbers within a family
     constexpr int LAYOUT_QWERTY = 1;
     constexpr int LAYOUT_WORKMAN = 2;
     constexpr int LAYOUT_COLEMAK = 3;
     constexpr int LAYOUT_DVORAK = 4;
     constexpr int LAYOUT_RUSSIAN = 1;  // Russian is layout 1 in Cyrillic family
     
-    // Key positions (A-Z = 1-26)
-    constexpr int KEY_A = 1;
-    constexpr int KEY_B = 2;
-    constexpr int KEY_C = 3;
-    constexpr int KEY_D = 4;
-    constexpr int KEY_E = 5;
-    constexpr int KEY_F = 6;
-    constexpr int KEY_G = 7;
-    constexpr int KEY_H = 8;
-    constexpr int KEY_I = 9;
-    constexpr int KEY_J = 10;
-    constexpr int KEY_K = 11;
-    constexpr int KEY_L = 12;
-    constexpr int KEY_M = 13;
-    constexpr int KEY_N = 14;
-    constexpr int KEY_O = 15;
-    constexpr int KEY_P = 16;
-    constexpr int KEY_Q = 17;
-    constexpr int KEY_R = 18;
-    constexpr int KEY_S = 19;
-    constexpr int KEY_T = 20;
-    constexpr int KEY_U = 21;
-    constexpr int KEY_V = 22;
-    constexpr int KEY_W = 23;
-    constexpr int KEY_X = 24;
-    constexpr int KEY_Y = 25;
-    constexpr int KEY_Z = 26;
+    // Physical keys, named after their US QWERTY legend. Letter keys come
+    // first in row order (Q = 1 ... M = 26), as in legacy key IDs.
+    constexpr int KEY_Q = 1;
+    constexpr int KEY_W = 2;
+    constexpr int KEY_E = 3;
+    constexpr int KEY_R = 4;
+    constexpr int KEY_T = 5;
+    constexpr int KEY_Y = 6;
+    constexpr int KEY_U = 7;
+    constexpr int KEY_I = 8;
+    constexpr int KEY_O = 9;
+    constexpr int KEY_P = 10;
+    constexpr int KEY_A = 11;
+    constexpr int KEY_S = 12;
+    constexpr int KEY_D = 13;
+    constexpr int KEY_F = 14;
+    constexpr int KEY_G = 15;
+    constexpr int KEY_H = 16;
+    constexpr int KEY_J = 17;
+    constexpr int KEY_K = 18;
+    constexpr int KEY_L = 19;
+    constexpr int KEY_Z = 20;
+    constexpr int KEY_X = 21;
+    constexpr int KEY_C = 22;
+    constexpr int KEY_V = 23;
+    constexpr int KEY_B = 24;
+    constexpr int KEY_N = 25;
+    constexpr int KEY_M = 26;
+    constexpr int KEY_BACKQUOTE = 27;
+    constexpr int KEY_DIGIT_1 = 28;  // KEY_DIGIT_1 + n - 1 for digits 1-9
+    constexpr int KEY_DIGIT_0 = 37;
+    constexpr int KEY_MINUS = 38;
+    constexpr int KEY_EQUAL = 39;
+    constexpr int KEY_BRACKET_LEFT = 40;
+    constexpr int KEY_BRACKET_RIGHT = 41;
+    constexpr int KEY_BACKSLASH = 42;
+    constexpr int KEY_SEMICOLON = 43;
+    constexpr int KEY_QUOTE = 44;
+    constexpr int KEY_COMMA = 45;
+    constexpr int KEY_PERIOD = 46;
+    constexpr int KEY_SLASH = 47;
+    constexpr int KEY_INTL_BACKSLASH = 48;  // ISO key between left Shift and Z
+    constexpr int PHYSICAL_KEY_COUNT = 48;
+    
+    // Modifier levels; each level is a full copy of the physical keys
+    constexpr int LEVEL_BASE = 0;
+    constexpr int LEVEL_SHIFT = 1;
+    constexpr int LEVEL_ALTGR = 2;
+    constexpr int LEVEL_SHIFT_ALTGR = 3;
+    constexpr int LEVEL_COUNT = 4;
+    
+    // Largest key position (position 0 means "no key")
+    constexpr int MAX_KEY_POSITION = LEVEL_COUNT * PHYSICAL_KEY_COUNT;
+    
+    // Position of a physical key at a modifier level
+    constexpr int key_position(int physical_key, int level = LEVEL_BASE) {
+        return level * PHYSICAL_KEY_COUNT + physical_key;
+    }
+    
+    constexpr int physical_key(int key_position) { return (key_position - 1) % PHYSICAL_KEY_COUNT + 1; }
+    constexpr int level(int key_position) { return (key_position - 1) / PHYSICAL_KEY_COUNT; }
 }
 
-// Generate key ID: FamilyID * 1000 + LayoutID * 100 + KeyPosition
+// Legacy decimal key IDs (FamilyID * 1000 + LayoutID * 100 + KeyPosition),
+// still accepted as key names in layout JSON files. They cannot describe
+// more than 9 layouts per family or modifier levels; nothing outside file
+// parsing uses them.
 inline int generate_key_id(int family_id, int layout_id, int key_position) {
     return family_id * 1000 + layout_id * 100 + key_position;
 }
 
-// Parse key ID into components
+// Parse a legacy key ID into components
 struct KeyIDComponents {
     int family_id;
     int layout_id;
@@ -73,19 +118,115 @@ struct KeyIDComponents {
     }
 };
 
-// Layout definition using key IDs
+struct StringBatch;         // See batch_converter.h
+class IncrementalDetector;  // See incremental_detector.h
+
+// Stable integer handle for a registered layout name (see resolve_layout)
+using LayoutHandle = int;
+constexpr LayoutHandle INVALID_LAYOUT_HANDLE = -1;
+
+static_assert(KeyID::MAX_KEY_POSITION <= 255, "Key positions are stored in one byte");
+
+// Layout definition using key IDs.
+// Characters are kept in flat tables indexed by key position and by
+// codepoint, so lookups never hash and never allocate.
 struct LayoutDefinition {
     std::string id;
     std::string name;
     int family_id;
     int layout_id;
-    std::unordered_map<int, char> key_to_char;  // KeyID -> Character
-    std::unordered_map<char, int> char_to_key;  // Character -> KeyID
+    std::string language;  // Language tag of the detection model (e.g. "en")
+    std::array<char32_t, KeyID::MAX_KEY_POSITION + 1> key_to_char{};          // Key position -> codepoint (0 = unused)
+    std::array<utf8::EncodedChar, KeyID::MAX_KEY_POSITION + 1> key_to_utf8{};  // Key position -> UTF-8 bytes
+    utf8::CodepointTable<unsigned char> char_to_key;                            // Codepoint -> key position (0 = none)
     double frequency_score;
     std::vector<std::string> common_words;
+    
+    // Assign a character to a key position (1..MAX_KEY_POSITION)
+    void set_key(int key_position, char32_t c);
+    
+    // Fill the Shift and Shift+AltGr levels of keys that leave them unset
+    // with the uppercase of the unshifted character, unless that uppercase
+    // already sits on some key. Applied when a layout is registered, so
+    // conversion maps every level directly and never changes case itself.
+    void complete_shift_levels();
+    
+    // Key position of a character, or 0 if the layout does not have it
+    int key_position_for(char32_t c) const { return char_to_key.get(c); }
+};
+
+// Conversion plan compiled for a single (from, to) layout pair.
+// Every key position of both layouts, modifier levels included, is
+// resolved once at compile time, so converting text is a single table
+// load per character.
+struct ConversionPlan {
+    std::string from_layout_id;
+    std::string to_layout_id;
+    bool byte_only = true;            // Every mapping is ASCII -> ASCII (byte kernel applies)
+    unsigned char max_expansion = 1;  // Upper bound on output bytes per input byte
+    std::array<unsigned char, 256> byte_table;                // Single-byte view (identity if unmapped or multibyte)
+    std::array<utf8::EncodedChar, 128> ascii_table;           // ASCII source -> encoded target
+    utf8::CodepointTable<utf8::EncodedChar> codepoint_table;  // Non-ASCII source -> encoded target (length 0 = keep)
+    
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    
+    char convert_char(char c) const {
+        return static_cast<char>(byte_table[static_cast<unsigned char>(c)]);
+    }
+    
+    // Output capacity that lets convert_into take its unchecked fast path
+    size_t max_converted_size(size_t input_size) const {
+        return byte_only ? input_size : input_size * max_expansion + 4;
+    }
+    
+    // Convert into caller-owned storage without allocating.
+    // Returns bytes written, or npos if the output does not fit.
+    size_t convert_into(std::string_view text, char* out, size_t capacity) const;
+    
+    // Exact number of bytes convert() would produce for `text`
+    size_t converted_size(std::string_view text) const;
+    
+    // Append the converted text to `buffer`, reusing its capacity.
+    // Returns bytes appended.
+    size_t append_to(std::string_view text, std::string& buffer) const;
+    
+    // Convert text using the precompiled tables
+    std::string convert(std::string_view text) const;
+};
+
+// One reading of a text during detection: the keys were pressed on
+// `typed_layout` while the user meant to write in `intended_layout`. The two
+// are equal when the text was typed on the right layout.
+struct LayoutHypothesis {
+    LayoutHandle typed_layout;
+    LayoutHandle intended_layout;
+    double score;  // Mean log-probability per character plus priors; higher is better
+    uint32_t common_words = 0;  // Common words of `intended_layout` found in the text
+};
+
+// Hypotheses of many texts in one flat array: those of text i are
+// [begin(i), end(i)), best first. Reusing a batch reuses its storage.
+struct DetectionBatch {
+    std::vector<LayoutHypothesis> hypotheses;
+    std::vector<size_t> offsets;  // size() + 1 entries
+    
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    const LayoutHypothesis* begin(size_t i) const { return hypotheses.data() + offsets[i]; }
+    const LayoutHypothesis* end(size_t i) const { return hypotheses.data() + offsets[i + 1]; }
+};
+
+// Counters of the directory watcher (see watch_directory)
+struct ReloadStats {
+    uint64_t reloads = 0;             // Batches of file changes published
+    uint64_t layouts_reloaded = 0;    // Layout files swapped in
+    uint64_t layouts_removed = 0;     // Layouts unloaded because their file was deleted
+    uint64_t failed_validations = 0;  // Changed files rejected; the previous version stays loaded
+    uint64_t last_latency_us = 0;     // First change noticed -> new registry published
+    uint64_t max_latency_us = 0;
 };
 
-// Layout library using key IDs
+// Layout library using key IDs. All methods may be called concurrently;
+// readers never block on, or observe a half-applied, layout reload.
 class KeyBasedLayoutLibrary {
 public:
     KeyBasedLayoutLibrary();
@@ -94,18 +235,158 @@ public:
     // Load layout from JSON file
     bool load_layout(const std::string& layout_id, const std::string& file_path);
     
-    // Get layout by ID
-    std::shared_ptr<LayoutDefinition> get_layout(const std::string& layout_id);
+    // Load every *.json layout in a directory, using the file name (without
+    // extension) as the layout ID. Returns the number of layouts loaded.
+    size_t load_directory(const std::string& directory);
+    
+    // Register the layouts compiled into the library (see builtin_layouts.h).
+    // No file access or parsing; returns the number registered.
+    size_t load_builtin_layouts();
+    
+    // Register a copy of an already-built layout under `layout_id`,
+    // replacing any layout with that ID. Later changes to `layout` do not
+    // reach the library.
+    bool add_layout(const std::string& layout_id, std::shared_ptr<const LayoutDefinition> layout);
+    
+    // Watch a directory of *.json layouts (usually after load_directory) and
+    // reload files as they change, on a background thread. Changed files
+    // are parsed and validated, then swapped in together; a file that fails
+    // validation is counted and its previous version kept. Deleting a file
+    // unloads its layout. Replaces any previous watch. Returns false if the
+    // directory cannot be watched (file notifications are Linux only).
+    bool watch_directory(const std::string& directory);
+    
+    // Stop the watcher; no reload starts after this returns
+    void stop_watching();
+    
+    ReloadStats get_reload_stats() const;
+    
+    // Load all layouts from a binary layout pack (see layout_pack.h)
+    bool load_pack(const std::string& file_path);
+    
+    // Load a word dictionary (see word_dictionary.h). Detection then
+    // favors readings whose words are in the dictionary of the intended
+    // layout's language. Replaces any dictionary of the same language.
+    // Returns false if the file cannot be opened or fails validation.
+    bool load_dictionary(const std::string& file_path);
+    
+    // Load a trained character n-gram model (see ngram_model.h, `layout_converter
+    // train`). Detection for its language then reads the model from the
+    // mapped file instead of building one from the layouts and compiled-in
+    // corpora. Replaces any model of the same language. Returns false if
+    // the file cannot be opened or fails validation.
+    bool load_language_model(const std::string& file_path);
+    
+    // Write all loaded layouts to a binary layout pack
+    bool save_pack(const std::string& file_path) const;
+    
+    // Get layout by ID. Loaded layouts are shared with concurrent readers,
+    // so they are read-only: copy one and pass it to add_layout to change it.
+    std::shared_ptr<const LayoutDefinition> get_layout(const std::string& layout_id);
+    
+    // Resolve a layout ID to its handle once, for use with the handle-based
+    // overloads. A handle stays valid for the lifetime of the library, also
+    // across reloads and clear_cache(). Returns INVALID_LAYOUT_HANDLE if the
+    // ID was never loaded.
+    LayoutHandle resolve_layout(const std::string& layout_id) const;
+    
+    // Layout ID a handle was resolved from, or an empty string
+    std::string get_layout_id(LayoutHandle handle) const;
+    
+    // Compile (or fetch from cache) the conversion plan for a layout pair.
+    // Returns nullptr if either layout is not loaded.
+    std::shared_ptr<const ConversionPlan> compile(const std::string& from_layout_id,
+                                                  const std::string& to_layout_id);
+    std::shared_ptr<const ConversionPlan> compile(LayoutHandle from_layout, LayoutHandle to_layout);
     
     // Convert text using key IDs (most efficient)
     std::string convert_text(const std::string& text, 
                            const std::string& from_layout_id, 
                            const std::string& to_layout_id);
     
-    // Smart detection using key patterns
+    // Zero-allocation conversion into caller-owned storage. Returns bytes
+    // written, or ConversionPlan::npos if the output does not fit. Text is
+    // copied unchanged if either layout is not loaded.
+    size_t convert_text(std::string_view text, LayoutHandle from_layout, LayoutHandle to_layout,
+                        char* out, size_t capacity);
+    
+    // Append the conversion to a reusable buffer. Returns bytes appended.
+    size_t convert_text(std::string_view text, LayoutHandle from_layout, LayoutHandle to_layout,
+                        std::string& out);
+    
+    // Convert many strings with one layout pair into a single arena (see
+    // batch_converter.h). Layouts are resolved once for the whole batch;
+    // strings are copied unchanged if either layout is not loaded.
+    void convert_batch(const std::vector<std::string_view>& inputs, LayoutHandle from_layout,
+                       LayoutHandle to_layout, StringBatch& out, unsigned threads = 1);
+    void convert_batch(const std::vector<std::string_view>& inputs, const std::string& from_layout_id,
+                       const std::string& to_layout_id, StringBatch& out, unsigned threads = 1);
+    
+    // Convert a whole file using memory mapping and `threads` workers
+    // (0 = hardware concurrency). Returns false if a layout is not loaded,
+    // if both paths name the same file, or on I/O error.
+    bool convert_file(const std::string& input_path, const std::string& output_path,
+                      const std::string& from_layout_id, const std::string& to_layout_id,
+                      unsigned threads = 0);
+    
+    // Convert one text into several layouts at once, e.g. for "did you
+    // mean" alternatives: out[i] is the text as typed on `from_layout`
+    // read on target_layouts[i] (see batch_converter.h). The text is
+    // decoded into key positions once and every output goes into one
+    // arena, so the per-call overhead is paid once rather than per target;
+    // this matters most for short texts. Text is copied unchanged for
+    // layouts that are not loaded.
+    void convert_fanout(std::string_view text, LayoutHandle from_layout,
+                        const std::vector<LayoutHandle>& target_layouts, StringBatch& out);
+    void convert_fanout(std::string_view text, const std::string& from_layout_id,
+                        const std::vector<std::string>& target_layout_ids, StringBatch& out);
+    
+    // Fan-out with every layout handle as a possible source:
+    // out[from * target_layouts.size() + i] is the text as typed on handle
+    // `from` read on target_layouts[i], for every handle resolved so far
+    // (out.size() / target_layouts.size() of them).
+    void convert_fanout(std::string_view text, const std::vector<LayoutHandle>& target_layouts, StringBatch& out);
+    
+    // Layouts the text was likely typed on, best first. Ranked by the best
+    // hypothesis each layout appears in as `typed_layout`.
     std::vector<std::string> detect_likely_layouts(const std::string& text, 
                                                   const std::string& user_language = "en");
     
+    // Score every (typed, intended) layout pair against the character n-gram
+    // model of the intended layout's language, best first. Layouts that do
+    // not cover at least half of the text's letters are not considered as
+    // typed layouts. `max_results` = 0 returns all hypotheses.
+    std::vector<LayoutHypothesis> detect_hypotheses(std::string_view text,
+                                                    const std::string& user_language = "en",
+                                                    size_t max_results = 0);
+    
+    // Score many texts as detect_hypotheses does, keeping the best `top_k`
+    // hypotheses of each (0 = all). Inputs are split into blocks scored by
+    // `threads` workers (0 = hardware concurrency).
+    void detect_batch(const std::vector<std::string_view>& inputs, const std::string& user_language,
+                      DetectionBatch& out, size_t top_k = 1, unsigned threads = 1);
+    
+    // Auto-correct mixed text: convert only the words that were typed on
+    // the wrong one of `candidate_layouts` ("hello ghbdtn world" ->
+    // "hello привет world"). Each word is scored under every (typed,
+    // intended) candidate pair and converted only when a converted reading
+    // is much more likely than the text as written. Linear in the text,
+    // with no per-word allocation. Time and memory per word grow with the
+    // square of the candidate count (one reading per ordered pair), so
+    // this is meant for a handful of candidates. Lists of more than
+    // MAX_FIX_CANDIDATES (at most 4033 readings, 16 KB of state per word)
+    // are not searched: the text is returned as written.
+    static constexpr size_t MAX_FIX_CANDIDATES = 64;
+    std::string fix_mistyped(std::string_view text, const std::vector<std::string>& candidate_layouts);
+    
+    // Append the corrected text to a reusable buffer. Returns bytes appended.
+    size_t fix_mistyped(std::string_view text, const std::vector<LayoutHandle>& candidate_layouts,
+                        std::string& out);
+    
+    // Start detecting a text that arrives piece by piece (see
+    // incremental_detector.h), against the layouts loaded now
+    IncrementalDetector create_incremental_detector(const std::string& user_language = "en") const;
+    
     // Get all loaded layouts
     std::vector<std::string> get_loaded_layouts() const;
     
@@ -119,17 +400,32 @@ private:
 
 // Utility functions
 namespace KeyUtils {
-    // Convert character to key position (A=1, B=2, etc.)
+    // Physical key carrying a letter on US QWERTY (Q=1, W=2, ..., M=26)
     int char_to_key_position(char c);
     
-    // Convert key position to character (1=A, 2=B, etc.)
+    // US QWERTY letter on a physical key (1=Q, 2=W, ..., 26=M)
     char key_position_to_char(int position);
     
-    // Get key ID for a character in a specific layout
-    int get_key_id_for_char(char c, const LayoutDefinition& layout);
+    // Legacy key ID of a character in a specific layout (0 if not found or
+    // not on a base-level physical key, which is all legacy IDs encode)
+    int get_key_id_for_char(char32_t c, const LayoutDefinition& layout);
+    
+    // Character for a legacy key ID in a specific layout (0 if not found,
+    // or if the ID's position is not a physical key 1..PHYSICAL_KEY_COUNT)
+    char32_t get_char_for_key_id(int key_id, const LayoutDefinition& layout);
+    
+    // Key position for a key name in a layout file: a W3C key code such
+    // as "KeyA", "Digit1" or "BracketLeft", optionally prefixed with the
+    // modifier level ("Shift+Digit1", "AltGr+KeyE", "Shift+AltGr+KeyE"),
+    // or a legacy decimal key ID such as "1101" (base level only).
+    // Returns 0 for an unknown name.
+    int key_position_from_name(std::string_view name);
+    
+    // W3C key code of a physical key (1..PHYSICAL_KEY_COUNT), or "" if none
+    const char* key_name(int physical_key);
     
-    // Get character for a key ID in a specific layout
-    char get_char_for_key_id(int key_id, const LayoutDefinition& layout);
+    // Language tag assumed for layouts that do not declare one
+    std::string default_language_for_family(int family_id);
 }
 
 } // namespace layout_converter
@@ -0,0 +1,67 @@
+// Layout Pack
+// Versioned binary container for many layouts, loaded without JSON parsing
+
+#ifndef LAYOUT_PACK_H
+#define LAYOUT_PACK_H
+
+#include "key_system.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace layout_converter {
+
+// File layout (native little-endian):
+//   Header | Record[layout_count] | string table
+// Strings are NUL-terminated and referenced by offset into the string table.
+namespace LayoutPack {
+    constexpr char MAGIC[4] = {'L', 'C', 'P', 'K'};
+    constexpr uint32_t VERSION = 3;  // 2: Record::language, 3: dense key positions with modifier levels
+    
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t layout_count;
+        uint32_t key_slots;            // Entries in Record::keys
+        uint32_t records_offset;
+        uint32_t string_table_offset;
+        uint32_t string_table_size;
+        uint32_t checksum;             // FNV-1a over everything after the header
+    };
+    
+    struct Record {
+        double frequency_score;
+        uint32_t layout_id;            // ID the layout is registered under
+        uint32_t display_id;           // "id" field of the source JSON
+        uint32_t name;
+        int32_t family_id;
+        int32_t layout_number;
+        uint32_t common_words;         // First word; words are stored back to back
+        uint32_t common_word_count;
+        uint32_t language;             // Language tag of the detection model
+        uint32_t reserved;             // Zero; pads the record to a multiple of 8 bytes
+        char32_t keys[KeyID::MAX_KEY_POSITION + 1];  // Key position -> codepoint (0 = unused)
+    };
+    
+    static_assert(sizeof(Header) == 32, "LayoutPack::Header must stay 32 bytes");
+    static_assert(sizeof(Record) % 8 == 0, "LayoutPack::Record must stay 8-byte aligned");
+    
+    using Entry = std::pair<std::string, std::shared_ptr<LayoutDefinition>>;
+    using ConstEntry = std::pair<std::string, std::shared_ptr<const LayoutDefinition>>;
+    
+    // Write layouts to a pack file. Returns false on I/O error.
+    bool write(const std::string& path, const std::vector<ConstEntry>& layouts);
+    
+    // Map a pack file and rebuild its layouts. Returns false if the file is
+    // missing, truncated, of another version or fails its checksum.
+    bool read(const std::string& path, std::vector<Entry>& layouts);
+    
+    // FNV-1a 32-bit hash used for the pack checksum
+    uint32_t checksum(const char* data, size_t size);
+}
+
+} // namespace layout_converter
+
+#endif // LAYOUT_PACK_H
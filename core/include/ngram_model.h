@@ -0,0 +1,121 @@
+// N-gram Model
+// Character bigram/trigram language model of one language, trained offline
+// from text corpora and memory-mapped by detection in quantized form
+
+#ifndef NGRAM_MODEL_H
+#define NGRAM_MODEL_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace layout_converter {
+
+// Options of NgramModel::train
+struct NgramTrainOptions {
+    unsigned bits = 8;           // Per table value: 4, 8, 16 or 32 (unquantized)
+    unsigned trigram_bits = 16;  // log2 of the trigram buckets, 8..18
+    unsigned threads = 0;        // 0 = hardware concurrency
+};
+
+// File layout (native little-endian), every section padded to 8 bytes:
+//   Header | language | alphabet | bigram | trigram context | trigram
+// The alphabet lists the letters of symbols 1..symbol_count-1 (symbol 0 is
+// the word boundary). Each table holds log-values linearly quantized to
+// `bits` bits (value = offset + scale * code; 32 bits = plain floats). The
+// trigram table is hashed into 2^trigram_bits buckets and is the only one
+// that grows with the model, so it is read straight from the mapping; the
+// bigram tables have at most 64 x 64 entries.
+class NgramModel {
+public:
+    static constexpr char MAGIC[4] = {'L', 'C', 'N', 'M'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr unsigned MAX_SYMBOLS = 64;
+    static constexpr unsigned MIN_TRIGRAM_BITS = 8;
+    static constexpr unsigned MAX_TRIGRAM_BITS = 18;  // 64^3 possible trigrams
+
+    struct Quantization {
+        float offset;
+        float scale;
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t language_size;      // Bytes
+        uint32_t symbol_count;       // Including the boundary symbol
+        uint32_t bits;               // Per table value: 4, 8, 16 or 32
+        uint32_t trigram_bits;       // log2 of the trigram buckets
+        Quantization bigram;
+        Quantization trigram_context;
+        Quantization trigram;
+        uint32_t checksum;           // FNV-1a over everything after the header
+        uint32_t reserved;           // Zero; pads the header to 56 bytes
+    };
+
+    static_assert(sizeof(Header) == 56, "NgramModel::Header must stay 56 bytes");
+
+    // One quantized table, decoded on access
+    struct Table {
+        const unsigned char* codes = nullptr;
+        unsigned bits = 32;
+        Quantization quantization{0.0f, 1.0f};
+
+        float operator[](size_t index) const {
+            switch (bits) {
+                case 4:
+                    return quantization.offset +
+                           quantization.scale * ((codes[index / 2] >> (index % 2 * 4)) & 0xF);
+                case 8:
+                    return quantization.offset + quantization.scale * codes[index];
+                case 16: {
+                    uint16_t code;
+                    std::memcpy(&code, codes + index * 2, sizeof(code));
+                    return quantization.offset + quantization.scale * code;
+                }
+                default: {
+                    float value;
+                    std::memcpy(&value, codes + index * 4, sizeof(value));
+                    return value;
+                }
+            }
+        }
+    };
+
+    ~NgramModel();
+
+    // Count n-grams of the UTF-8 text files `corpus_paths` on
+    // `options.threads` threads and write the quantized model to `path`.
+    // The alphabet is the 63 most frequent letters. Returns false if a
+    // corpus cannot be read, the options are out of range, or on I/O error.
+    static bool train(const std::string& path, const std::string& language,
+                      const std::vector<std::string>& corpus_paths, const NgramTrainOptions& options = {});
+
+    // Map a model file. Returns nullptr if the file is missing, truncated,
+    // of another version or fails its checksum.
+    static std::shared_ptr<const NgramModel> open(const std::string& path);
+
+    const std::string& language() const;
+    const std::vector<char32_t>& alphabet() const;  // Letter of symbol i + 1
+    unsigned symbol_count() const;
+    unsigned bits() const;
+    unsigned trigram_bits() const;
+    size_t size_bytes() const;  // Of the mapped file
+
+    const Table& bigram() const;           // [a * symbol_count + b] -> log P(b | a)
+    const Table& trigram_context() const;  // [a * symbol_count + b] -> log (N(ab) + k * V)
+    const Table& trigram() const;          // [bucket(a, b, c)] -> log (N(abc) + k)
+
+private:
+    class Impl;
+
+    NgramModel();
+
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace layout_converter
+
+#endif // NGRAM_MODEL_H
@@ -0,0 +1,82 @@
+// Library Statistics
+// Optional per-operation counters and latency histograms of the core
+// library, compiled in with -DLAYOUT_CONVERTER_ENABLE_STATS=ON
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace layout_converter {
+
+namespace Stats {
+    enum class Counter {
+        CONVERT_CALLS,
+        CONVERT_BYTES_IN,
+        CONVERT_BYTES_OUT,
+        PASSTHROUGH_CHARACTERS,  // Characters copied unchanged (unmapped, or mapped to themselves)
+        PLAN_CACHE_HITS,         // Compiled pair tables found ready
+        PLAN_CACHE_MISSES,       // Pair tables compiled on demand
+        DETECT_CALLS,
+        DETECT_BYTES,
+        SOURCES_PRUNED,          // Loaded typed layouts ruled out before scoring, by script or coverage
+        HYPOTHESES_SCORED,       // (typed, intended) candidates given a bigram score
+        HYPOTHESES_RESCORED,     // Candidates close enough to the best to get trigrams
+        LAYOUTS_LOADED,
+        LAYOUT_LOAD_FAILURES,
+        COUNT
+    };
+    
+    enum class Operation {
+        CONVERT,      // convert_text, convert_batch
+        DETECT,       // detect_likely_layouts, detect_hypotheses, detect_batch
+        LOAD_LAYOUT,  // load_layout, load_directory, load_pack, load_builtin_layouts
+        COUNT
+    };
+    
+    constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+    constexpr size_t OPERATION_COUNT = static_cast<size_t>(Operation::COUNT);
+    
+    // Bucket 0 holds latencies below 2 ns, bucket i those in [2^i, 2^(i+1)) ns;
+    // the last bucket also holds everything slower
+    constexpr size_t HISTOGRAM_BUCKETS = 40;
+    
+    struct Histogram {
+        std::array<uint64_t, HISTOGRAM_BUCKETS> buckets{};
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        
+        // Upper bound of the bucket holding the given quantile (0..1), or 0
+        // if nothing was recorded
+        uint64_t quantile_ns(double quantile) const;
+        
+        double mean_ns() const { return count ? static_cast<double>(total_ns) / count : 0.0; }
+    };
+    
+    struct Snapshot {
+        bool enabled = false;  // False if the library was built without statistics
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+        std::array<Histogram, OPERATION_COUNT> latency{};
+        
+        uint64_t operator[](Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+        const Histogram& operator[](Operation operation) const { return latency[static_cast<size_t>(operation)]; }
+    };
+    
+    // Whether the library records statistics
+    bool enabled();
+    
+    // Totals across all threads since the start or the last reset()
+    Snapshot snapshot();
+    
+    // Start counting from zero
+    void reset();
+    
+    const char* counter_name(Counter counter);
+    const char* operation_name(Operation operation);
+}
+
+} // namespace layout_converter
+
+#endif // STATS_H
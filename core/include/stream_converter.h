@@ -0,0 +1,45 @@
+// Stream Converter
+// Chunked layout conversion for streams of any size in constant memory
+
+#ifndef STREAM_CONVERTER_H
+#define STREAM_CONVERTER_H
+
+#include "key_system.h"
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace layout_converter {
+
+class StreamConverter {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+    
+    explicit StreamConverter(std::shared_ptr<const ConversionPlan> plan,
+                             size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    
+    // Convert the next piece of input and append the result to `out`.
+    // An incomplete UTF-8 sequence at the end is held back and completed
+    // by the next call.
+    void feed(std::string_view input, std::string& out);
+    
+    // Flush any held bytes (an unterminated sequence passes through as-is)
+    void finish(std::string& out);
+    
+    // Convert all of `in` to `out` chunk by chunk. Memory use is bounded by
+    // the chunk size. Returns false on a read or write error.
+    bool convert(std::istream& in, std::ostream& out);
+    
+    size_t chunk_size() const { return chunk_size_; }
+
+private:
+    std::shared_ptr<const ConversionPlan> plan_;
+    size_t chunk_size_;
+    std::string carry_;  // At most 3 bytes of an incomplete sequence
+};
+
+} // namespace layout_converter
+
+#endif // STREAM_CONVERTER_H
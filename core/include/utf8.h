@@ -0,0 +1,173 @@
+// UTF-8 Support
+// Codepoint decoding/encoding and flat codepoint-indexed tables
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace layout_converter {
+namespace utf8 {
+
+constexpr char32_t INVALID_CODEPOINT = 0xFFFFFFFF;
+
+// A character pre-encoded as UTF-8 so the convert loop can copy it
+// with a fixed 4-byte store and advance by `length`
+struct EncodedChar {
+    char bytes[4] = {0, 0, 0, 0};
+    unsigned char length = 0;  // 0 = unmapped
+};
+
+// Sequence length by lead byte, indexed by (byte >> 3); 0 = invalid lead
+constexpr unsigned char SEQUENCE_LENGTH[32] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x00-0x7F
+    0, 0, 0, 0, 0, 0, 0, 0,                          // 0x80-0xBF continuation
+    2, 2, 2, 2,                                      // 0xC0-0xDF
+    3, 3,                                            // 0xE0-0xEF
+    4,                                               // 0xF0-0xF7
+    0                                                // 0xF8-0xFF
+};
+
+inline size_t sequence_length(unsigned char lead) {
+    return SEQUENCE_LENGTH[lead >> 3];
+}
+
+inline bool is_continuation(unsigned char b) {
+    return (b & 0xC0) == 0x80;
+}
+
+// Decode one character at `p` (p < end). Returns the number of bytes
+// consumed, always >= 1. Malformed or truncated input yields
+// INVALID_CODEPOINT with a length of 1 so the byte can be passed through.
+inline size_t decode(const char* p, const char* end, char32_t& cp) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(p);
+    size_t length = sequence_length(s[0]);
+    size_t available = static_cast<size_t>(end - p);
+
+    switch (length) {
+        case 1:
+            cp = s[0];
+            return 1;
+        case 2:
+            if (available >= 2 && is_continuation(s[1])) {
+                cp = (char32_t(s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+                if (cp >= 0x80) return 2;
+            }
+            break;
+        case 3:
+            if (available >= 3 && is_continuation(s[1]) && is_continuation(s[2])) {
+                cp = (char32_t(s[0] & 0x0F) << 12) | (char32_t(s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+                if (cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF)) return 3;
+            }
+            break;
+        case 4:
+            if (available >= 4 && is_continuation(s[1]) && is_continuation(s[2]) && is_continuation(s[3])) {
+                cp = (char32_t(s[0] & 0x07) << 18) | (char32_t(s[1] & 0x3F) << 12) |
+                     (char32_t(s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+                if (cp >= 0x10000 && cp <= 0x10FFFF) return 4;
+            }
+            break;
+    }
+
+    cp = INVALID_CODEPOINT;
+    return 1;
+}
+
+// Length of the longest prefix of `data` that does not end in the middle
+// of a UTF-8 sequence. Malformed tails count as complete so they pass
+// through instead of being held forever.
+inline size_t complete_prefix_length(const char* data, size_t size) {
+    size_t stop = size > 4 ? size - 4 : 0;
+    for (size_t i = size; i > stop; --i) {
+        unsigned char b = static_cast<unsigned char>(data[i - 1]);
+        if (is_continuation(b)) continue;
+        size_t length = sequence_length(b);
+        return (length > 1 && i - 1 + length > size) ? i - 1 : size;
+    }
+    return size;
+}
+
+// Encode a codepoint; returns an unmapped EncodedChar for invalid input
+constexpr EncodedChar encode(char32_t cp) {
+    EncodedChar e;
+    if (cp < 0x80) {
+        e.bytes[0] = static_cast<char>(cp);
+        e.length = 1;
+    } else if (cp < 0x800) {
+        e.bytes[0] = static_cast<char>(0xC0 | (cp >> 6));
+        e.bytes[1] = static_cast<char>(0x80 | (cp & 0x3F));
+        e.length = 2;
+    } else if (cp < 0x10000) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) return e;
+        e.bytes[0] = static_cast<char>(0xE0 | (cp >> 12));
+        e.bytes[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        e.bytes[2] = static_cast<char>(0x80 | (cp & 0x3F));
+        e.length = 3;
+    } else if (cp <= 0x10FFFF) {
+        e.bytes[0] = static_cast<char>(0xF0 | (cp >> 18));
+        e.bytes[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        e.bytes[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        e.bytes[3] = static_cast<char>(0x80 | (cp & 0x3F));
+        e.length = 4;
+    }
+    return e;
+}
+
+// Simple case mapping for the scripts we ship layouts for (ASCII,
+// Latin-1 and Cyrillic); other codepoints are returned unchanged
+constexpr char32_t to_lower(char32_t cp) {
+    if (cp >= 'A' && cp <= 'Z') return cp + 0x20;
+    if (cp < 0xC0) return cp;
+    if (cp <= 0xDE && cp != 0xD7) return cp + 0x20;          // Latin-1 À-Þ
+    if (cp >= 0x0410 && cp <= 0x042F) return cp + 0x20;      // Cyrillic А-Я
+    if (cp >= 0x0400 && cp <= 0x040F) return cp + 0x50;      // Cyrillic Ѐ-Џ
+    return cp;
+}
+
+constexpr char32_t to_upper(char32_t cp) {
+    if (cp >= 'a' && cp <= 'z') return cp - 0x20;
+    if (cp < 0xE0) return cp;
+    if (cp <= 0xFE && cp != 0xF7) return cp - 0x20;          // Latin-1 à-þ
+    if (cp >= 0x0430 && cp <= 0x044F) return cp - 0x20;      // Cyrillic а-я
+    if (cp >= 0x0450 && cp <= 0x045F) return cp - 0x50;      // Cyrillic ѐ-џ
+    return cp;
+}
+
+// Flat table indexed by BMP codepoint, stored as 256-entry pages that are
+// only allocated when something is written to them. Lookups are two
+// array loads; codepoints outside the BMP always read as T{}.
+template <typename T>
+class CodepointTable {
+public:
+    const T& get(char32_t cp) const {
+        static const T empty{};
+        if (cp > 0xFFFF) return empty;
+        uint16_t page = page_index_[cp >> 8];
+        return page ? pages_[page - 1][cp & 0xFF] : empty;
+    }
+
+    void set(char32_t cp, const T& value) {
+        if (cp > 0xFFFF) return;
+        uint16_t& page = page_index_[cp >> 8];
+        if (!page) {
+            pages_.emplace_back();
+            pages_.back().fill(T{});
+            page = static_cast<uint16_t>(pages_.size());
+        }
+        pages_[page - 1][cp & 0xFF] = value;
+    }
+
+    size_t page_count() const { return pages_.size(); }
+
+private:
+    std::array<uint16_t, 256> page_index_{};  // High byte -> page number + 1 (0 = empty)
+    std::vector<std::array<T, 256>> pages_;
+};
+
+} // namespace utf8
+} // namespace layout_converter
+
+#endif // UTF8_H
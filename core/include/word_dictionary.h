@@ -0,0 +1,83 @@
+// Word Dictionary
+// Minimal acyclic automaton over the words of one language, built offline
+// and memory-mapped for lookups during detection
+
+#ifndef WORD_DICTIONARY_H
+#define WORD_DICTIONARY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace layout_converter {
+
+// File layout (native little-endian):
+//   Header | language | Bloom filter words | arcs
+// The automaton is over UTF-8 bytes. Each arc is one 32-bit word: label
+// byte, a flag for "a word ends after this arc", a flag for the last arc
+// of its state, and the index of the target state's first arc (0 = a
+// state with no arcs). Shared suffixes are stored once, so a 500k-word
+// list takes a few MB and a lookup reads one short arc run per byte.
+class WordDictionary {
+public:
+    static constexpr char MAGIC[4] = {'L', 'C', 'W', 'D'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t MAX_ARCS = 1u << 22;  // Width of the target field
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t word_count;
+        uint32_t root;               // First arc of the start state
+        uint32_t language_size;      // Bytes, padded to 8 in the file
+        uint32_t bloom_words;        // 64-bit words of the Bloom filter (0 = none)
+        uint32_t bloom_hashes;
+        uint32_t arc_count;
+        uint32_t checksum;           // FNV-1a over everything after the header
+        uint32_t reserved;           // Zero; pads the header to 40 bytes
+    };
+
+    static_assert(sizeof(Header) == 40, "WordDictionary::Header must stay 40 bytes");
+
+    ~WordDictionary();
+
+    // Build the automaton of `words` and write it to `path`. Words are
+    // lowercased and deduplicated; empty ones are skipped. With
+    // `bloom_bits_per_word` > 0 a Bloom filter of that density is stored
+    // too and rejects most absent words before the automaton is walked.
+    // Returns false on I/O error or if the automaton has more than MAX_ARCS
+    // arcs.
+    static bool write(const std::string& path, const std::string& language, std::vector<std::string> words,
+                      unsigned bloom_bits_per_word = 0);
+
+    // Map a dictionary file. Returns nullptr if the file is missing,
+    // truncated, of another version or fails its checksum.
+    static std::shared_ptr<const WordDictionary> open(const std::string& path);
+
+    // Whether `word` (UTF-8, lowercase) is in the dictionary
+    bool contains(std::string_view word) const;
+
+    const std::string& language() const;
+    size_t word_count() const;
+    size_t size_bytes() const;  // Of the mapped file
+
+private:
+    class Impl;
+
+    WordDictionary();
+
+    // Views into the mapping held by pImpl, so lookups skip the indirection
+    const uint32_t* arcs_ = nullptr;
+    uint32_t root_ = 0;
+    const uint64_t* bloom_ = nullptr;
+    uint64_t bloom_bits_ = 0;
+    uint32_t bloom_hashes_ = 0;
+
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace layout_converter
+
+#endif // WORD_DICTIONARY_H
@@ -0,0 +1,170 @@
+// Batch Converter Implementation
+
+#include "../include/batch_converter.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace layout_converter {
+
+void convert_batch(const ConversionPlan& plan, const std::string_view* inputs, size_t count,
+                   StringBatch& out, unsigned threads, size_t min_chunk_size) {
+    out.offsets.resize(count + 1);
+    out.offsets[0] = 0;
+    
+    // Chunks of consecutive inputs. Every input gets an upper-bound output
+    // region, so it converts on the unchecked fast path without a sizing
+    // pass; regions are compacted afterwards if the plan can shrink text.
+    size_t input_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        input_size += inputs[i].size();
+    }
+    size_t chunk_count = std::min<size_t>(input_size / std::max<size_t>(min_chunk_size, 1),
+                                          size_t(resolve_thread_count(threads)) * 4);
+    chunk_count = std::max<size_t>(1, std::min(chunk_count, count));
+    
+    std::vector<size_t> first(chunk_count + 1);   // First input of each chunk
+    std::vector<size_t> region(chunk_count + 1);  // Arena offset of each chunk's region
+    for (size_t c = 0, i = 0, bound = 0; c < chunk_count; ++c) {
+        first[c] = i;
+        region[c] = bound;
+        for (size_t end = count * (c + 1) / chunk_count; i < end; ++i) {
+            bound += plan.max_converted_size(inputs[i].size());
+        }
+        first[c + 1] = i;
+        region[c + 1] = bound;
+    }
+    out.arena.resize(region[chunk_count]);
+    
+    std::vector<size_t> written_end(chunk_count);
+    char* arena = &out.arena[0];
+    parallel_for(chunk_count, threads, [&](size_t c) {
+        size_t position = region[c];
+        for (size_t i = first[c]; i < first[c + 1]; ++i) {
+            out.offsets[i] = position;
+            position += plan.convert_into(inputs[i], arena + position, plan.max_converted_size(inputs[i].size()));
+        }
+        written_end[c] = position;
+    });
+    
+    // Close the gaps left by upper bounds (none for byte-preserving plans)
+    size_t size = 0;
+    for (size_t c = 0; c < chunk_count; ++c) {
+        size_t shift = region[c] - size;
+        if (shift) {
+            std::memmove(arena + size, arena + region[c], written_end[c] - region[c]);
+            for (size_t i = first[c]; i < first[c + 1]; ++i) {
+                out.offsets[i] -= shift;
+            }
+        }
+        size += written_end[c] - region[c];
+    }
+    out.offsets[count] = size;
+    out.arena.resize(size);
+}
+
+namespace {
+
+// keep[n] selects the first n bytes of a 4-byte load, whatever the byte order
+const std::array<uint32_t, 5>& prefix_masks() {
+    static const std::array<uint32_t, 5> masks = [] {
+        std::array<uint32_t, 5> result{};
+        for (size_t n = 0; n <= 4; ++n) {
+            unsigned char bytes[4] = {};
+            std::fill(bytes, bytes + n, 0xFF);
+            std::memcpy(&result[n], bytes, 4);
+        }
+        return result;
+    }();
+    return masks;
+}
+
+// Per-thread buffers of convert_fanout, so short texts convert without
+// allocating once a thread has warmed up
+struct FanoutScratch {
+    std::vector<char32_t> codepoints;      // Decoded text (INVALID_CODEPOINT for malformed bytes)
+    std::vector<uint64_t> original;        // Source bytes of each character | length << 32
+    std::vector<uint32_t> positions;       // Key position of each character on the current source (not a
+                                           // char type, so the stores cannot alias the lookup table)
+};
+
+} // namespace
+
+void convert_fanout(std::string_view text, const LayoutDefinition* const* sources, size_t source_count,
+                    const LayoutDefinition* const* targets, size_t target_count, StringBatch& out) {
+    thread_local FanoutScratch scratch;
+    auto& [codepoints, original, positions] = scratch;
+    
+    // Decode once, keeping each character's own bytes for the ones a
+    // target has no key for
+    codepoints.resize(text.size());
+    original.resize(text.size());
+    size_t char_count = 0;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    const uint32_t* keep = prefix_masks().data();
+    while (p < end) {
+        char32_t cp;
+        size_t length = utf8::decode(p, end, cp);
+        uint32_t packed = 0;
+        if (end - p >= 4) {
+            std::memcpy(&packed, p, 4);
+            packed &= keep[length];
+        } else {
+            std::memcpy(&packed, p, length);
+        }
+        codepoints[char_count] = cp;
+        original[char_count++] = packed | uint64_t(length) << 32;
+        p += length;
+    }
+    positions.resize(char_count);
+    
+    // Outputs are written back to back with fixed 4-byte stores; the arena
+    // only grows when the next output might not fit
+    out.arena.clear();
+    out.offsets.assign(1, 0);
+    size_t cursor = 0;
+    for (size_t s = 0; s < source_count; ++s) {
+        const LayoutDefinition* source = sources[s];
+        for (size_t i = 0; source && i < char_count; ++i) {
+            positions[i] = static_cast<uint32_t>(source->key_position_for(codepoints[i]));
+        }
+        for (size_t t = 0; t < target_count; ++t) {
+            size_t bound = cursor + char_count * 4 + 4;
+            if (out.arena.size() < bound) {
+                out.arena.resize(std::max(bound, out.arena.size() * 2));
+            }
+            char* o = &out.arena[cursor];
+            if (!source || !targets[t]) {
+                std::memcpy(o, text.data(), text.size());
+                cursor += text.size();
+                out.offsets.push_back(cursor);
+                continue;
+            }
+            
+            // Locals, so the stores cannot alias them
+            const utf8::EncodedChar* table = targets[t]->key_to_utf8.data();
+            const uint32_t* position = positions.data();
+            const uint64_t* fallback = original.data();
+            char* const begin = o;
+            for (size_t i = 0; i < char_count; ++i) {
+                const utf8::EncodedChar& mapped = table[position[i]];
+                if (mapped.length) {
+                    std::memcpy(o, mapped.bytes, 4);
+                    o += mapped.length;
+                } else {
+                    uint64_t kept = fallback[i];
+                    uint32_t bytes = static_cast<uint32_t>(kept);
+                    std::memcpy(o, &bytes, 4);
+                    o += kept >> 32;
+                }
+            }
+            cursor += static_cast<size_t>(o - begin);
+            out.offsets.push_back(cursor);
+        }
+    }
+    out.arena.resize(cursor);
+}
+
+} // namespace layout_converter
@@ -0,0 +1,32 @@
+// Corpus Word Counts
+// Word frequencies of the in-tree text corpora, compiled into the library
+// to seed the detection language models
+
+#ifndef CORPUS_WORDS_H
+#define CORPUS_WORDS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace layout_converter {
+namespace CorpusWords {
+
+struct WordCount {
+    const char* word;   // Lowercase UTF-8
+    uint32_t count;
+};
+
+struct Language {
+    const char* language;  // Corpus file name, e.g. "en"
+    const WordCount* words;
+    size_t word_count;
+};
+
+} // namespace CorpusWords
+} // namespace layout_converter
+
+// Generated at build time from data/corpora/*.txt: defines CorpusWords::LANGUAGES
+#include "corpus_words_data.h"
+
+#endif // CORPUS_WORDS_H
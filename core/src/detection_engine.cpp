@@ -0,0 +1,907 @@
+// Layout Detection Engine Implementation
+// Models are built once per layout change; scoring a text is one pass to
+// profile it plus a small table walk per hypothesis
+
+#include "detection_engine.h"
+#include "corpus_words.h"
+#include "parallel_for.h"
+#include "script_classifier.h"
+#include "stats_recorder.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+
+namespace layout_converter {
+
+namespace {
+
+// Add-k smoothing constant for both bigram and trigram estimates
+constexpr double SMOOTHING = 0.5;
+
+// Score of a character the intended language has no symbol for: a letter
+// of another alphabet is strong evidence against the hypothesis, other
+// characters (digits, punctuation) only act as word breaks
+constexpr float OOV_LETTER_PENALTY = -8.0f;
+constexpr float NON_LETTER_PENALTY = -3.0f;
+
+// Priors, in mean log-probability per character: text is usually typed on
+// the right layout, and in the user's language
+constexpr double IDENTITY_BONUS = 0.5;
+constexpr double USER_LANGUAGE_BONUS = 0.25;
+constexpr double FREQUENCY_WEIGHT = 0.1;
+
+// Bonus per character of the text covered by common words of the intended
+// layout
+constexpr double COMMON_WORD_BONUS = 1.0;
+
+// Bonus per letter of the text in words of the intended language's
+// dictionary. Lower than the common-word bonus: a large dictionary also
+// has short words that many mistyped strings happen to spell.
+constexpr double DICTIONARY_WORD_BONUS = 0.5;
+
+// Hypotheses within this distance of the best bigram score are rescored
+// with trigrams
+constexpr double RESCORE_MARGIN = 1.0;
+
+constexpr unsigned MAX_LOCAL_CHARS = 255;
+
+// Non-ASCII characters are letters unless they fall in a block of
+// punctuation, digits, symbols or emoji, so letters of scripts without
+// keys here still count against a layout's coverage
+bool is_letter(char32_t c) {
+    if (c < 0x80) return std::isalpha(static_cast<int>(c)) != 0;
+    if (c < 0xC0 || c == 0xD7 || c == 0xF7) return false;           // Latin-1 punctuation, x and /
+    if (c == 0x60C || c == 0x61B || c == 0x61F || c == 0x6D4) return false;  // Arabic punctuation
+    if ((c >= 0x660 && c <= 0x66D) || (c >= 0x6F0 && c <= 0x6F9)) return false;  // Arabic digits
+    if (c >= 0x964 && c <= 0x96F) return false;                      // Devanagari danda and digits
+    if (c >= 0x2000 && c <= 0x2BFF) return false;                    // Punctuation, currency, No, arrows, math, dingbats
+    if (c >= 0x3000 && c <= 0x303F) return false;                    // CJK punctuation
+    if (c >= 0xE000 && c <= 0xF8FF) return false;                    // Private use
+    if (c >= 0xFE00 && c <= 0xFE6F) return false;                    // Variation selectors, CJK compatibility forms
+    if ((c >= 0xFF01 && c <= 0xFF20) || (c >= 0xFF3B && c <= 0xFF40) || (c >= 0xFF5B && c <= 0xFF65)) {
+        return false;                                                // Fullwidth punctuation and digits
+    }
+    if (c >= 0x1F000 && c <= 0x1FBFF) return false;                  // Emoji and pictographs
+    return c < 0xE0000;                                              // Tags, selectors, private use; INVALID_CODEPOINT
+}
+
+bool is_boundary(char32_t c) {
+    return c <= 0x20 || c == utf8::INVALID_CODEPOINT;
+}
+
+// Sort packed n-gram keys and collapse them into (key, count) runs
+void count_runs(std::vector<uint32_t>& keys, std::vector<float>& counts) {
+    std::sort(keys.begin(), keys.end());
+    counts.clear();
+    size_t unique = 0;
+    for (size_t i = 0; i < keys.size();) {
+        size_t j = i;
+        while (j < keys.size() && keys[j] == keys[i]) ++j;
+        keys[unique++] = keys[i];
+        counts.push_back(static_cast<float>(j - i));
+        i = j;
+    }
+    keys.resize(unique);
+}
+
+// Sort hypotheses best first (ties by handle) and keep the top
+// `max_results` (0 = all)
+void rank(std::vector<LayoutHypothesis>& hypotheses, size_t max_results) {
+    auto better = [](const LayoutHypothesis& a, const LayoutHypothesis& b) {
+        return a.score > b.score || (a.score == b.score && (a.typed_layout < b.typed_layout ||
+            (a.typed_layout == b.typed_layout && a.intended_layout < b.intended_layout)));
+    };
+    if (max_results && max_results < hypotheses.size()) {
+        std::partial_sort(hypotheses.begin(), hypotheses.begin() + static_cast<std::ptrdiff_t>(max_results),
+                          hypotheses.end(), better);
+        hypotheses.resize(max_results);
+    } else {
+        std::sort(hypotheses.begin(), hypotheses.end(), better);
+    }
+}
+
+} // namespace
+
+LanguageModelBuilder::LanguageModelBuilder(unsigned trigram_bits)
+    : bigram_counts(LanguageModel::MAX_SYMBOLS * LanguageModel::MAX_SYMBOLS),
+      trigram_counts(size_t(1) << trigram_bits) {
+    model.trigram_bits = trigram_bits;
+}
+
+void LanguageModelBuilder::add_letter(char32_t c) {
+    c = utf8::to_lower(c);
+    if (!is_letter(c) || model.symbols.get(c) || model.symbol_count >= static_cast<unsigned>(LanguageModel::MAX_SYMBOLS)) {
+        return;
+    }
+    model.symbols.set(c, static_cast<unsigned char>(model.symbol_count++));
+}
+
+void LanguageModelBuilder::add_letters(std::string_view word) {
+    const char* p = word.data();
+    const char* end = p + word.size();
+    while (p < end) {
+        char32_t cp;
+        p += utf8::decode(p, end, cp);
+        add_letter(cp);
+    }
+}
+
+void LanguageModelBuilder::add_word(std::string_view word, double weight) {
+    unsigned a = 0, b = 0;
+    auto push = [&](unsigned c) {
+        if (b || c) bigram_counts[b * LanguageModel::MAX_SYMBOLS + c] += weight;
+        if (b) trigram_counts[model.trigram_bucket(a, b, c)] += weight;
+        a = b;
+        b = c;
+    };
+    const char* p = word.data();
+    const char* end = p + word.size();
+    while (p < end) {
+        char32_t cp;
+        p += utf8::decode(p, end, cp);
+        push(model.symbols.get(utf8::to_lower(cp)));
+    }
+    push(0);
+}
+
+void LanguageModelBuilder::add_text(std::string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    const char* word = p;
+    while (p < end) {
+        char32_t cp;
+        size_t length = utf8::decode(p, end, cp);
+        if (is_boundary(cp)) {
+            if (p > word) add_word(std::string_view(word, static_cast<size_t>(p - word)), 1.0);
+            word = p + length;
+        }
+        p += length;
+    }
+    if (end > word) add_word(std::string_view(word, static_cast<size_t>(end - word)), 1.0);
+}
+
+void LanguageModelBuilder::merge(const LanguageModelBuilder& other) {
+    for (size_t i = 0; i < bigram_counts.size(); ++i) {
+        bigram_counts[i] += other.bigram_counts[i];
+    }
+    for (size_t i = 0; i < trigram_counts.size(); ++i) {
+        trigram_counts[i] += other.trigram_counts[i];
+    }
+}
+
+LanguageModel LanguageModelBuilder::finish() {
+    const size_t stride = LanguageModel::MAX_SYMBOLS;
+    const size_t size = model.symbol_count;
+    const double vocabulary = model.symbol_count;
+    model.bigram.assign(size * size, 0.0f);
+    model.trigram_context.assign(size * size, 0.0f);
+    model.trigram.assign(model.trigram_buckets(), 0.0f);
+
+    for (size_t a = 0; a < size; ++a) {
+        double row_total = 0.0;
+        for (size_t b = 0; b < size; ++b) {
+            row_total += bigram_counts[a * stride + b];
+        }
+        for (size_t b = 0; b < size; ++b) {
+            double count = bigram_counts[a * stride + b];
+            model.bigram[a * size + b] = static_cast<float>(
+                std::log((count + SMOOTHING) / (row_total + SMOOTHING * vocabulary)));
+            model.trigram_context[a * size + b] = static_cast<float>(
+                std::log(count + SMOOTHING * vocabulary));
+        }
+    }
+    for (size_t i = 0; i < model.trigram.size(); ++i) {
+        model.trigram[i] = static_cast<float>(std::log(trigram_counts[i] + SMOOTHING));
+    }
+    // Boundary -> boundary never reaches scoring in a profile, but a
+    // hypothesis can map two characters to symbol 0; keep it neutral so
+    // the scoring loop needs no branch
+    model.bigram[0] = 0.0f;
+    return std::move(model);
+}
+
+void LanguageModelBuilder::count_letters(std::string_view text, std::unordered_map<char32_t, uint64_t>& counts) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        char32_t cp;
+        p += utf8::decode(p, end, cp);
+        cp = utf8::to_lower(cp);
+        if (is_letter(cp)) ++counts[cp];
+    }
+}
+
+LanguageModel LanguageModel::from_file(std::shared_ptr<const NgramModel> file) {
+    LanguageModel model;
+    model.language = file->language();
+    model.symbol_count = file->symbol_count();
+    model.trigram_bits = file->trigram_bits();
+    for (size_t i = 0; i < file->alphabet().size(); ++i) {
+        model.symbols.set(file->alphabet()[i], static_cast<unsigned char>(i + 1));
+    }
+    size_t size = size_t(model.symbol_count) * model.symbol_count;
+    model.bigram.resize(size);
+    model.trigram_context.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        model.bigram[i] = file->bigram()[i];
+        model.trigram_context[i] = file->trigram_context()[i];
+    }
+    model.bigram[0] = 0.0f;  // See LanguageModelBuilder::finish
+    model.mapped_trigram = file->trigram();
+    model.file = std::move(file);
+    return model;
+}
+
+void TextProfile::build(std::string_view text) {
+    chars.clear();
+    counts.clear();
+    bigrams.clear();
+    trigrams.clear();
+    sequence.clear();
+    total = 0;
+    letters = 0;
+
+    std::array<unsigned char, 128> ascii_ids{};
+    unsigned a = 0, b = 0;
+    auto push = [&](unsigned c) {
+        if (b == 0 && c == 0) return;  // Collapse runs of boundaries
+        sequence.push_back(static_cast<unsigned char>(c));
+        bigrams.push_back(b << 8 | c);
+        if (b) trigrams.push_back(a << 16 | b << 8 | c);
+        a = b;
+        b = c;
+    };
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        char32_t cp;
+        p += utf8::decode(p, end, cp);
+        if (is_boundary(cp)) {
+            push(0);
+            continue;
+        }
+        cp = utf8::to_lower(cp);
+
+        unsigned id = cp < 0x80 ? ascii_ids[cp] : 0;
+        if (!id) {
+            auto it = std::find(chars.begin(), chars.end(), cp);
+            if (it != chars.end()) {
+                id = static_cast<unsigned>(it - chars.begin()) + 1;
+            } else if (chars.size() < MAX_LOCAL_CHARS) {
+                chars.push_back(cp);
+                counts.push_back(0);
+                id = static_cast<unsigned>(chars.size());
+            }
+            if (cp < 0x80) ascii_ids[cp] = static_cast<unsigned char>(id);
+        }
+        if (!id) {
+            push(0);  // Out of local IDs; rare enough to treat as a break
+            continue;
+        }
+
+        ++counts[id - 1];
+        ++total;
+        if (is_letter(cp)) ++letters;
+        push(id);
+    }
+    push(0);
+
+    count_runs(bigrams, bigram_counts);
+    count_runs(trigrams, trigram_counts);
+}
+
+void DetectionEngine::rebuild(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts,
+                              const std::vector<std::shared_ptr<const WordDictionary>>& dictionaries,
+                              const std::vector<std::shared_ptr<const NgramModel>>& models) {
+    // One model per language: a loaded model file, or one trained on the
+    // common words of every layout that declares the language plus the
+    // compiled-in corpus for it
+    std::vector<std::string> languages;
+    for (const auto& layout : layouts) {
+        if (layout && std::find(languages.begin(), languages.end(), layout->language) == languages.end()) {
+            languages.push_back(layout->language);
+        }
+    }
+
+    models_.clear();
+    for (const std::string& language : languages) {
+        auto file = std::find_if(models.begin(), models.end(), [&](const auto& model) {
+            return model && model->language() == language;
+        });
+        if (file != models.end()) {
+            models_.push_back(LanguageModel::from_file(*file));
+            continue;
+        }
+        LanguageModelBuilder builder;
+        builder.model.language = language;
+        std::unordered_set<std::string> words;
+        for (const auto& layout : layouts) {
+            if (!layout || layout->language != language) continue;
+            for (char32_t c : layout->key_to_char) {
+                if (c) builder.add_letter(c);
+            }
+            words.insert(layout->common_words.begin(), layout->common_words.end());
+        }
+        for (const std::string& word : words) {
+            builder.add_letters(word);
+            builder.add_word(word, 1.0);
+        }
+        for (const CorpusWords::Language& corpus : CorpusWords::LANGUAGES) {
+            if (language != corpus.language) continue;
+            for (size_t i = 0; i < corpus.word_count; ++i) {
+                builder.add_letters(corpus.words[i].word);
+                builder.add_word(corpus.words[i].word, corpus.words[i].count);
+            }
+        }
+        models_.push_back(builder.finish());
+    }
+
+    has_dictionaries_ = false;
+    for (LanguageModel& model : models_) {
+        for (const auto& dictionary : dictionaries) {
+            if (dictionary && dictionary->language() == model.language) model.dictionary = dictionary;
+        }
+        has_dictionaries_ |= model.dictionary != nullptr;
+    }
+
+    words_.build(layouts);
+
+    layouts_.assign(layouts.size(), LayoutEntry{});
+    for (size_t handle = 0; handle < layouts.size(); ++handle) {
+        if (!layouts[handle]) continue;
+        LayoutEntry& entry = layouts_[handle];
+        entry.layout = layouts[handle];
+        entry.model = static_cast<int>(
+            std::find(languages.begin(), languages.end(), entry.layout->language) - languages.begin());
+        for (int position = 0; position <= KeyID::MAX_KEY_POSITION; ++position) {
+            char32_t c = entry.layout->key_to_char[position];
+            entry.key_symbols[position] = c ? map_char(models_[entry.model], c) : MappedSymbol{KEEP_SYMBOL, 0.0f};
+            if (c && is_letter(c)) entry.scripts |= 1u << Scripts::script_of(c);
+        }
+    }
+
+    std::vector<unsigned> scripts(layouts_.size());
+    for (size_t handle = 0; handle < layouts_.size(); ++handle) {
+        scripts[handle] = layouts_[handle].scripts;
+    }
+    index_.build(layouts, scripts);
+}
+
+DetectionEngine::MappedSymbol DetectionEngine::map_char(const LanguageModel& model, char32_t c) const {
+    MappedSymbol mapped;
+    mapped.symbol = model.symbols.get(utf8::to_lower(c));
+    if (!mapped.symbol) {
+        mapped.penalty = is_letter(c) ? OOV_LETTER_PENALTY : NON_LETTER_PENALTY;
+    }
+    return mapped;
+}
+
+bool DetectionEngine::in_dictionary(const LayoutEntry& intended, const char32_t* letters,
+                                    const unsigned char* positions, size_t length) const {
+    const WordDictionary* dictionary = models_[intended.model].dictionary.get();
+    if (!dictionary || length == 0 || length > MAX_DICTIONARY_WORD) {
+        return false;
+    }
+    char word[MAX_DICTIONARY_WORD * 4];
+    size_t size = 0;
+    for (size_t i = 0; i < length; ++i) {
+        // A letter the typed layout has no key for is kept as typed
+        char32_t c = positions[i] ? intended.layout->key_to_char[positions[i]] : letters[i];
+        utf8::EncodedChar encoded = utf8::encode(utf8::to_lower(c));
+        std::memcpy(word + size, encoded.bytes, encoded.length);
+        size += encoded.length;
+    }
+    return dictionary->contains(std::string_view(word, size));
+}
+
+const LanguageModel* DetectionEngine::model(const std::string& language) const {
+    for (const auto& model : models_) {
+        if (model.language == language) return &model;
+    }
+    return nullptr;
+}
+
+std::vector<LayoutHypothesis> DetectionEngine::score(std::string_view text, const std::string& user_language,
+                                                     size_t max_results) const {
+    Scratch scratch;
+    score(text, user_language, max_results, scratch);
+    return std::move(scratch.hypotheses);
+}
+
+void DetectionEngine::score(std::string_view text, const std::string& user_language, size_t max_results,
+                            Scratch& scratch) const {
+    std::vector<LayoutHypothesis>& result = scratch.hypotheses;
+    result.clear();
+    TextProfile& profile = scratch.profile;
+    profile.build(text);
+    if (profile.letters == 0) {
+        return;
+    }
+    const size_t char_count = profile.chars.size();
+    const double inverse_total = 1.0 / profile.total;
+
+    // Characters a source layout does not have are typed as-is, so their
+    // symbol only depends on the intended language: resolve once per model
+    std::vector<MappedSymbol>& passthrough = scratch.passthrough;
+    std::vector<double>& language_bonus = scratch.language_bonus;
+    passthrough.resize(models_.size() * char_count);
+    language_bonus.resize(models_.size());
+    for (size_t m = 0; m < models_.size(); ++m) {
+        for (size_t i = 0; i < char_count; ++i) {
+            passthrough[m * char_count + i] = map_char(models_[m], profile.chars[i]);
+        }
+        language_bonus[m] = models_[m].language == user_language ? USER_LANGUAGE_BONUS : 0.0;
+    }
+
+    // Front stage: letters of the text per set of scripts. A layout can
+    // cover at most the letters of the scripts it has keys for, so whole
+    // families of sources drop out before any of their keys are looked up.
+    Scripts::Counts script_letters = Scripts::count(text.data(), text.size());
+    std::array<uint32_t, 1u << Scripts::SCRIPT_COUNT> reachable{};
+    for (size_t script = 0; script < Scripts::SCRIPT_COUNT; ++script) {
+        size_t bit = size_t(1) << script;
+        for (size_t set = bit; set < 2 * bit; ++set) {
+            reachable[set] = reachable[set - bit] + script_letters[script];
+        }
+    }
+    const double min_covered = MIN_SOURCE_COVERAGE * profile.letters;
+    std::vector<uint64_t>& candidates = scratch.candidates;
+    std::vector<uint64_t>& hit = scratch.hit;
+    candidates.assign(index_.words(), 0);
+    hit.assign(index_.words(), 0);
+    index_.select_scripts([&](unsigned scripts) { return reachable[scripts] >= min_covered; },
+                          candidates.data());
+
+    // Letters of the text each remaining layout has a key for, from the
+    // character index: the cost grows with the layouts that type the
+    // text's letters, not with every layout loaded. Only the layouts hit
+    // are visited, and their totals cleared again for the next text.
+    std::vector<uint32_t>& covered = scratch.covered;
+    if (covered.size() != layouts_.size()) {
+        covered.assign(layouts_.size(), 0);
+    }
+    for (size_t i = 0; i < char_count; ++i) {
+        if (is_letter(profile.chars[i])) {
+            index_.add_to_layouts_with(profile.chars[i], profile.counts[i], candidates.data(), covered.data(),
+                                       hit.data());
+        }
+    }
+
+    // Key position of every distinct character on each plausible source
+    std::vector<LayoutHandle>& sources = scratch.sources;
+    std::vector<unsigned char>& positions = scratch.positions;
+    sources.clear();
+    positions.clear();
+    index_.for_each(hit.data(), [&](size_t source) {
+        bool plausible = covered[source] >= min_covered;
+        covered[source] = 0;
+        if (!plausible) return;
+
+        const LayoutEntry& typed = layouts_[source];
+        size_t offset = positions.size();
+        positions.resize(offset + char_count);
+        for (size_t i = 0; i < char_count; ++i) {
+            positions[offset + i] = static_cast<unsigned char>(typed.layout->key_position_for(profile.chars[i]));
+        }
+        sources.push_back(static_cast<LayoutHandle>(source));
+    });
+    LC_STATS_ADD(SOURCES_PRUNED, index_.layout_count() - sources.size());
+
+    // Symbols of the text's characters under one hypothesis, by local ID
+    // ([0] = boundary). Returns the summed penalty of unknown characters.
+    std::vector<unsigned char>& symbols = scratch.symbols;
+    symbols.assign(char_count + 1, 0);
+    auto map_symbols = [&](size_t source_index, const LayoutEntry& intended) {
+        const unsigned char* source_positions = &positions[source_index * char_count];
+        const MappedSymbol* kept = &passthrough[static_cast<size_t>(intended.model) * char_count];
+        float penalty = 0.0f;
+        for (size_t i = 0; i < char_count; ++i) {
+            const MappedSymbol* mapped = &intended.key_symbols[source_positions[i]];
+            if (mapped->symbol == KEEP_SYMBOL) mapped = &kept[i];
+            symbols[i + 1] = mapped->symbol;
+            penalty += mapped->penalty * static_cast<float>(profile.counts[i]);
+        }
+        return penalty;
+    };
+
+    // Pass 1: bigram and common-word score of every hypothesis. Two
+    // accumulators keep the adds from forming one long dependency chain.
+    std::vector<Partial>& partials = scratch.partials;
+    partials.clear();
+    std::vector<unsigned char>& typed_positions = scratch.typed_positions;
+    typed_positions.resize(profile.sequence.size());
+    WordMatcher::Matches& matches = scratch.matches;
+    double best = -1e30;
+    for (size_t source_index = 0; source_index < sources.size(); ++source_index) {
+        const LayoutEntry& typed = layouts_[sources[source_index]];
+
+        // Common words of every intended layout, in one scan of the keys
+        // pressed. Typed punctuation ends a word even where an intended
+        // layout has a letter on its key (Russian б on the comma key).
+        const unsigned char* source_positions = &positions[source_index * char_count];
+        for (size_t i = 0; i < profile.sequence.size(); ++i) {
+            unsigned id = profile.sequence[i];
+            typed_positions[i] = id && is_letter(profile.chars[id - 1]) ? source_positions[id - 1]
+                                                                        : WordMatcher::WORD_BREAK;
+        }
+        matches.reset(layouts_.size());
+        words_.scan(typed_positions.data(), typed_positions.size(), matches);
+
+        // Letter runs and their keys, for the intended dictionaries
+        std::vector<char32_t>& word_letters = scratch.word_letters;
+        std::vector<unsigned char>& word_positions = scratch.word_positions;
+        std::vector<uint32_t>& word_ends = scratch.word_ends;
+        word_letters.clear();
+        word_positions.clear();
+        word_ends.clear();
+        for (size_t i = 0; has_dictionaries_ && i <= profile.sequence.size(); ++i) {
+            unsigned id = i < profile.sequence.size() ? profile.sequence[i] : 0;
+            if (id && is_letter(profile.chars[id - 1])) {
+                word_letters.push_back(profile.chars[id - 1]);
+                word_positions.push_back(source_positions[id - 1]);
+            } else if (word_letters.size() > (word_ends.empty() ? 0 : word_ends.back())) {
+                word_ends.push_back(static_cast<uint32_t>(word_letters.size()));
+            }
+        }
+
+        for (size_t target = 0; target < layouts_.size(); ++target) {
+            const LayoutEntry& intended = layouts_[target];
+            if (!intended.layout) continue;
+            const LanguageModel& model = models_[intended.model];
+
+            float penalty = map_symbols(source_index, intended);
+            float sums[2] = {0.0f, 0.0f};
+            for (size_t k = 0; k < profile.bigrams.size(); ++k) {
+                uint32_t key = profile.bigrams[k];
+                sums[k & 1] += profile.bigram_counts[k] * model.bigram_score(symbols[key >> 8], symbols[key & 0xFF]);
+            }
+            float bigrams = sums[0] + sums[1];
+
+            double score = (penalty + bigrams) * inverse_total + language_bonus[intended.model] +
+                           FREQUENCY_WEIGHT * typed.layout->frequency_score;
+            score += COMMON_WORD_BONUS * matches.characters[target] * inverse_total;
+            if (sources[source_index] == static_cast<LayoutHandle>(target)) score += IDENTITY_BONUS;
+            uint32_t dictionary_letters = 0;
+            for (size_t w = 0, begin = 0; w < word_ends.size(); begin = word_ends[w++]) {
+                if (in_dictionary(intended, &word_letters[begin], &word_positions[begin], word_ends[w] - begin)) {
+                    dictionary_letters += word_ends[w] - static_cast<uint32_t>(begin);
+                }
+            }
+            score += DICTIONARY_WORD_BONUS * dictionary_letters * inverse_total;
+            best = std::max(best, score);
+
+            partials.push_back({source_index, static_cast<LayoutHandle>(target), bigrams});
+            result.push_back({sources[source_index], static_cast<LayoutHandle>(target), score, matches.words[target]});
+        }
+    }
+
+    // Pass 2: hypotheses close to the best also get the trigram estimate,
+    // averaged with the bigram one. The rest keep the bigram estimate; they
+    // are too far behind for the trigrams to change the top of the ranking.
+    for (size_t h = 0; h < result.size(); ++h) {
+        if (result[h].score < best - RESCORE_MARGIN) continue;
+        const Partial& partial = partials[h];
+        const LayoutEntry& intended = layouts_[partial.target];
+        const LanguageModel& model = models_[intended.model];
+
+        map_symbols(partial.source_index, intended);
+        float sums[2] = {0.0f, 0.0f};
+        for (size_t k = 0; k < profile.trigrams.size(); ++k) {
+            uint32_t key = profile.trigrams[k];
+            unsigned b = symbols[(key >> 8) & 0xFF];
+            float score = model.trigram_score(symbols[key >> 16], b, symbols[key & 0xFF]);
+            sums[k & 1] += b ? profile.trigram_counts[k] * score : 0.0f;  // Never across a word break
+        }
+        float trigrams = sums[0] + sums[1];
+        result[h].score += (trigrams - partial.bigrams) / 2 * inverse_total;
+        LC_STATS_ADD(HYPOTHESES_RESCORED, 1);
+    }
+    LC_STATS_ADD(HYPOTHESES_SCORED, result.size());
+
+    rank(result, max_results);
+}
+
+void DetectionEngine::score_batch(const std::string_view* inputs, size_t count, const std::string& user_language,
+                                  size_t max_results, unsigned threads, DetectionBatch& out) const {
+    // Each block keeps its results apart until the blocks are joined in
+    // input order; the model tables are shared read-only by all workers
+    const size_t block_count = (count + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    std::vector<std::vector<LayoutHypothesis>> block_results(block_count);
+    out.offsets.resize(count + 1);
+    out.offsets[0] = 0;
+
+    parallel_for(block_count, resolve_thread_count(threads), [&](size_t block) {
+        Scratch scratch;
+        std::vector<LayoutHypothesis>& results = block_results[block];
+        size_t end = std::min(count, (block + 1) * BATCH_BLOCK);
+        for (size_t i = block * BATCH_BLOCK; i < end; ++i) {
+            score(inputs[i], user_language, max_results, scratch);
+            results.insert(results.end(), scratch.hypotheses.begin(), scratch.hypotheses.end());
+            out.offsets[i + 1] = scratch.hypotheses.size();  // Made absolute below
+        }
+    });
+
+    out.hypotheses.clear();
+    for (const auto& results : block_results) {
+        out.hypotheses.insert(out.hypotheses.end(), results.begin(), results.end());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        out.offsets[i + 1] += out.offsets[i];
+    }
+}
+
+void DetectionEngine::stream_reset(Stream& stream) const {
+    stream.sources.clear();
+    stream.hypotheses.clear();
+    for (size_t source = 0; source < layouts_.size(); ++source) {
+        if (!layouts_[source].layout) continue;
+        Stream::Source entry;
+        entry.layout = static_cast<LayoutHandle>(source);
+        entry.matches.reset(layouts_.size());
+        entry.word_state = words_.step(WordMatcher::START_STATE, WordMatcher::WORD_BREAK, entry.matches);
+        for (size_t target = 0; target < layouts_.size(); ++target) {
+            if (!layouts_[target].layout) continue;
+            Stream::Hypothesis hypothesis;
+            hypothesis.source = static_cast<uint32_t>(stream.sources.size());
+            hypothesis.target = static_cast<LayoutHandle>(target);
+            stream.hypotheses.push_back(hypothesis);
+        }
+        stream.sources.push_back(std::move(entry));
+    }
+    stream.closing_matches.reset(layouts_.size());
+    stream.passthrough.resize(models_.size());
+    stream.word.clear();
+    stream.total = 0;
+    stream.letters = 0;
+    stream.after_break = true;
+}
+
+void DetectionEngine::stream_append(Stream& stream, char32_t c) const {
+    // Same tokenization as TextProfile: boundaries collapse into one break
+    if (is_boundary(c)) {
+        if (stream.after_break) return;
+        stream.after_break = true;
+        stream_close_word(stream);
+        for (Stream::Source& source : stream.sources) {
+            source.word_state = words_.step(source.word_state, WordMatcher::WORD_BREAK, source.matches);
+        }
+        for (Stream::Hypothesis& hypothesis : stream.hypotheses) {
+            const LanguageModel& model = models_[layouts_[hypothesis.target].model];
+            hypothesis.bigrams += model.bigram_score(hypothesis.previous, 0);
+            if (hypothesis.previous) {
+                hypothesis.trigrams += model.trigram_score(hypothesis.before_previous, hypothesis.previous, 0);
+            }
+            hypothesis.before_previous = hypothesis.previous;
+            hypothesis.previous = 0;
+        }
+        return;
+    }
+
+    c = utf8::to_lower(c);
+    bool letter = is_letter(c);
+    ++stream.total;
+    stream.letters += letter;
+    stream.after_break = false;
+    if (!letter) {
+        stream_close_word(stream);
+    } else if (has_dictionaries_ && stream.word.size() <= MAX_DICTIONARY_WORD) {
+        stream.word.push_back(c);  // One past the limit marks a word too long to look up
+    }
+    for (size_t m = 0; m < models_.size(); ++m) {
+        stream.passthrough[m] = map_char(models_[m], c);
+    }
+
+    // Hypotheses are source-major, so each source's key position is looked
+    // up once for all of its targets
+    size_t h = 0;
+    for (uint32_t s = 0; s < stream.sources.size(); ++s) {
+        Stream::Source& source = stream.sources[s];
+        auto position = static_cast<unsigned char>(layouts_[source.layout].layout->key_position_for(c));
+        if (position && letter) ++source.covered_letters;
+        if (letter && source.word_positions.size() < stream.word.size()) source.word_positions.push_back(position);
+        source.word_state = words_.step(source.word_state, letter ? position : WordMatcher::WORD_BREAK,
+                                        source.matches);
+
+        for (; h < stream.hypotheses.size() && stream.hypotheses[h].source == s; ++h) {
+            Stream::Hypothesis& hypothesis = stream.hypotheses[h];
+            const LayoutEntry& intended = layouts_[hypothesis.target];
+            const LanguageModel& model = models_[intended.model];
+            const MappedSymbol* mapped = &intended.key_symbols[position];
+            if (mapped->symbol == KEEP_SYMBOL) mapped = &stream.passthrough[intended.model];
+
+            hypothesis.penalty += mapped->penalty;
+            hypothesis.bigrams += model.bigram_score(hypothesis.previous, mapped->symbol);
+            if (hypothesis.previous) {
+                hypothesis.trigrams += model.trigram_score(hypothesis.before_previous, hypothesis.previous,
+                                                           mapped->symbol);
+            }
+            hypothesis.before_previous = hypothesis.previous;
+            hypothesis.previous = mapped->symbol;
+        }
+    }
+}
+
+void DetectionEngine::stream_close_word(Stream& stream) const {
+    if (stream.word.empty()) {
+        return;
+    }
+    for (Stream::Hypothesis& hypothesis : stream.hypotheses) {
+        if (in_dictionary(layouts_[hypothesis.target], stream.word.data(),
+                          stream.sources[hypothesis.source].word_positions.data(), stream.word.size())) {
+            hypothesis.dictionary_letters += static_cast<uint32_t>(stream.word.size());
+        }
+    }
+    stream.word.clear();
+    for (Stream::Source& source : stream.sources) {
+        source.word_positions.clear();
+    }
+}
+
+void DetectionEngine::stream_rank(const Stream& stream, const std::string& user_language, size_t max_results,
+                                  std::vector<LayoutHypothesis>& out) const {
+    out.clear();
+    if (stream.letters == 0) {
+        return;
+    }
+    const double inverse_total = 1.0 / stream.total;
+
+    // The text is ranked as if it ended here: close the open word and add
+    // the final boundary n-grams without changing the stream. The words the
+    // closing break completes go to a scratch, one source at a time.
+    WordMatcher::Matches& pending = stream.closing_matches;
+    auto closing = [&](const Stream::Hypothesis& hypothesis, float& bigrams, float& trigrams) {
+        const LanguageModel& model = models_[layouts_[hypothesis.target].model];
+        bigrams = hypothesis.bigrams;
+        trigrams = hypothesis.trigrams;
+        if (!stream.after_break) {
+            bigrams += model.bigram_score(hypothesis.previous, 0);
+            if (hypothesis.previous) {
+                trigrams += model.trigram_score(hypothesis.before_previous, hypothesis.previous, 0);
+            }
+        }
+    };
+
+    // Pass 1 and pass 2 as in score(). Hypotheses are source-major and
+    // every loaded layout is a target of each source, so clearing the
+    // scratch at each target undoes all the closing break added.
+    double best = -1e30;
+    size_t h = 0;
+    for (uint32_t s = 0; s < stream.sources.size(); ++s) {
+        const Stream::Source& source = stream.sources[s];
+        bool plausible = source.covered_letters >= MIN_SOURCE_COVERAGE * stream.letters;
+        if (plausible && !stream.after_break) {
+            words_.step(source.word_state, WordMatcher::WORD_BREAK, pending);
+        }
+        for (; h < stream.hypotheses.size() && stream.hypotheses[h].source == s; ++h) {
+            const Stream::Hypothesis& hypothesis = stream.hypotheses[h];
+            if (!plausible) continue;
+            const LayoutEntry& intended = layouts_[hypothesis.target];
+            float bigrams, trigrams;
+            closing(hypothesis, bigrams, trigrams);
+            uint32_t words = source.matches.words[hypothesis.target] + pending.words[hypothesis.target];
+            uint32_t word_characters =
+                source.matches.characters[hypothesis.target] + pending.characters[hypothesis.target];
+            pending.words[hypothesis.target] = 0;
+            pending.characters[hypothesis.target] = 0;
+
+            double score = (hypothesis.penalty + bigrams) * inverse_total +
+                           (models_[intended.model].language == user_language ? USER_LANGUAGE_BONUS : 0.0) +
+                           FREQUENCY_WEIGHT * layouts_[source.layout].layout->frequency_score;
+            score += COMMON_WORD_BONUS * word_characters * inverse_total;
+            if (source.layout == hypothesis.target) score += IDENTITY_BONUS;
+            uint32_t dictionary_letters = hypothesis.dictionary_letters;
+            if (in_dictionary(intended, stream.word.data(), source.word_positions.data(), stream.word.size())) {
+                dictionary_letters += static_cast<uint32_t>(stream.word.size());  // The open word
+            }
+            score += DICTIONARY_WORD_BONUS * dictionary_letters * inverse_total;
+            best = std::max(best, score);
+            out.push_back({source.layout, hypothesis.target, score, words});
+        }
+    }
+
+    size_t k = 0;
+    for (const Stream::Hypothesis& hypothesis : stream.hypotheses) {
+        if (stream.sources[hypothesis.source].covered_letters < MIN_SOURCE_COVERAGE * stream.letters) continue;
+        LayoutHypothesis& result = out[k++];
+        if (result.score < best - RESCORE_MARGIN) continue;
+        float bigrams, trigrams;
+        closing(hypothesis, bigrams, trigrams);
+        result.score += (trigrams - bigrams) / 2 * inverse_total;
+    }
+
+    rank(out, max_results);
+}
+
+void DetectionEngine::score_word(std::string_view word, const LayoutHandle* candidates, size_t count,
+                                 WordMatcher::Matches& matches, double* scores) const {
+    const char* end = word.data() + word.size();
+    for (size_t typed_index = 0; typed_index < count; ++typed_index) {
+        double* row = scores + typed_index * count;
+        std::fill(row, row + count, -std::numeric_limits<double>::infinity());
+        LayoutHandle typed = candidates[typed_index];
+        if (typed < 0 || static_cast<size_t>(typed) >= layouts_.size() || !layouts_[typed].layout) continue;
+        const LayoutDefinition& source = *layouts_[typed].layout;
+
+        // Coverage and common words of the keys pressed, and the letter
+        // runs for the dictionaries
+        uint32_t total = 0, letters = 0, covered = 0;
+        char32_t run_letters[MAX_DICTIONARY_WORD];
+        unsigned char run_positions[MAX_DICTIONARY_WORD];
+        uint32_t run_ends[MAX_DICTIONARY_WORD];
+        size_t run_count = 0;
+        auto close_run = [&] {
+            if (letters <= MAX_DICTIONARY_WORD && letters > (run_count ? run_ends[run_count - 1] : 0)) {
+                run_ends[run_count++] = letters;
+            }
+        };
+        matches.reset(layouts_.size());
+        uint32_t state = words_.step(WordMatcher::START_STATE, WordMatcher::WORD_BREAK, matches);
+        for (const char* p = word.data(); p < end;) {
+            char32_t c;
+            p += utf8::decode(p, end, c);
+            c = utf8::to_lower(c);
+            auto position = static_cast<unsigned char>(source.key_position_for(c));
+            ++total;
+            bool letter = is_letter(c);
+            if (letter) {
+                if (letters < MAX_DICTIONARY_WORD) {
+                    run_letters[letters] = c;
+                    run_positions[letters] = position;
+                }
+                ++letters;
+                covered += position != 0;
+            } else {
+                close_run();
+            }
+            state = words_.step(state, letter ? position : WordMatcher::WORD_BREAK, matches);
+        }
+        close_run();
+        if (letters > MAX_DICTIONARY_WORD) run_count = 0;  // Too long to be a word
+        words_.step(state, WordMatcher::WORD_BREAK, matches);
+        if (total == 0 || covered < MIN_SOURCE_COVERAGE * letters) continue;
+        const double inverse_total = 1.0 / total;
+
+        for (size_t intended_index = 0; intended_index < count; ++intended_index) {
+            LayoutHandle target = candidates[intended_index];
+            if (target < 0 || static_cast<size_t>(target) >= layouts_.size() || !layouts_[target].layout) continue;
+            const LayoutEntry& intended = layouts_[target];
+            const LanguageModel& model = models_[intended.model];
+
+            float penalty = 0.0f, bigrams = 0.0f, trigrams = 0.0f;
+            unsigned previous = 0, before_previous = 0;
+            auto push = [&](unsigned symbol) {
+                bigrams += model.bigram_score(previous, symbol);
+                if (previous) trigrams += model.trigram_score(before_previous, previous, symbol);
+                before_previous = previous;
+                previous = symbol;
+            };
+            for (const char* p = word.data(); p < end;) {
+                char32_t c;
+                p += utf8::decode(p, end, c);
+                c = utf8::to_lower(c);
+                MappedSymbol mapped = intended.key_symbols[source.key_position_for(c)];
+                if (mapped.symbol == KEEP_SYMBOL) mapped = map_char(model, c);
+                penalty += mapped.penalty;
+                push(mapped.symbol);
+            }
+            push(0);
+
+            uint32_t dictionary_letters = 0;
+            for (size_t r = 0, begin = 0; r < run_count; begin = run_ends[r++]) {
+                if (in_dictionary(intended, run_letters + begin, run_positions + begin, run_ends[r] - begin)) {
+                    dictionary_letters += run_ends[r] - static_cast<uint32_t>(begin);
+                }
+            }
+            row[intended_index] = (penalty + (bigrams + trigrams) / 2) * inverse_total +
+                                  COMMON_WORD_BONUS * matches.characters[target] * inverse_total +
+                                  (typed == target ? IDENTITY_BONUS : 0.0) +
+                                  DICTIONARY_WORD_BONUS * dictionary_letters * inverse_total;
+        }
+    }
+}
+
+} // namespace layout_converter
@@ -0,0 +1,279 @@
+// Layout Detection Engine
+// Character n-gram language models and hypothesis scoring behind
+// detect_likely_layouts
+
+#ifndef DETECTION_ENGINE_H
+#define DETECTION_ENGINE_H
+
+#include "../include/key_system.h"
+#include "../include/ngram_model.h"
+#include "../include/word_dictionary.h"
+#include "layout_index.h"
+#include "word_matcher.h"
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace layout_converter {
+
+// Character bigram/trigram model of one language. Letters are mapped to a
+// small dense alphabet so every table is a flat array; symbol 0 is the word
+// boundary and stands for anything that is not a letter of the language.
+// Models built at load time keep float tables; a model loaded from a file
+// (see ngram_model.h) reads its quantized trigram table from the mapping.
+struct LanguageModel {
+    static constexpr int MAX_SYMBOLS = NgramModel::MAX_SYMBOLS;
+    static constexpr unsigned DEFAULT_TRIGRAM_BITS = 12;
+
+    std::string language;
+    unsigned symbol_count = 1;  // Also the row stride of the bigram tables
+    unsigned trigram_bits = DEFAULT_TRIGRAM_BITS;
+    utf8::CodepointTable<unsigned char> symbols;  // Lowercase codepoint -> symbol (0 = boundary)
+    std::vector<float> bigram;                    // [a * symbol_count + b] -> log P(b | a); [0] = 0
+    std::vector<float> trigram_context;           // [a * symbol_count + b] -> log (N(ab) + k * V)
+    std::vector<float> trigram;                   // [hash(a, b, c)] -> log (N(abc) + k); empty if mapped
+    NgramModel::Table mapped_trigram;             // Used when `trigram` is empty
+    std::shared_ptr<const NgramModel> file;       // Owner of `mapped_trigram`, if any
+    std::shared_ptr<const WordDictionary> dictionary;  // Null if none is loaded for the language
+
+    size_t trigram_buckets() const { return size_t(1) << trigram_bits; }
+
+    size_t trigram_bucket(unsigned a, unsigned b, unsigned c) const {
+        uint32_t key = (a * MAX_SYMBOLS + b) * MAX_SYMBOLS + c;
+        return (key * 2654435761u) >> (32 - trigram_bits);
+    }
+
+    float bigram_score(unsigned a, unsigned b) const {
+        return bigram[a * symbol_count + b];
+    }
+
+    // log P(c | a, b)
+    float trigram_score(unsigned a, unsigned b, unsigned c) const {
+        size_t bucket = trigram_bucket(a, b, c);
+        float count = trigram.empty() ? mapped_trigram[bucket] : trigram[bucket];
+        return count - trigram_context[a * symbol_count + b];
+    }
+
+    // Model with the tables of a model file; the bigram tables are decoded
+    // into floats, the trigram table stays in the mapping
+    static LanguageModel from_file(std::shared_ptr<const NgramModel> file);
+};
+
+// Accumulates n-gram counts for one language before they become log tables
+struct LanguageModelBuilder {
+    LanguageModel model;
+    std::vector<double> bigram_counts;
+    std::vector<double> trigram_counts;
+
+    explicit LanguageModelBuilder(unsigned trigram_bits = LanguageModel::DEFAULT_TRIGRAM_BITS);
+
+    // Give a letter the next free symbol, while there are any
+    void add_letter(char32_t c);
+    void add_letters(std::string_view word);
+
+    // Count the n-grams of one word framed by boundaries
+    void add_word(std::string_view word, double weight);
+
+    // Count every word of a text, weight 1
+    void add_text(std::string_view text);
+
+    // Add the counts of a builder with the same alphabet
+    void merge(const LanguageModelBuilder& other);
+
+    LanguageModel finish();
+
+    // Occurrences of each letter of `text` (lowercased), to choose an
+    // alphabet from
+    static void count_letters(std::string_view text, std::unordered_map<char32_t, uint64_t>& counts);
+};
+
+// Distinct characters and n-gram counts of a text, gathered in one pass.
+// N-grams are over local character IDs (index into `chars` + 1, 0 = word
+// boundary), so each hypothesis only has to remap the distinct characters.
+struct TextProfile {
+    std::vector<char32_t> chars;     // Distinct lowercase characters
+    std::vector<uint32_t> counts;    // Occurrences per character
+    std::vector<uint32_t> bigrams;   // (a << 8 | b) keys, sorted and unique
+    std::vector<float> bigram_counts;
+    std::vector<uint32_t> trigrams;  // (a << 16 | b << 8 | c) keys, sorted and unique
+    std::vector<float> trigram_counts;
+    std::vector<unsigned char> sequence;  // Local IDs in text order, runs of breaks collapsed to one 0
+    uint32_t total = 0;              // Non-whitespace characters
+    uint32_t letters = 0;            // Letter characters
+
+    void build(std::string_view text);
+};
+
+class DetectionEngine {
+public:
+    // Minimum share of the text's letters a layout must have to be
+    // considered as the layout the text was typed on
+    static constexpr double MIN_SOURCE_COVERAGE = 0.5;
+
+    // Rebuild language models and per-layout tables. `layouts` is indexed
+    // by LayoutHandle; null entries are not loaded. A language with a model
+    // file in `models` uses it instead of a model built from the layouts
+    // and compiled-in corpora; each language model uses the dictionary of
+    // its language, if there is one.
+    void rebuild(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts,
+                 const std::vector<std::shared_ptr<const WordDictionary>>& dictionaries = {},
+                 const std::vector<std::shared_ptr<const NgramModel>>& models = {});
+
+    // Longest word, in letters, looked up in a dictionary
+    static constexpr size_t MAX_DICTIONARY_WORD = 64;
+
+    // Inputs scored by one worker in a batch. Large enough to amortize the
+    // scratch buffers, small enough to balance threads.
+    static constexpr size_t BATCH_BLOCK = 256;
+
+    struct Scratch;
+
+    // Score every (typed, intended) layout pair for `text`, best first.
+    // `max_results` = 0 keeps all of them.
+    std::vector<LayoutHypothesis> score(std::string_view text, const std::string& user_language,
+                                        size_t max_results = 0) const;
+
+    // Same, leaving the hypotheses in `scratch.hypotheses`. Reusing the
+    // scratch across calls avoids all per-text allocation.
+    void score(std::string_view text, const std::string& user_language, size_t max_results,
+               Scratch& scratch) const;
+
+    // Score `count` texts in blocks of BATCH_BLOCK on `threads` workers
+    // (0 = hardware concurrency), keeping the best `max_results` of each
+    void score_batch(const std::string_view* inputs, size_t count, const std::string& user_language,
+                     size_t max_results, unsigned threads, DetectionBatch& out) const;
+
+    // Model for a language tag, or nullptr if no loaded layout uses it
+    const LanguageModel* model(const std::string& language) const;
+
+    struct Stream;
+
+    // Incremental scoring (IncrementalDetector): start a stream, feed it
+    // one character at a time, rank it at any point. Each character costs
+    // one table walk per hypothesis, independent of how much came before,
+    // and the ranking matches score() on the same text. Ranking uses
+    // scratch kept in the stream, so a stream is used by one thread at a time.
+    void stream_reset(Stream& stream) const;
+    void stream_append(Stream& stream, char32_t c) const;
+    void stream_rank(const Stream& stream, const std::string& user_language, size_t max_results,
+                     std::vector<LayoutHypothesis>& out) const;
+
+    // Scores of one word (a run of non-boundary characters) under every
+    // (typed, intended) pair of `candidates`, in
+    // scores[typed * count + intended]: log-probability per character of
+    // the word framed by breaks, trigram-rescored, plus the common-word and
+    // identity bonuses. -infinity where the typed layout lacks keys for too many of
+    // the word's letters. `matches` is scratch; nothing is allocated once
+    // it has grown.
+    void score_word(std::string_view word, const LayoutHandle* candidates, size_t count,
+                    WordMatcher::Matches& matches, double* scores) const;
+
+    // fix_mistyped: log-probability cost of switching between reading the
+    // text as written and a conversion, between two words. A mistyped span
+    // must gain more than this to be converted.
+    static constexpr double SWITCH_PENALTY = 4.0;
+    // Weight of a word in a reading whose typed layout cannot type it,
+    // while another reading can
+    static constexpr double UNREADABLE_WORD = -100.0;
+
+private:
+    // Symbol of a character under a model, with its penalty if the
+    // character is not part of the model's alphabet
+    struct MappedSymbol {
+        unsigned char symbol = 0;
+        float penalty = 0.0f;
+    };
+
+    // Key symbol marking an empty key: the typed character is kept as-is
+    static constexpr unsigned char KEEP_SYMBOL = 0xFF;
+
+    // Hypothesis after the bigram pass
+    struct Partial {
+        size_t source_index;
+        LayoutHandle target;
+        float bigrams;  // Summed bigram log-probabilities
+    };
+
+    struct LayoutEntry {
+        std::shared_ptr<const LayoutDefinition> layout;  // Null if not loaded
+        int model = -1;
+        unsigned scripts = 0;  // Bit per Scripts:: index of the layout's letters
+        std::array<MappedSymbol, KeyID::MAX_KEY_POSITION + 1> key_symbols{};  // Key position -> symbol under `model`
+    };
+
+    std::vector<LanguageModel> models_;
+    std::vector<LayoutEntry> layouts_;  // Indexed by LayoutHandle
+    WordMatcher words_;
+    LayoutIndex index_;
+
+    bool has_dictionaries_ = false;
+
+    MappedSymbol map_char(const LanguageModel& model, char32_t c) const;
+
+    // Whether typed letters (lowercase) of one word, read through their
+    // key positions on `intended`, form a word of its language's dictionary
+    bool in_dictionary(const LayoutEntry& intended, const char32_t* letters, const unsigned char* positions,
+                       size_t length) const;
+
+    // Credit every stream hypothesis whose reading of the open word is a
+    // dictionary word, and start a new word
+    void stream_close_word(Stream& stream) const;
+
+public:
+    // Working buffers of score(); one per thread
+    struct Scratch {
+        TextProfile profile;
+        std::vector<MappedSymbol> passthrough;
+        std::vector<double> language_bonus;
+        std::vector<uint64_t> candidates;  // Layouts the script counts leave in, as a bitset
+        std::vector<uint64_t> hit;         // Of those, layouts with a key for a letter of the text
+        std::vector<uint32_t> covered;     // Per layout; all zero between texts
+        std::vector<LayoutHandle> sources;
+        std::vector<unsigned char> positions;
+        std::vector<unsigned char> symbols;
+        std::vector<Partial> partials;
+        std::vector<unsigned char> typed_positions;
+        std::vector<char32_t> word_letters;          // Letter runs of the text, for dictionary lookups
+        std::vector<unsigned char> word_positions;   // Their key positions on the current source
+        std::vector<uint32_t> word_ends;
+        WordMatcher::Matches matches;
+        std::vector<LayoutHypothesis> hypotheses;  // Result
+    };
+
+    // Running sums of one incrementally scored text
+    struct Stream {
+        struct Source {
+            LayoutHandle layout;
+            uint32_t covered_letters = 0;  // Letters of the text this layout has a key for
+            uint32_t word_state = 0;       // Common word automaton state
+            WordMatcher::Matches matches;  // Common words found so far, by intended layout
+            std::vector<unsigned char> word_positions;  // Keys of the open word's letters
+        };
+        struct Hypothesis {
+            uint32_t source;  // Index into `sources`
+            LayoutHandle target;
+            float penalty = 0.0f;
+            float bigrams = 0.0f;
+            float trigrams = 0.0f;
+            unsigned char previous = 0;         // Symbols of the last two characters
+            unsigned char before_previous = 0;
+            uint32_t dictionary_letters = 0;    // Letters in closed words found in the dictionary
+        };
+
+        std::vector<Source> sources;          // Every loaded layout
+        std::vector<Hypothesis> hypotheses;   // Source-major, every loaded target per source
+        std::vector<MappedSymbol> passthrough;  // Per model, for the character being added
+        std::vector<char32_t> word;           // Letters of the open word
+        mutable WordMatcher::Matches closing_matches;  // Scratch of stream_rank; all zero between calls
+        uint32_t total = 0;                   // Non-whitespace characters
+        uint32_t letters = 0;
+        bool after_break = true;              // Last character was a word boundary
+    };
+};
+
+} // namespace layout_converter
+
+#endif // DETECTION_ENGINE_H
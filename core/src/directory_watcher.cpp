@@ -0,0 +1,126 @@
+// Directory Watcher Implementation
+
+#include "directory_watcher.h"
+#include <algorithm>
+#include <string_view>
+
+#ifdef __linux__
+#define LAYOUT_CONVERTER_HAS_INOTIFY 1
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace layout_converter {
+
+namespace {
+
+bool is_layout_file(const char* name) {
+    std::string_view view(name);
+    return view.size() > 5 && view.substr(view.size() - 5) == ".json";
+}
+
+// Record `name` as the latest state of a file, so a file written and then
+// deleted within one batch ends up only in `removed`
+void note(std::vector<std::string>& add_to, std::vector<std::string>& remove_from, const std::string& name) {
+    remove_from.erase(std::remove(remove_from.begin(), remove_from.end(), name), remove_from.end());
+    if (std::find(add_to.begin(), add_to.end(), name) == add_to.end()) {
+        add_to.push_back(name);
+    }
+}
+
+} // namespace
+
+DirectoryWatcher::~DirectoryWatcher() {
+    stop();
+}
+
+#ifdef LAYOUT_CONVERTER_HAS_INOTIFY
+
+bool DirectoryWatcher::start(const std::string& directory, Callback callback) {
+    stop();
+    
+    notify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd_ < 0 || wake_fd_ < 0 ||
+        inotify_add_watch(notify_fd_, directory.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR) < 0) {
+        stop();
+        return false;
+    }
+    
+    callback_ = std::move(callback);
+    thread_ = std::thread(&DirectoryWatcher::run, this);
+    return true;
+}
+
+void DirectoryWatcher::stop() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        (void)::write(wake_fd_, &one, sizeof(one));
+        thread_.join();
+    }
+    if (notify_fd_ >= 0) ::close(notify_fd_);
+    if (wake_fd_ >= 0) ::close(wake_fd_);
+    notify_fd_ = wake_fd_ = -1;
+    callback_ = nullptr;
+}
+
+void DirectoryWatcher::run() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{notify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    Changes changes;
+    
+    for (;;) {
+        // Block until the first event, then keep collecting until the
+        // directory has been quiet for COALESCE_WINDOW
+        int timeout = changes.changed.empty() && changes.removed.empty()
+                          ? -1 : static_cast<int>(COALESCE_WINDOW.count());
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0) {
+            continue;  // EINTR
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        if (ready == 0) {
+            callback_(changes);
+            changes = Changes();
+            continue;
+        }
+        
+        if (changes.changed.empty() && changes.removed.empty()) {
+            changes.noticed = std::chrono::steady_clock::now();
+        }
+        ssize_t length;
+        while ((length = ::read(notify_fd_, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                if (!event->len || !is_layout_file(event->name)) {
+                    continue;
+                }
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    note(changes.removed, changes.changed, event->name);
+                } else {
+                    note(changes.changed, changes.removed, event->name);
+                }
+            }
+        }
+    }
+}
+
+#else
+
+bool DirectoryWatcher::start(const std::string&, Callback) {
+    return false;
+}
+
+void DirectoryWatcher::stop() {}
+
+void DirectoryWatcher::run() {}
+
+#endif
+
+} // namespace layout_converter
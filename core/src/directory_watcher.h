@@ -0,0 +1,59 @@
+// Directory Watcher
+// Background thread that reports layout files created, changed or removed
+// in a directory (inotify on Linux)
+
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace layout_converter {
+
+class DirectoryWatcher {
+public:
+    // One batch of changes: file names (not paths) of *.json files that were
+    // written or moved in, and of those deleted or moved out, plus the time
+    // the first event of the batch was read
+    struct Changes {
+        std::vector<std::string> changed;
+        std::vector<std::string> removed;
+        std::chrono::steady_clock::time_point noticed;
+    };
+    using Callback = std::function<void(const Changes&)>;
+    
+    // Events arriving within this window of each other are delivered as one
+    // batch, so an editor's write-rename sequence causes a single reload
+    static constexpr std::chrono::milliseconds COALESCE_WINDOW{20};
+    
+    DirectoryWatcher() = default;
+    ~DirectoryWatcher();
+    
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+    
+    // Start watching `directory`, replacing any previous watch. `callback`
+    // runs on the watcher thread. Returns false if the directory cannot be
+    // watched or the platform has no file notifications.
+    bool start(const std::string& directory, Callback callback);
+    
+    // Stop the watcher thread; no callback runs after this returns
+    void stop();
+    
+    bool running() const { return thread_.joinable(); }
+
+private:
+    void run();
+    
+    Callback callback_;
+    std::thread thread_;
+    int notify_fd_ = -1;
+    int wake_fd_ = -1;  // Written by stop() to interrupt the wait
+};
+
+} // namespace layout_converter
+
+#endif // DIRECTORY_WATCHER_H
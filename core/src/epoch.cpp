@@ -0,0 +1,120 @@
+// Epoch-Based Reclamation Implementation
+
+#include "epoch.h"
+#include <algorithm>
+
+namespace layout_converter {
+
+namespace {
+
+// Returns this thread's record to the pool when the thread exits
+struct ThreadSlot {
+    void* record = nullptr;
+    std::atomic<bool>* in_use = nullptr;
+
+    ~ThreadSlot() {
+        if (in_use) in_use->store(false, std::memory_order_release);
+    }
+};
+
+thread_local ThreadSlot thread_slot;
+
+} // namespace
+
+EpochDomain& EpochDomain::global() {
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::~EpochDomain() {
+    for (const Retired& retired : retired_) {
+        retired.deleter(retired.object);
+    }
+    ThreadRecord* record = records_.load();
+    while (record) {
+        ThreadRecord* next = record->next;
+        delete record;
+        record = next;
+    }
+}
+
+EpochDomain::ThreadRecord* EpochDomain::acquire_record() {
+    for (ThreadRecord* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+        bool expected = false;
+        if (!record->in_use.load(std::memory_order_relaxed) &&
+            record->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return record;
+        }
+    }
+
+    auto* record = new ThreadRecord;
+    record->in_use.store(true, std::memory_order_relaxed);
+    ThreadRecord* head = records_.load(std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!records_.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+}
+
+uint64_t EpochDomain::oldest_active_epoch() const {
+    uint64_t oldest = UINT64_MAX;
+    for (ThreadRecord* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+        uint64_t epoch = record->epoch.load(std::memory_order_seq_cst);
+        if (epoch) oldest = std::min(oldest, epoch);
+    }
+    return oldest;
+}
+
+void EpochDomain::retire(void* object, void (*deleter)(void*)) {
+    // Readers that entered at or before this epoch may hold the object;
+    // anyone entering later loads its replacement
+    uint64_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        retired_.push_back({epoch, object, deleter});
+    }
+    reclaim();
+}
+
+void EpochDomain::reclaim() {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        uint64_t oldest = oldest_active_epoch();
+        auto keep = std::partition(retired_.begin(), retired_.end(),
+                                   [&](const Retired& retired) { return retired.epoch >= oldest; });
+        ready.assign(keep, retired_.end());
+        retired_.erase(keep, retired_.end());
+    }
+    for (const Retired& retired : ready) {
+        retired.deleter(retired.object);
+    }
+}
+
+size_t EpochDomain::retired_count() {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    return retired_.size();
+}
+
+EpochGuard::EpochGuard() {
+    EpochDomain& domain = EpochDomain::global();
+    if (!thread_slot.record) {
+        auto* record = domain.acquire_record();
+        thread_slot.record = record;
+        thread_slot.in_use = &record->in_use;
+    }
+    record_ = static_cast<EpochDomain::ThreadRecord*>(thread_slot.record);
+    if (record_->depth++ == 0) {
+        // seq_cst store: the announcement must be visible before the
+        // caller loads any protected pointer
+        record_->epoch.store(domain.epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+}
+
+EpochGuard::~EpochGuard() {
+    if (--record_->depth == 0) {
+        record_->epoch.store(0, std::memory_order_release);
+    }
+}
+
+} // namespace layout_converter
@@ -0,0 +1,82 @@
+// Epoch-Based Reclamation
+// Lets readers use shared objects without locks or reference counts while
+// writers replace them; retired objects are freed once no reader can still
+// hold them
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace layout_converter {
+
+// Process-wide reclamation domain. Readers announce the epoch they entered
+// in a per-thread record; an object retired at epoch E is freed once every
+// active reader entered after E.
+class EpochDomain {
+public:
+    static EpochDomain& global();
+
+    // Hand over an object that readers may still be using. It is deleted
+    // with `deleter` once no reader can reach it any more.
+    void retire(void* object, void (*deleter)(void*));
+
+    template <typename T>
+    void retire(const T* object) {
+        retire(const_cast<T*>(object), [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // Free every retired object no active reader can still hold
+    void reclaim();
+
+    // Objects waiting to be freed
+    size_t retired_count();
+
+private:
+    friend class EpochGuard;
+
+    struct alignas(64) ThreadRecord {
+        std::atomic<uint64_t> epoch{0};  // 0 = not reading
+        std::atomic<bool> in_use{false};
+        ThreadRecord* next = nullptr;
+        unsigned depth = 0;              // Nested guards; only touched by the owning thread
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    EpochDomain() = default;
+    ~EpochDomain();
+
+    ThreadRecord* acquire_record();
+    uint64_t oldest_active_epoch() const;
+
+    std::atomic<uint64_t> epoch_{1};
+    std::atomic<ThreadRecord*> records_{nullptr};  // Never freed; reused after their thread exits
+    std::mutex retired_mutex_;                     // Writers only
+    std::vector<Retired> retired_;
+};
+
+// Read-side critical section. Objects loaded from an atomic pointer inside
+// the guard stay valid until it is destroyed. Guards nest.
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+    EpochDomain::ThreadRecord* record_;
+};
+
+} // namespace layout_converter
+
+#endif // EPOCH_H
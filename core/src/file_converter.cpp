@@ -0,0 +1,169 @@
+// File Converter Implementation
+
+#include "../include/file_converter.h"
+#include "../include/stream_converter.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LAYOUT_CONVERTER_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace layout_converter {
+
+namespace {
+
+// Chunk start offsets (plus a final `size` entry), each moved back to the
+// start of the UTF-8 character it falls in
+std::vector<size_t> split_chunks(const char* data, size_t size, size_t chunk_count) {
+    std::vector<size_t> bounds;
+    bounds.reserve(chunk_count + 1);
+    bounds.push_back(0);
+    for (size_t i = 1; i < chunk_count; ++i) {
+        size_t b = size / chunk_count * i;
+        for (int back = 0; back < 3 && b > bounds.back() &&
+                           utf8::is_continuation(static_cast<unsigned char>(data[b])); ++back) {
+            --b;
+        }
+        if (b > bounds.back()) {
+            bounds.push_back(b);
+        }
+    }
+    bounds.push_back(size);
+    return bounds;
+}
+
+bool convert_file_streaming(const std::shared_ptr<const ConversionPlan>& plan,
+                            const std::string& input_path, const std::string& output_path) {
+    std::error_code ec;
+    if (std::filesystem::equivalent(input_path, output_path, ec)) {
+        return false;  // Opening the output would truncate the input
+    }
+    std::ifstream in(input_path, std::ios::binary);
+    std::ofstream out(output_path, std::ios::binary);
+    if (!in.is_open() || !out.is_open()) {
+        return false;
+    }
+    StreamConverter converter(plan);
+    return converter.convert(in, out);
+}
+
+} // namespace
+
+#ifdef LAYOUT_CONVERTER_HAS_MMAP
+
+bool convert_file(const std::shared_ptr<const ConversionPlan>& plan_ptr,
+                  const std::string& input_path,
+                  const std::string& output_path,
+                  unsigned threads,
+                  size_t min_chunk_size) {
+    const ConversionPlan& plan = *plan_ptr;
+    int in_fd = ::open(input_path.c_str(), O_RDONLY);
+    if (in_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(in_fd);
+        return convert_file_streaming(plan_ptr, input_path, output_path);  // Pipes, devices
+    }
+    size_t in_size = static_cast<size_t>(st.st_size);
+    
+    // Opening the output truncates it, so it must not be the input
+    struct stat out_st;
+    if (::stat(output_path.c_str(), &out_st) == 0 && out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino) {
+        ::close(in_fd);
+        return false;
+    }
+    
+    int out_fd = ::open(output_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        ::close(in_fd);
+        return false;
+    }
+    if (in_size == 0) {
+        ::close(in_fd);
+        return ::close(out_fd) == 0;
+    }
+    
+    const char* in_data = static_cast<const char*>(
+        ::mmap(nullptr, in_size, PROT_READ, MAP_PRIVATE, in_fd, 0));
+    ::close(in_fd);
+    if (in_data == MAP_FAILED) {
+        ::close(out_fd);
+        return false;
+    }
+    ::madvise(const_cast<char*>(in_data), in_size, MADV_SEQUENTIAL);
+    
+    threads = resolve_thread_count(threads);
+    min_chunk_size = std::max<size_t>(min_chunk_size, 1);
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(in_size / min_chunk_size, size_t(threads) * 4));
+    std::vector<size_t> bounds = split_chunks(in_data, in_size, chunk_count);
+    chunk_count = bounds.size() - 1;
+    
+    // Output offsets: identical to input offsets for byte-preserving plans,
+    // otherwise a sizing pass followed by a prefix sum
+    std::vector<size_t> out_offsets(bounds);
+    if (!plan.byte_only) {
+        std::vector<size_t> sizes(chunk_count);
+        parallel_for(chunk_count, threads, [&](size_t i) {
+            sizes[i] = plan.converted_size(std::string_view(in_data + bounds[i], bounds[i + 1] - bounds[i]));
+        });
+        out_offsets[0] = 0;
+        for (size_t i = 0; i < chunk_count; ++i) {
+            out_offsets[i + 1] = out_offsets[i] + sizes[i];
+        }
+    }
+    size_t out_size = out_offsets.back();
+    
+    bool ok = ::ftruncate(out_fd, static_cast<off_t>(out_size)) == 0;
+    char* out_data = nullptr;
+    if (ok) {
+        void* mapped = ::mmap(nullptr, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+        ok = mapped != MAP_FAILED;
+        out_data = ok ? static_cast<char*>(mapped) : nullptr;
+    }
+    
+    if (ok) {
+        std::atomic<bool> failed{false};
+        // Exact capacities keep each worker inside its own output range
+        parallel_for(chunk_count, threads, [&](size_t i) {
+            size_t capacity = out_offsets[i + 1] - out_offsets[i];
+            size_t written = plan.convert_into(
+                std::string_view(in_data + bounds[i], bounds[i + 1] - bounds[i]),
+                out_data + out_offsets[i], capacity);
+            if (written != capacity) {
+                failed = true;
+            }
+        });
+        ok = !failed;
+    }
+    if (out_data && ::munmap(out_data, out_size) != 0) {
+        ok = false;
+    }
+    
+    ::munmap(const_cast<char*>(in_data), in_size);
+    return ::close(out_fd) == 0 && ok;
+}
+
+#else
+
+bool convert_file(const std::shared_ptr<const ConversionPlan>& plan,
+                  const std::string& input_path,
+                  const std::string& output_path,
+                  unsigned /*threads*/,
+                  size_t /*min_chunk_size*/) {
+    return convert_file_streaming(plan, input_path, output_path);
+}
+
+#endif // LAYOUT_CONVERTER_HAS_MMAP
+
+} // namespace layout_converter
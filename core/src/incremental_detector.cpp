@@ -0,0 +1,109 @@
+// Incremental Detector Implementation
+
+#include "../include/incremental_detector.h"
+#include "detection_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace layout_converter {
+
+class IncrementalDetector::Impl {
+public:
+    Impl(std::shared_ptr<const DetectionEngine> engine, std::string user_language)
+        : engine_(std::move(engine)), user_language_(std::move(user_language)) {
+        engine_->stream_reset(stream_);
+    }
+
+    void append(std::string_view text) {
+        // Complete a sequence held from the previous call first
+        while (!carry_.empty() && !text.empty()) {
+            carry_ += text.front();
+            text.remove_prefix(1);
+            if (utf8::complete_prefix_length(carry_.data(), carry_.size()) == carry_.size()) {
+                feed(carry_);
+                carry_.clear();
+            }
+        }
+
+        size_t complete = utf8::complete_prefix_length(text.data(), text.size());
+        feed(text.substr(0, complete));
+        carry_.append(text.substr(complete));
+    }
+
+    void reset() {
+        engine_->stream_reset(stream_);
+        carry_.clear();
+    }
+
+    std::vector<LayoutHypothesis> ranking(size_t max_results) const {
+        std::vector<LayoutHypothesis> result;
+        engine_->stream_rank(stream_, user_language_, max_results, result);
+        return result;
+    }
+
+    Decision decide(double confidence) const {
+        Decision decision;
+        std::vector<LayoutHypothesis> hypotheses = ranking(0);
+        if (hypotheses.empty()) {
+            return decision;
+        }
+        // Softmax over whole-text log-probabilities, relative to the best
+        double characters = static_cast<double>(stream_.total);
+        double mass = 0.0;
+        for (const LayoutHypothesis& hypothesis : hypotheses) {
+            mass += std::exp((hypothesis.score - hypotheses.front().score) * characters);
+        }
+        decision.best = hypotheses.front();
+        decision.confidence = 1.0 / mass;
+        decision.decided = decision.confidence >= confidence;
+        return decision;
+    }
+
+    size_t size() const { return stream_.total; }
+
+private:
+    void feed(std::string_view text) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            char32_t c;
+            p += utf8::decode(p, end, c);
+            engine_->stream_append(stream_, c);
+        }
+    }
+
+    std::shared_ptr<const DetectionEngine> engine_;  // Pinned: reloads do not affect an open stream
+    std::string user_language_;
+    DetectionEngine::Stream stream_;
+    std::string carry_;  // At most 3 bytes of an incomplete sequence
+};
+
+IncrementalDetector::IncrementalDetector(std::shared_ptr<const DetectionEngine> engine,
+                                         const std::string& user_language)
+    : pImpl(std::make_unique<Impl>(std::move(engine), user_language)) {}
+
+IncrementalDetector::IncrementalDetector(IncrementalDetector&&) noexcept = default;
+IncrementalDetector& IncrementalDetector::operator=(IncrementalDetector&&) noexcept = default;
+IncrementalDetector::~IncrementalDetector() = default;
+
+void IncrementalDetector::append(std::string_view text) {
+    pImpl->append(text);
+}
+
+void IncrementalDetector::reset() {
+    pImpl->reset();
+}
+
+std::vector<LayoutHypothesis> IncrementalDetector::ranking(size_t max_results) const {
+    return pImpl->ranking(max_results);
+}
+
+IncrementalDetector::Decision IncrementalDetector::decide(double confidence) const {
+    return pImpl->decide(confidence);
+}
+
+size_t IncrementalDetector::size() const {
+    return pImpl->size();
+}
+
+} // namespace layout_converter
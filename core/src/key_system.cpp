@@ -2,11 +2,30 @@
 // Efficient layout conversion using key IDs
 
 #include "../include/key_system.h"
+#include "../include/batch_converter.h"
+#include "../include/builtin_layouts.h"
+#include "../include/file_converter.h"
+#include "../include/incremental_detector.h"
+#include "../include/layout_pack.h"
+#include "../include/ngram_model.h"
+#include "../include/word_dictionary.h"
+#include "detection_engine.h"
+#include "directory_watcher.h"
+#include "epoch.h"
+#include "simd_convert.h"
+#include "stats_recorder.h"
+#include <nlohmann/json.hpp>
 #include <fstream>
+#include <filesystem>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <limits>
+#include <cstring>
 #include <string>
 #include <memory>
+#include <mutex>
 
 using json = nlohmann::json;
 
@@ -14,249 +33,1115 @@ namespace layout_converter {
 
 // KeyUtils implementation
 namespace KeyUtils {
+    // US QWERTY legends of the letter keys, by physical key
+    constexpr char LETTER_KEYS[] = "qwertyuiopasdfghjklzxcvbnm";
+    
     int char_to_key_position(char c) {
-        char lower = std::tolower(c);
-        if (lower >= 'a' && lower <= 'z') {
-            return lower - 'a' + 1;  // A=1, B=2, etc.
-        }
-        return 0;  // Invalid
+        char lower = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        const char* key = lower ? std::strchr(LETTER_KEYS, lower) : nullptr;
+        return key ? static_cast<int>(key - LETTER_KEYS) + 1 : 0;  // 0 = invalid
     }
     
     char key_position_to_char(int position) {
         if (position >= 1 && position <= 26) {
-            return 'a' + position - 1;  // 1=A, 2=B, etc.
+            return LETTER_KEYS[position - 1];
         }
         return '\0';  // Invalid
     }
     
-    int get_key_id_for_char(char c, const LayoutDefinition& layout) {
-        auto it = layout.char_to_key.find(c);
-        return it != layout.char_to_key.end() ? it->second : 0;
+    // Legacy key IDs only encode physical keys at the base level
+    bool legacy_key_position(int position) {
+        return position >= 1 && position <= KeyID::PHYSICAL_KEY_COUNT;
+    }
+    
+    int get_key_id_for_char(char32_t c, const LayoutDefinition& layout) {
+        int position = layout.key_position_for(c);
+        return legacy_key_position(position) ? generate_key_id(layout.family_id, layout.layout_id, position) : 0;
+    }
+    
+    char32_t get_char_for_key_id(int key_id, const LayoutDefinition& layout) {
+        KeyIDComponents components(key_id);
+        if (components.family_id != layout.family_id || components.layout_id != layout.layout_id ||
+            !legacy_key_position(components.key_position)) {
+            return 0;
+        }
+        return layout.key_to_char[components.key_position];
     }
     
-    char get_char_for_key_id(int key_id, const LayoutDefinition& layout) {
-        auto it = layout.key_to_char.find(key_id);
-        return it != layout.key_to_char.end() ? it->second : c;
+    // W3C UI Events key codes, indexed by physical key
+    constexpr std::array<const char*, KeyID::PHYSICAL_KEY_COUNT + 1> KEY_NAMES = {
+        "",
+        "KeyQ", "KeyW", "KeyE", "KeyR", "KeyT", "KeyY", "KeyU", "KeyI", "KeyO", "KeyP",
+        "KeyA", "KeyS", "KeyD", "KeyF", "KeyG", "KeyH", "KeyJ", "KeyK", "KeyL",
+        "KeyZ", "KeyX", "KeyC", "KeyV", "KeyB", "KeyN", "KeyM",
+        "Backquote",
+        "Digit1", "Digit2", "Digit3", "Digit4", "Digit5", "Digit6", "Digit7", "Digit8", "Digit9", "Digit0",
+        "Minus", "Equal", "BracketLeft", "BracketRight", "Backslash", "Semicolon", "Quote",
+        "Comma", "Period", "Slash", "IntlBackslash",
+    };
+    
+    const char* key_name(int physical_key) {
+        return physical_key >= 1 && physical_key <= KeyID::PHYSICAL_KEY_COUNT ? KEY_NAMES[physical_key] : "";
+    }
+    
+    int key_position_from_name(std::string_view name) {
+        if (!name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            // Legacy key ID: only the two position digits carry meaning
+            if (name.size() > 9) return 0;
+            int position = KeyIDComponents(std::stoi(std::string(name))).key_position;
+            return legacy_key_position(position) ? position : 0;
+        }
+        
+        auto strip_prefix = [&name](std::string_view prefix) {
+            if (name.substr(0, prefix.size()) != prefix) return false;
+            name.remove_prefix(prefix.size());
+            return true;
+        };
+        int level = KeyID::LEVEL_BASE;
+        if (strip_prefix("Shift+")) level |= KeyID::LEVEL_SHIFT;
+        if (strip_prefix("AltGr+")) level |= KeyID::LEVEL_ALTGR;
+        
+        for (int key = 1; key <= KeyID::PHYSICAL_KEY_COUNT; ++key) {
+            if (name == KEY_NAMES[key]) return KeyID::key_position(key, level);
+        }
+        return 0;
+    }
+    
+    std::string default_language_for_family(int family_id) {
+        switch (family_id) {
+            case KeyID::FAMILY_LATIN: return "en";
+            case KeyID::FAMILY_CYRILLIC: return "ru";
+            case KeyID::FAMILY_HINDI: return "hi";
+            case KeyID::FAMILY_ARABIC: return "ar";
+            case KeyID::FAMILY_CHINESE: return "zh";
+            default: return "";
+        }
     }
 }
 
+// LayoutDefinition implementation
+void LayoutDefinition::set_key(int key_position, char32_t c) {
+    if (key_position < 1 || key_position > KeyID::MAX_KEY_POSITION) {
+        return;
+    }
+    // A character whose key is taken over falls back to its last other
+    // key, if it has one
+    char32_t replaced = key_to_char[key_position];
+    if (replaced && key_position_for(replaced) == key_position) {
+        int other = 0;
+        for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+            if (position != key_position && key_to_char[position] == replaced) other = position;
+        }
+        char_to_key.set(replaced, static_cast<unsigned char>(other));
+    }
+    key_to_char[key_position] = c;
+    key_to_utf8[key_position] = utf8::encode(c);
+    char_to_key.set(c, static_cast<unsigned char>(key_position));
+}
+
+void LayoutDefinition::complete_shift_levels() {
+    for (int level : {KeyID::LEVEL_BASE, KeyID::LEVEL_ALTGR}) {
+        for (int key = 1; key <= KeyID::PHYSICAL_KEY_COUNT; ++key) {
+            char32_t unshifted = key_to_char[KeyID::key_position(key, level)];
+            char32_t upper = utf8::to_upper(unshifted);
+            int shifted = KeyID::key_position(key, level | KeyID::LEVEL_SHIFT);
+            if (upper != unshifted && !key_to_char[shifted] && !key_position_for(upper)) {
+                set_key(shifted, upper);
+            }
+        }
+    }
+}
+
+// ConversionPlan implementation
+namespace {
+
+// Shared UTF-8 convert loop. Unchecked mode relies on the caller providing
+// max_converted_size() bytes, which allows fixed 4-byte stores per character.
+template <bool Checked>
+size_t convert_utf8(const ConversionPlan& plan, const char* in, size_t size, char* out, size_t capacity) {
+    char* const out_begin = out;
+    char* const out_end = out + capacity;
+    const char* p = in;
+    const char* end = in + size;
+    
+    auto emit = [&](const char* bytes, size_t length, bool padded) {
+        if constexpr (Checked) {
+            if (length > static_cast<size_t>(out_end - out)) {
+                return false;
+            }
+            std::memcpy(out, bytes, length);
+        } else {
+            if (padded) {
+                std::memcpy(out, bytes, 4);
+            } else {
+                std::memcpy(out, bytes, length);
+            }
+        }
+        out += length;
+        return true;
+    };
+    
+    while (p < end) {
+        if (static_cast<unsigned char>(*p) < 0x80) {
+            const char* run_end = p + simd::ascii_prefix_length(p, static_cast<size_t>(end - p));
+            for (; p < run_end; ++p) {
+                const utf8::EncodedChar& target = plan.ascii_table[static_cast<unsigned char>(*p)];
+                if (!emit(target.bytes, target.length, true)) return ConversionPlan::npos;
+            }
+            continue;
+        }
+        
+        char32_t cp;
+        size_t length = utf8::decode(p, end, cp);
+        const utf8::EncodedChar& target = plan.codepoint_table.get(cp);
+        bool written = target.length ? emit(target.bytes, target.length, true)
+                                     : emit(p, length, false);  // Unmapped or malformed, keep original bytes
+        if (!written) return ConversionPlan::npos;
+        p += length;
+    }
+    
+    return static_cast<size_t>(out - out_begin);
+}
+
+} // namespace
+
+size_t ConversionPlan::convert_into(std::string_view text, char* out, size_t capacity) const {
+    if (byte_only) {
+        if (capacity < text.size()) {
+            return npos;
+        }
+        simd::translate_bytes(byte_table.data(), text.data(), out, text.size());
+        return text.size();
+    }
+    
+    if (capacity >= max_converted_size(text.size())) {
+        return convert_utf8<false>(*this, text.data(), text.size(), out, capacity);
+    }
+    return convert_utf8<true>(*this, text.data(), text.size(), out, capacity);
+}
+
+size_t ConversionPlan::converted_size(std::string_view text) const {
+    if (byte_only) {
+        return text.size();
+    }
+    
+    size_t total = 0;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        if (static_cast<unsigned char>(*p) < 0x80) {
+            total += ascii_table[static_cast<unsigned char>(*p)].length;
+            ++p;
+            continue;
+        }
+        char32_t cp;
+        size_t length = utf8::decode(p, end, cp);
+        unsigned char target_length = codepoint_table.get(cp).length;
+        total += target_length ? target_length : length;
+        p += length;
+    }
+    return total;
+}
+
+size_t ConversionPlan::append_to(std::string_view text, std::string& buffer) const {
+    size_t offset = buffer.size();
+    buffer.resize(offset + max_converted_size(text.size()));
+    size_t written = convert_into(text, &buffer[offset], buffer.size() - offset);
+    buffer.resize(offset + written);
+    return written;
+}
+
+std::string ConversionPlan::convert(std::string_view text) const {
+    std::string result;
+    append_to(text, result);
+    return result;
+}
+
 // KeyBasedLayoutLibrary implementation
+namespace {
+
+// Immutable view of the registered layouts. Readers use one snapshot for a
+// whole call; writers build a replacement and publish it atomically, so a
+// snapshot never changes once readers can see it. The only state filled in
+// after publication is compiled-on-demand plans (one atomic slot per pair);
+// the detection models are built before the snapshot is published.
+struct Registry {
+    struct LayoutSlot {
+        std::string layout_id;
+        std::shared_ptr<const LayoutDefinition> layout;  // Null until loaded or after clear_cache
+    };
+    using PlanBox = std::shared_ptr<const ConversionPlan>;
+    
+    std::vector<LayoutSlot> slots;                          // Indexed by LayoutHandle
+    std::unordered_map<std::string, LayoutHandle> handles;  // Layout ID -> handle
+    std::unique_ptr<std::atomic<const PlanBox*>[]> plans;   // [from * slots.size() + to]
+    std::vector<std::shared_ptr<const WordDictionary>> dictionaries;  // At most one per language
+    std::vector<std::shared_ptr<const NgramModel>> models;            // At most one per language
+    std::shared_ptr<DetectionEngine> detector;  // Shared with incremental detectors
+    
+    Registry() = default;
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+    
+    ~Registry() {
+        size_t count = slots.size() * slots.size();
+        for (size_t i = 0; plans && i < count; ++i) {
+            delete plans[i].load(std::memory_order_relaxed);
+        }
+    }
+    
+    LayoutHandle resolve(const std::string& layout_id) const {
+        auto it = handles.find(layout_id);
+        return it != handles.end() ? it->second : INVALID_LAYOUT_HANDLE;
+    }
+    
+    bool valid(LayoutHandle handle) const {
+        return handle >= 0 && handle < static_cast<LayoutHandle>(slots.size());
+    }
+    
+    // Loaded layout behind a handle, or nullptr
+    const LayoutDefinition* layout(LayoutHandle handle) const {
+        return valid(handle) ? slots[handle].layout.get() : nullptr;
+    }
+    
+    LayoutHandle register_layout(const std::string& layout_id) {
+        auto it = handles.find(layout_id);
+        if (it != handles.end()) {
+            return it->second;
+        }
+        LayoutHandle handle = static_cast<LayoutHandle>(slots.size());
+        slots.push_back({layout_id, nullptr});
+        handles.emplace(layout_id, handle);
+        return handle;
+    }
+    
+    void set_layout(const std::string& layout_id, std::shared_ptr<LayoutDefinition> layout) {
+        if (layout->language.empty()) {
+            layout->language = KeyUtils::default_language_for_family(layout->family_id);
+        }
+        layout->complete_shift_levels();
+        slots[register_layout(layout_id)].layout = std::move(layout);
+    }
+    
+    // Size the plan table for the final slot count, keeping the compiled
+    // plans of `previous` whose layouts did not change
+    void allocate_plans(const Registry& previous) {
+        size_t count = slots.size();
+        plans.reset(new std::atomic<const PlanBox*>[count * count]);
+        for (size_t i = 0; i < count * count; ++i) {
+            plans[i].store(nullptr, std::memory_order_relaxed);
+        }
+        
+        size_t previous_count = previous.slots.size();
+        for (size_t from = 0; previous.plans && from < previous_count; ++from) {
+            if (slots[from].layout != previous.slots[from].layout) continue;
+            for (size_t to = 0; to < previous_count; ++to) {
+                const PlanBox* box = previous.plans[from * previous_count + to].load(std::memory_order_acquire);
+                if (box && slots[to].layout == previous.slots[to].layout) {
+                    plans[from * count + to].store(new PlanBox(*box), std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+    
+    // Plan for a handle pair, compiled on first use. Concurrent first uses
+    // may both compile; one wins the slot and the other is discarded.
+    // Returns a pointer into the table so the hot path never touches the
+    // refcount.
+    const PlanBox* find_plan(LayoutHandle from_layout, LayoutHandle to_layout) const {
+        if (!valid(from_layout) || !valid(to_layout)) {
+            return nullptr;
+        }
+        
+        std::atomic<const PlanBox*>& slot = plans[static_cast<size_t>(from_layout) * slots.size() +
+                                                  static_cast<size_t>(to_layout)];
+        const PlanBox* box = slot.load(std::memory_order_acquire);
+        if (box) {
+            LC_STATS_ADD(PLAN_CACHE_HITS, 1);
+            return box;
+        }
+        LC_STATS_ADD(PLAN_CACHE_MISSES, 1);
+        
+        const auto& from = slots[from_layout];
+        const auto& to = slots[to_layout];
+        if (!from.layout || !to.layout) {
+            return nullptr;
+        }
+        
+        auto plan = build_plan(*from.layout, *to.layout);
+        plan->from_layout_id = from.layout_id;
+        plan->to_layout_id = to.layout_id;
+        auto* fresh = new PlanBox(std::move(plan));
+        if (slot.compare_exchange_strong(box, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return fresh;
+        }
+        delete fresh;
+        return box;
+    }
+    
+    // Build the detection models of the final slots, or share those of
+    // `previous` when no layout, dictionary or model changed
+    void build_detection(const Registry& previous) {
+        bool same_layouts = slots.size() == previous.slots.size();
+        for (size_t handle = 0; same_layouts && handle < slots.size(); ++handle) {
+            same_layouts = slots[handle].layout == previous.slots[handle].layout;
+        }
+        if (previous.detector && same_layouts && dictionaries == previous.dictionaries && models == previous.models) {
+            detector = previous.detector;
+            return;
+        }
+        std::vector<std::shared_ptr<const LayoutDefinition>> layouts;
+        for (const auto& slot : slots) {
+            layouts.push_back(slot.layout);
+        }
+        detector = std::make_shared<DetectionEngine>();
+        detector->rebuild(layouts, dictionaries, models);
+    }
+    
+    const std::shared_ptr<DetectionEngine>& detection_engine() const {
+        return detector;
+    }
+    
+    const DetectionEngine& detection() const {
+        return *detection_engine();
+    }
+    
+    static void add_plan_mapping(ConversionPlan& plan, char32_t source, char32_t target) {
+        utf8::EncodedChar encoded = utf8::encode(target);
+        if (encoded.length == 0) {
+            return;
+        }
+        
+        if (source < 0x80) {
+            plan.ascii_table[source] = encoded;
+            if (encoded.length == 1) {
+                plan.byte_table[source] = static_cast<unsigned char>(encoded.bytes[0]);
+            } else {
+                plan.byte_table[source] = static_cast<unsigned char>(source);
+                plan.byte_only = false;
+            }
+            plan.max_expansion = std::max(plan.max_expansion, encoded.length);
+        } else {
+            unsigned char source_length = utf8::encode(source).length;
+            plan.codepoint_table.set(source, encoded);
+            plan.byte_only = false;
+            plan.max_expansion = std::max<unsigned char>(
+                plan.max_expansion, (encoded.length + source_length - 1) / source_length);
+        }
+    }
+    
+    // Resolve every key position of the pair once. Levels map to the same
+    // level, so case needs no handling of its own: Shift-level characters
+    // were filled in by complete_shift_levels.
+    static std::shared_ptr<ConversionPlan> build_plan(const LayoutDefinition& from_layout,
+                                                      const LayoutDefinition& to_layout) {
+        auto plan = std::make_shared<ConversionPlan>();
+        for (int b = 0; b < 256; ++b) {
+            plan->byte_table[b] = static_cast<unsigned char>(b);
+        }
+        for (int b = 0; b < 128; ++b) {
+            plan->ascii_table[b] = utf8::encode(static_cast<char32_t>(b));
+        }
+        
+        for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+            char32_t source = from_layout.key_to_char[position];
+            char32_t target = to_layout.key_to_char[position];
+            // Skip empty keys and characters that also sit on a later key
+            if (!source || !target || from_layout.key_position_for(source) != position) {
+                continue;
+            }
+            add_plan_mapping(*plan, source, target);
+        }
+        
+        return plan;
+    }
+};
+
+} // namespace
+
 class KeyBasedLayoutLibrary::Impl {
 public:
-    Impl() = default;
-    ~Impl() = default;
+    Impl() {
+        auto registry = new Registry;
+        registry->allocate_plans(Registry{});
+        registry->build_detection(Registry{});
+        registry_.store(registry);
+    }
+    
+    // No reader may still be inside the library here
+    ~Impl() {
+        watcher_.stop();
+        delete registry_.load();
+        EpochDomain::global().reclaim();
+    }
     
     bool load_layout(const std::string& layout_id, const std::string& file_path) {
-        try {
-            std::ifstream file(file_path);
-            if (!file.is_open()) {
-                return false;
-            }
-            
-            json j;
-            file >> j;
-            
-            auto layout = std::make_shared<LayoutDefinition>();
-            layout->id = j["id"];
-            layout->name = j["name"];
-            layout->family_id = j["family_id"];
-            layout->layout_id = j["layout_id"];
-            layout->frequency_score = j["frequency_score"];
-            
-            // Load common words
-            if (j.contains("common_words")) {
-                layout->common_words = j["common_words"].get<std::vector<std::string>>();
+        LC_STATS_TIME(LOAD_LAYOUT);
+        auto layout = parse_layout(file_path);
+        if (!layout) {
+            LC_STATS_ADD(LAYOUT_LOAD_FAILURES, 1);
+            return false;
+        }
+        LC_STATS_ADD(LAYOUTS_LOADED, 1);
+        return add_layout(layout_id, std::move(layout));
+    }
+    
+    size_t load_builtin_layouts() {
+        LC_STATS_TIME(LOAD_LAYOUT);
+        LC_STATS_ADD(LAYOUTS_LOADED, Builtin::LAYOUT_COUNT);
+        publish([](Registry& registry) {
+            for (const Builtin::LayoutData& data : Builtin::LAYOUTS) {
+                auto layout = std::make_shared<LayoutDefinition>();
+                layout->id = data.id;
+                layout->name = data.name;
+                layout->family_id = data.family_id;
+                layout->layout_id = data.layout_id;
+                layout->language = data.language;
+                layout->frequency_score = data.frequency_score;
+                layout->common_words.assign(data.common_words, data.common_words + data.common_word_count);
+                for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+                    if (data.keys[position]) {
+                        layout->set_key(position, data.keys[position]);
+                    }
+                }
+                registry.set_layout(data.layout_key, std::move(layout));
             }
-            
-            // Load key mappings
-            auto key_mappings = j["key_mappings"];
-            for (auto it = key_mappings.begin(); it != key_mappings.end(); ++it) {
-                int key_id = std::stoi(it.key());
-                char character = it.value().get<std::string>()[0];
-                
-                layout->key_to_char[key_id] = character;
-                layout->char_to_key[character] = key_id;
+        });
+        return Builtin::LAYOUT_COUNT;
+    }
+    
+    bool add_layout(const std::string& layout_id, std::shared_ptr<const LayoutDefinition> layout) {
+        if (!layout) {
+            return false;
+        }
+        // The caller keeps its pointer: complete and publish a private copy
+        auto copy = std::make_shared<LayoutDefinition>(*layout);
+        publish([&](Registry& registry) { registry.set_layout(layout_id, std::move(copy)); });
+        return true;
+    }
+    
+    bool load_pack(const std::string& file_path) {
+        LC_STATS_TIME(LOAD_LAYOUT);
+        std::vector<LayoutPack::Entry> layouts;
+        if (!LayoutPack::read(file_path, layouts)) {
+            LC_STATS_ADD(LAYOUT_LOAD_FAILURES, 1);
+            return false;
+        }
+        LC_STATS_ADD(LAYOUTS_LOADED, layouts.size());
+        publish([&](Registry& registry) {
+            for (auto& [layout_id, layout] : layouts) {
+                registry.set_layout(layout_id, std::move(layout));
             }
-            
-            layouts_[layout_id] = layout;
-            return true;
-            
-        } catch (const std::exception& e) {
+        });
+        return true;
+    }
+    
+    bool load_dictionary(const std::string& file_path) {
+        auto dictionary = WordDictionary::open(file_path);
+        if (!dictionary) {
             return false;
         }
+        publish([&](Registry& registry) {
+            auto& dictionaries = registry.dictionaries;
+            dictionaries.erase(std::remove_if(dictionaries.begin(), dictionaries.end(),
+                                              [&](const auto& loaded) {
+                                                  return loaded->language() == dictionary->language();
+                                              }),
+                               dictionaries.end());
+            dictionaries.push_back(std::move(dictionary));
+        });
+        return true;
     }
     
-    std::shared_ptr<LayoutDefinition> get_layout(const std::string& layout_id) {
-        auto it = layouts_.find(layout_id);
-        if (it != layouts_.end()) {
-            return it->second;
+    bool load_language_model(const std::string& file_path) {
+        auto model = NgramModel::open(file_path);
+        if (!model) {
+            return false;
+        }
+        publish([&](Registry& registry) {
+            auto& models = registry.models;
+            models.erase(std::remove_if(models.begin(), models.end(),
+                                        [&](const auto& loaded) { return loaded->language() == model->language(); }),
+                         models.end());
+            models.push_back(std::move(model));
+        });
+        return true;
+    }
+    
+    bool save_pack(const std::string& file_path) const {
+        std::vector<LayoutPack::ConstEntry> layouts;
+        {
+            EpochGuard guard;
+            for (const auto& slot : snapshot().slots) {
+                if (slot.layout) {
+                    layouts.emplace_back(slot.layout_id, slot.layout);
+                }
+            }
+        }
+        return LayoutPack::write(file_path, layouts);
+    }
+    
+    size_t load_directory(const std::string& directory) {
+        LC_STATS_TIME(LOAD_LAYOUT);
+        std::error_code ec;
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                files.push_back(entry.path());
+            }
         }
-        return nullptr;
+        std::sort(files.begin(), files.end());  // Deterministic handle order
+        
+        // Parse everything first, then publish once
+        std::vector<std::pair<std::string, std::shared_ptr<LayoutDefinition>>> layouts;
+        for (const auto& path : files) {
+            if (auto layout = parse_layout(path.string())) {
+                layouts.emplace_back(path.stem().string(), std::move(layout));
+            }
+        }
+        LC_STATS_ADD(LAYOUTS_LOADED, layouts.size());
+        LC_STATS_ADD(LAYOUT_LOAD_FAILURES, files.size() - layouts.size());
+        if (!layouts.empty()) {
+            publish([&](Registry& registry) {
+                for (auto& [layout_id, layout] : layouts) {
+                    registry.set_layout(layout_id, std::move(layout));
+                }
+            });
+        }
+        return layouts.size();
+    }
+    
+    bool watch_directory(const std::string& directory) {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        return watcher_.start(directory, [this, directory](const DirectoryWatcher::Changes& changes) {
+            reload_files(directory, changes);
+        });
+    }
+    
+    void stop_watching() {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        watcher_.stop();
+    }
+    
+    ReloadStats get_reload_stats() const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        return reload_stats_;
+    }
+    
+    std::shared_ptr<const LayoutDefinition> get_layout(const std::string& layout_id) const {
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        LayoutHandle handle = registry.resolve(layout_id);
+        return handle != INVALID_LAYOUT_HANDLE ? registry.slots[handle].layout : nullptr;
+    }
+    
+    LayoutHandle resolve_layout(const std::string& layout_id) const {
+        EpochGuard guard;
+        return snapshot().resolve(layout_id);
+    }
+    
+    std::string get_layout_id(LayoutHandle handle) const {
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        return registry.valid(handle) ? registry.slots[handle].layout_id : "";
+    }
+    
+    std::shared_ptr<const ConversionPlan> compile(const std::string& from_layout_id,
+                                                  const std::string& to_layout_id) const {
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        auto plan = registry.find_plan(registry.resolve(from_layout_id), registry.resolve(to_layout_id));
+        return plan ? *plan : nullptr;
+    }
+    
+    std::shared_ptr<const ConversionPlan> compile(LayoutHandle from_layout, LayoutHandle to_layout) const {
+        EpochGuard guard;
+        auto plan = snapshot().find_plan(from_layout, to_layout);
+        return plan ? *plan : nullptr;
     }
     
     std::string convert_text(const std::string& text, 
                            const std::string& from_layout_id, 
-                           const std::string& to_layout_id) {
-        auto from_layout = get_layout(from_layout_id);
-        auto to_layout = get_layout(to_layout_id);
-        
-        if (!from_layout || !to_layout) {
+                           const std::string& to_layout_id) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        auto plan = registry.find_plan(registry.resolve(from_layout_id), registry.resolve(to_layout_id));
+        if (!plan) {
+            LC_STATS_ONLY(record_conversion(nullptr, text, text.size()));
             return text;  // Return original if layouts not found
         }
         
-        std::string result;
-        result.reserve(text.length());
+        std::string result = (*plan)->convert(text);
+        LC_STATS_ONLY(record_conversion(plan->get(), text, result.size()));
+        return result;
+    }
+    
+    size_t convert_text(std::string_view text, LayoutHandle from_layout, LayoutHandle to_layout,
+                        char* out, size_t capacity) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        auto plan = snapshot().find_plan(from_layout, to_layout);
+        if (!plan) {
+            if (capacity < text.size()) {
+                return ConversionPlan::npos;
+            }
+            std::memcpy(out, text.data(), text.size());
+            LC_STATS_ONLY(record_conversion(nullptr, text, text.size()));
+            return text.size();
+        }
         
-        for (char c : text) {
-            char converted = convert_char(c, *from_layout, *to_layout);
-            result += converted;
+        size_t written = (*plan)->convert_into(text, out, capacity);
+        LC_STATS_ONLY(if (written != ConversionPlan::npos) record_conversion(plan->get(), text, written));
+        return written;
+    }
+    
+    size_t convert_text(std::string_view text, LayoutHandle from_layout, LayoutHandle to_layout,
+                        std::string& out) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        auto plan = snapshot().find_plan(from_layout, to_layout);
+        if (!plan) {
+            out.append(text);
+            LC_STATS_ONLY(record_conversion(nullptr, text, text.size()));
+            return text.size();
         }
         
-        return result;
+        size_t written = (*plan)->append_to(text, out);
+        LC_STATS_ONLY(record_conversion(plan->get(), text, written));
+        return written;
+    }
+    
+    void convert_batch(const std::vector<std::string_view>& inputs, LayoutHandle from_layout,
+                       LayoutHandle to_layout, StringBatch& out, unsigned threads) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;  // Covers the workers too: they run inside this call
+        convert_batch_with(snapshot().find_plan(from_layout, to_layout), inputs, out, threads);
+    }
+    
+    void convert_batch(const std::vector<std::string_view>& inputs, const std::string& from_layout_id,
+                       const std::string& to_layout_id, StringBatch& out, unsigned threads) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        convert_batch_with(registry.find_plan(registry.resolve(from_layout_id), registry.resolve(to_layout_id)),
+                           inputs, out, threads);
+    }
+    
+    void convert_fanout(std::string_view text, LayoutHandle from_layout, const std::vector<LayoutHandle>& targets,
+                        StringBatch& out) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        const LayoutDefinition* source = registry.layout(from_layout);
+        std::vector<const LayoutDefinition*> target_layouts = layouts(registry, targets);
+        layout_converter::convert_fanout(text, &source, 1, target_layouts.data(), target_layouts.size(), out);
+        LC_STATS_ONLY(record_fanout(registry, text, {from_layout}, targets, out));
+    }
+    
+    void convert_fanout(std::string_view text, const std::vector<LayoutHandle>& targets, StringBatch& out) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        std::vector<LayoutHandle> sources(registry.slots.size());
+        for (size_t handle = 0; handle < sources.size(); ++handle) {
+            sources[handle] = static_cast<LayoutHandle>(handle);
+        }
+        std::vector<const LayoutDefinition*> source_layouts = layouts(registry, sources);
+        std::vector<const LayoutDefinition*> target_layouts = layouts(registry, targets);
+        layout_converter::convert_fanout(text, source_layouts.data(), source_layouts.size(), target_layouts.data(),
+                                         target_layouts.size(), out);
+        LC_STATS_ONLY(record_fanout(registry, text, sources, targets, out));
     }
     
     std::vector<std::string> detect_likely_layouts(const std::string& text, 
-                                                  const std::string& user_language) {
-        std::vector<std::pair<std::string, double>> scores;
+                                                  const std::string& user_language) const {
+        LC_STATS_TIME(DETECT);
+        LC_STATS_ADD(DETECT_CALLS, 1);
+        LC_STATS_ADD(DETECT_BYTES, text.size());
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        std::vector<std::string> result;
+        std::vector<bool> seen(registry.slots.size());
+        for (const LayoutHypothesis& hypothesis : registry.detection().score(text, user_language)) {
+            if (!seen[hypothesis.typed_layout]) {
+                seen[hypothesis.typed_layout] = true;
+                result.push_back(registry.slots[hypothesis.typed_layout].layout_id);
+            }
+        }
+        return result;
+    }
+    
+    std::vector<LayoutHypothesis> detect_hypotheses(std::string_view text, const std::string& user_language,
+                                                    size_t max_results) const {
+        LC_STATS_TIME(DETECT);
+        LC_STATS_ADD(DETECT_CALLS, 1);
+        LC_STATS_ADD(DETECT_BYTES, text.size());
+        EpochGuard guard;
+        return snapshot().detection().score(text, user_language, max_results);
+    }
+    
+    void detect_batch(const std::vector<std::string_view>& inputs, const std::string& user_language,
+                      DetectionBatch& out, size_t top_k, unsigned threads) const {
+        LC_STATS_TIME(DETECT);
+        LC_STATS_ONLY(for (std::string_view input : inputs) {
+            LC_STATS_ADD(DETECT_CALLS, 1);
+            LC_STATS_ADD(DETECT_BYTES, input.size());
+        })
+        EpochGuard guard;
+        snapshot().detection().score_batch(inputs.data(), inputs.size(), user_language, top_k, threads, out);
+    }
+    
+    size_t fix_mistyped(std::string_view text, const std::vector<LayoutHandle>& candidates,
+                        std::string& out) const {
+        LC_STATS_TIME(CONVERT);
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        const DetectionEngine& engine = registry.detection();
+        const size_t count = candidates.size();
+        const size_t start = out.size();
         
-        for (const auto& [layout_id, layout] : layouts_) {
-            double score = calculate_layout_score(text, *layout, user_language);
-            if (score > 0.1) {  // Threshold
-                scores.emplace_back(layout_id, score);
+        // n candidates make n * (n - 1) + 1 states per word; keep that bounded
+        if (count > MAX_FIX_CANDIDATES) {
+            out.append(text.data(), text.size());
+            return text.size();
+        }
+        
+        // Reading states: 0 = as written, 1 + p = converted with the p-th
+        // ordered (typed, intended) pair of distinct candidates
+        std::vector<std::pair<size_t, size_t>> pairs;
+        for (size_t typed = 0; typed < count; ++typed) {
+            for (size_t intended = 0; intended < count; ++intended) {
+                if (candidates[typed] != candidates[intended]) pairs.emplace_back(typed, intended);
             }
         }
+        const size_t states = pairs.size() + 1;
         
-        // Sort by score (highest first)
-        std::sort(scores.begin(), scores.end(), 
-                 [](const auto& a, const auto& b) { return a.second > b.second; });
+        // Viterbi over words in one pass: a word's weight in each state is
+        // its whole log-probability under that reading, and changing state
+        // between words costs SWITCH_PENALTY, so short words follow their
+        // neighbours and a run of mistyped words converts as one span
+        struct Word {
+            size_t begin, end;
+        };
+        std::vector<Word> words;
+        std::vector<uint32_t> back;  // Best previous state, per word and state
+        std::vector<double> path(states, -DetectionEngine::SWITCH_PENALTY), next(states);
+        path[0] = 0.0;
+        std::vector<double> scores(count * count);
+        WordMatcher::Matches matches;
         
-        std::vector<std::string> result;
-        for (const auto& [layout_id, score] : scores) {
-            result.push_back(layout_id);
+        size_t i = 0;
+        while (true) {
+            while (i < text.size() && static_cast<unsigned char>(text[i]) <= 0x20) ++i;
+            if (i == text.size()) break;
+            size_t begin = i;
+            size_t characters = 0;
+            for (; i < text.size() && static_cast<unsigned char>(text[i]) > 0x20; ++i) {
+                characters += (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80;
+            }
+            words.push_back({begin, i});
+            engine.score_word(text.substr(begin, i - begin), candidates.data(), count, matches, scores.data());
+            
+            double literal = -std::numeric_limits<double>::infinity();
+            for (size_t c = 0; c < count; ++c) {
+                literal = std::max(literal, scores[c * count + c]);
+            }
+            size_t best = static_cast<size_t>(std::max_element(path.begin(), path.end()) - path.begin());
+            double switched = path[best] - DetectionEngine::SWITCH_PENALTY;
+            for (size_t s = 0; s < states; ++s) {
+                double score = s == 0 ? literal : scores[pairs[s - 1].first * count + pairs[s - 1].second];
+                // A word no candidate can type is neutral in every reading;
+                // otherwise readings whose typed layout lacks it are ruled out
+                double weight = score == -std::numeric_limits<double>::infinity()
+                              ? (literal == score ? 0.0 : DetectionEngine::UNREADABLE_WORD)
+                              : score * static_cast<double>(characters);
+                bool stay = path[s] >= switched;
+                back.push_back(static_cast<uint32_t>(stay ? s : best));
+                next[s] = (stay ? path[s] : switched) + weight;
+            }
+            path.swap(next);
         }
         
-        return result;
+        // Walk back to each word's state, then copy or convert word by word
+        size_t state = static_cast<size_t>(std::max_element(path.begin(), path.end()) - path.begin());
+        for (size_t w = words.size(); w-- > 0;) {
+            size_t previous = back[w * states + state];
+            back[w * states] = static_cast<uint32_t>(state);  // Reuse the row to hold the decision
+            state = previous;
+        }
+        size_t copied = 0;
+        for (size_t w = 0; w < words.size(); ++w) {
+            const Word& word = words[w];
+            out.append(text.data() + copied, word.begin - copied);
+            size_t s = back[w * states];
+            const Registry::PlanBox* plan =
+                s ? registry.find_plan(candidates[pairs[s - 1].first], candidates[pairs[s - 1].second]) : nullptr;
+            if (plan) {
+                (*plan)->append_to(text.substr(word.begin, word.end - word.begin), out);
+            } else {
+                out.append(text.data() + word.begin, word.end - word.begin);
+            }
+            copied = word.end;
+        }
+        out.append(text.data() + copied, text.size() - copied);
+        
+        LC_STATS_ADD(CONVERT_CALLS, 1);
+        LC_STATS_ADD(CONVERT_BYTES_IN, text.size());
+        LC_STATS_ADD(CONVERT_BYTES_OUT, out.size() - start);
+        return out.size() - start;
+    }
+    
+    std::shared_ptr<const DetectionEngine> detection_engine() const {
+        EpochGuard guard;
+        return snapshot().detection_engine();
     }
     
     std::vector<std::string> get_loaded_layouts() const {
+        EpochGuard guard;
         std::vector<std::string> result;
-        for (const auto& [layout_id, layout] : layouts_) {
-            result.push_back(layout_id);
+        for (const auto& slot : snapshot().slots) {
+            if (slot.layout) {
+                result.push_back(slot.layout_id);
+            }
         }
         return result;
     }
     
+    // Handles survive clear_cache so callers holding them stay valid
     void clear_cache() {
-        layouts_.clear();
+        publish([](Registry& registry) {
+            for (auto& slot : registry.slots) {
+                slot.layout.reset();
+            }
+        });
     }
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<LayoutDefinition>> layouts_;
+    std::atomic<const Registry*> registry_;  // Current snapshot
+    std::mutex writer_mutex_;                // Serializes publishers; readers never take it
     
-    char convert_char(char c, const LayoutDefinition& from_layout, const LayoutDefinition& to_layout) {
-        // Get key ID for character in source layout
-        int key_id = KeyUtils::get_key_id_for_char(c, from_layout);
-        if (key_id == 0) {
-            return c;  // Character not found, return original
-        }
-        
-        // Extract key position from key ID
-        KeyIDComponents components(key_id);
-        
-        // Generate key ID for target layout
-        int target_key_id = generate_key_id(to_layout.family_id, to_layout.layout_id, components.key_position);
-        
-        // Get character for target key ID
-        char result = KeyUtils::get_char_for_key_id(target_key_id, to_layout);
-        if (result == '\0') {
-            return c;  // No mapping found, return original
-        }
-        
-        // Preserve case
-        return std::isupper(c) ? std::toupper(result) : result;
+    std::mutex watch_mutex_;                 // Guards starting and stopping the watcher
+    DirectoryWatcher watcher_;
+    mutable std::mutex stats_mutex_;
+    ReloadStats reload_stats_;
+    
+    // Current snapshot; only valid while the caller holds an EpochGuard.
+    // seq_cst pairs with the guard's announcement (store before load).
+    const Registry& snapshot() const {
+        return *registry_.load(std::memory_order_seq_cst);
     }
     
-    double calculate_layout_score(const std::string& text, const LayoutDefinition& layout, 
-                                const std::string& user_language) {
-        double score = 0.0;
-        
-        // Character frequency analysis
-        score += analyze_character_frequency(text, layout);
+    // Copy the current snapshot, apply `update` and publish the result.
+    // The previous snapshot is freed once no reader can still hold it.
+    template <typename Update>
+    void publish(Update&& update) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        const Registry* current = registry_.load(std::memory_order_relaxed);
+        auto next = std::make_unique<Registry>();
+        next->slots = current->slots;
+        next->handles = current->handles;
+        next->dictionaries = current->dictionaries;
+        next->models = current->models;
+        update(*next);
+        next->allocate_plans(*current);
+        next->build_detection(*current);  // Off the readers' path: they only see finished models
         
-        // Common word analysis
-        score += analyze_common_words(text, layout);
-        
-        // Language compatibility
-        score += analyze_language_compatibility(text, layout, user_language);
-        
-        // Base frequency score
-        score += layout.frequency_score * 0.1;
-        
-        return score;
+        registry_.store(next.release(), std::memory_order_seq_cst);
+        EpochDomain::global().retire(current);
     }
     
-    double analyze_character_frequency(const std::string& text, const LayoutDefinition& layout) {
-        if (text.empty()) return 0.0;
-        
-        std::unordered_map<char, int> char_count;
-        for (char c : text) {
-            if (std::isalpha(c)) {
-                char_count[std::tolower(c)]++;
+    // Loaded layout behind each handle, nullptr where there is none
+    static std::vector<const LayoutDefinition*> layouts(const Registry& registry,
+                                                        const std::vector<LayoutHandle>& handles) {
+        std::vector<const LayoutDefinition*> result(handles.size());
+        for (size_t i = 0; i < handles.size(); ++i) {
+            result[i] = registry.layout(handles[i]);
+        }
+        return result;
+    }
+    
+    // Batch through `plan`, or copy the inputs if there is none
+    static void convert_batch_with(const Registry::PlanBox* plan, const std::vector<std::string_view>& inputs,
+                                   StringBatch& out, unsigned threads) {
+        if (plan) {
+            layout_converter::convert_batch(**plan, inputs.data(), inputs.size(), out, threads);
+        } else {
+            out.arena.clear();
+            out.offsets.assign(1, 0);
+            for (std::string_view input : inputs) {
+                out.arena.append(input);
+                out.offsets.push_back(out.arena.size());
             }
         }
+        LC_STATS_ONLY(for (size_t i = 0; i < inputs.size(); ++i) {
+            record_conversion(plan ? plan->get() : nullptr, inputs[i], out[i].size());
+        })
+    }
+    
+#ifdef LAYOUT_CONVERTER_STATS
+    // Counters of one converted text; `plan` is null if it was copied as-is
+    static void record_conversion(const ConversionPlan* plan, std::string_view text, size_t written) {
+        LC_STATS_ADD(CONVERT_CALLS, 1);
+        LC_STATS_ADD(CONVERT_BYTES_IN, text.size());
+        LC_STATS_ADD(CONVERT_BYTES_OUT, written);
         
-        // Check if characters exist in layout
-        int found_chars = 0;
-        int total_chars = 0;
-        
-        for (const auto& [c, count] : char_count) {
-            total_chars += count;
-            if (layout.char_to_key.find(c) != layout.char_to_key.end()) {
-                found_chars += count;
+        // Extra pass over the text; only paid in statistics builds
+        size_t passthrough = 0;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            auto byte = static_cast<unsigned char>(*p);
+            if (byte < 0x80) {
+                passthrough += !plan || (plan->ascii_table[byte].length == 1 &&
+                                         static_cast<unsigned char>(plan->ascii_table[byte].bytes[0]) == byte);
+                ++p;
+                continue;
             }
+            char32_t cp;
+            size_t length = utf8::decode(p, end, cp);
+            passthrough += !plan || plan->codepoint_table.get(cp).length == 0;
+            p += length;
         }
-        
-        return total_chars > 0 ? static_cast<double>(found_chars) / total_chars : 0.0;
+        LC_STATS_ADD(PASSTHROUGH_CHARACTERS, passthrough);
     }
     
-    double analyze_common_words(const std::string& text, const LayoutDefinition& layout) {
-        if (layout.common_words.empty()) return 0.0;
-        
-        std::string lower_text = text;
-        std::transform(lower_text.begin(), lower_text.end(), lower_text.begin(), ::tolower);
-        
-        int found_words = 0;
-        for (const std::string& word : layout.common_words) {
-            if (lower_text.find(word) != std::string::npos) {
-                found_words++;
+    // Counters of a fan-out, as if each output were its own conversion
+    static void record_fanout(const Registry& registry, std::string_view text, const std::vector<LayoutHandle>& sources,
+                              const std::vector<LayoutHandle>& targets, const StringBatch& out) {
+        for (size_t s = 0; s < sources.size(); ++s) {
+            for (size_t t = 0; t < targets.size(); ++t) {
+                const Registry::PlanBox* plan = registry.find_plan(sources[s], targets[t]);
+                record_conversion(plan ? plan->get() : nullptr, text, out[s * targets.size() + t].size());
             }
         }
-        
-        return static_cast<double>(found_words) / layout.common_words.size();
     }
+#endif
     
-    double analyze_language_compatibility(const std::string& text, const LayoutDefinition& layout, 
-                                        const std::string& user_language) {
-        // Simple script detection
-        bool has_cyrillic = false;
-        bool has_latin = false;
-        
-        for (char c : text) {
-            if (c >= 0x0400 && c <= 0x04FF) {  // Cyrillic range
-                has_cyrillic = true;
-            } else if (std::isalpha(c)) {
-                has_latin = true;
+    // Apply one batch of watched file changes (runs on the watcher thread)
+    void reload_files(const std::string& directory, const DirectoryWatcher::Changes& changes) {
+        std::vector<std::pair<std::string, std::shared_ptr<LayoutDefinition>>> layouts;
+        uint64_t failed = 0;
+        for (const std::string& name : changes.changed) {
+            std::filesystem::path path = std::filesystem::path(directory) / name;
+            auto layout = parse_layout(path.string());
+            if (!layout || !validate_layout(*layout, loaded_base_keys(path.stem().string()))) {
+                ++failed;
+                continue;
             }
+            layouts.emplace_back(path.stem().string(), std::move(layout));
         }
         
-        // Score based on script compatibility
-        if (layout.family_id == KeyID::FAMILY_CYRILLIC && has_cyrillic) {
-            return 0.5;
-        } else if (layout.family_id == KeyID::FAMILY_LATIN && has_latin) {
-            return 0.5;
+        uint64_t removed = 0;
+        if (!layouts.empty() || !changes.removed.empty()) {
+            publish([&](Registry& registry) {
+                for (auto& [layout_id, layout] : layouts) {
+                    registry.set_layout(layout_id, std::move(layout));
+                }
+                for (const std::string& name : changes.removed) {
+                    LayoutHandle handle = registry.resolve(std::filesystem::path(name).stem().string());
+                    if (handle != INVALID_LAYOUT_HANDLE && registry.slots[handle].layout) {
+                        registry.slots[handle].layout.reset();
+                        ++removed;
+                    }
+                }
+            });
         }
         
-        return 0.0;
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - changes.noticed);
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        reload_stats_.failed_validations += failed;
+        if (!layouts.empty() || removed) {
+            ++reload_stats_.reloads;
+            reload_stats_.layouts_reloaded += layouts.size();
+            reload_stats_.layouts_removed += removed;
+            reload_stats_.last_latency_us = static_cast<uint64_t>(latency.count());
+            reload_stats_.max_latency_us = std::max(reload_stats_.max_latency_us, reload_stats_.last_latency_us);
+        }
+    }
+    
+    // Keys mapped at the base level
+    static int base_key_count(const LayoutDefinition& layout) {
+        return static_cast<int>(std::count_if(layout.key_to_char.begin() + 1,
+                                              layout.key_to_char.begin() + 1 + KeyID::PHYSICAL_KEY_COUNT,
+                                              [](char32_t c) { return c != 0; }));
+    }
+    
+    // Base-level keys of the layout loaded under `layout_id` (0 if none)
+    int loaded_base_keys(const std::string& layout_id) const {
+        EpochGuard guard;
+        const Registry& registry = snapshot();
+        const LayoutDefinition* layout = registry.layout(registry.resolve(layout_id));
+        return layout ? base_key_count(*layout) : 0;
+    }
+    
+    // Checks a reloaded layout must pass before it replaces a working one:
+    // it has an ID, keys at the base level, a language (given or from its
+    // family) and at least half the base keys of the version it replaces,
+    // so a truncated edit keeps the working version
+    static bool validate_layout(const LayoutDefinition& layout, int previous_base_keys) {
+        int base_keys = base_key_count(layout);
+        if (layout.id.empty() || base_keys == 0) {
+            return false;
+        }
+        if (layout.language.empty() && KeyUtils::default_language_for_family(layout.family_id).empty()) {
+            return false;
+        }
+        return 2 * base_keys >= previous_base_keys;
+    }
+    
+    // Parse a layout JSON file. Returns nullptr if it cannot be read, names
+    // an unknown key or maps a key to anything but exactly one character.
+    static std::shared_ptr<LayoutDefinition> parse_layout(const std::string& file_path) {
+        try {
+            std::ifstream file(file_path);
+            if (!file.is_open()) {
+                return nullptr;
+            }
+            
+            json j;
+            file >> j;
+            
+            auto layout = std::make_shared<LayoutDefinition>();
+            layout->id = j["id"];
+            layout->name = j["name"];
+            layout->family_id = j.value("family_id", 0);
+            layout->layout_id = j.value("layout_id", 0);
+            layout->language = j.value("language", std::string());
+            layout->frequency_score = j["frequency_score"];
+            
+            // Load common words
+            if (j.contains("common_words")) {
+                layout->common_words = j["common_words"].get<std::vector<std::string>>();
+            }
+            
+            // Load key mappings (key names -> single UTF-8 characters)
+            auto key_mappings = j["key_mappings"];
+            for (auto it = key_mappings.begin(); it != key_mappings.end(); ++it) {
+                int position = KeyUtils::key_position_from_name(it.key());
+                if (!position) {
+                    return nullptr;  // Unknown key
+                }
+                std::string character = it.value().get<std::string>();
+                if (character.empty()) {
+                    continue;
+                }
+                
+                char32_t cp;
+                const char* begin = character.data();
+                if (utf8::decode(begin, begin + character.size(), cp) != character.size() ||
+                    cp == utf8::INVALID_CODEPOINT) {
+                    return nullptr;  // Not exactly one well-formed character
+                }
+                layout->set_key(position, cp);
+            }
+            
+            return layout;
+            
+        } catch (const std::exception& e) {
+            return nullptr;
+        }
     }
 };
 
@@ -268,21 +1153,159 @@ bool KeyBasedLayoutLibrary::load_layout(const std::string& layout_id, const std:
     return pImpl->load_layout(layout_id, file_path);
 }
 
-std::shared_ptr<LayoutDefinition> KeyBasedLayoutLibrary::get_layout(const std::string& layout_id) {
+size_t KeyBasedLayoutLibrary::load_directory(const std::string& directory) {
+    return pImpl->load_directory(directory);
+}
+
+size_t KeyBasedLayoutLibrary::load_builtin_layouts() {
+    return pImpl->load_builtin_layouts();
+}
+
+bool KeyBasedLayoutLibrary::add_layout(const std::string& layout_id, std::shared_ptr<const LayoutDefinition> layout) {
+    return pImpl->add_layout(layout_id, std::move(layout));
+}
+
+bool KeyBasedLayoutLibrary::watch_directory(const std::string& directory) {
+    return pImpl->watch_directory(directory);
+}
+
+void KeyBasedLayoutLibrary::stop_watching() {
+    pImpl->stop_watching();
+}
+
+ReloadStats KeyBasedLayoutLibrary::get_reload_stats() const {
+    return pImpl->get_reload_stats();
+}
+
+bool KeyBasedLayoutLibrary::load_pack(const std::string& file_path) {
+    return pImpl->load_pack(file_path);
+}
+
+bool KeyBasedLayoutLibrary::load_dictionary(const std::string& file_path) {
+    return pImpl->load_dictionary(file_path);
+}
+
+bool KeyBasedLayoutLibrary::load_language_model(const std::string& file_path) {
+    return pImpl->load_language_model(file_path);
+}
+
+bool KeyBasedLayoutLibrary::save_pack(const std::string& file_path) const {
+    return pImpl->save_pack(file_path);
+}
+
+std::shared_ptr<const LayoutDefinition> KeyBasedLayoutLibrary::get_layout(const std::string& layout_id) {
     return pImpl->get_layout(layout_id);
 }
 
+std::shared_ptr<const ConversionPlan> KeyBasedLayoutLibrary::compile(const std::string& from_layout_id,
+                                                                     const std::string& to_layout_id) {
+    return pImpl->compile(from_layout_id, to_layout_id);
+}
+
+std::shared_ptr<const ConversionPlan> KeyBasedLayoutLibrary::compile(LayoutHandle from_layout,
+                                                                     LayoutHandle to_layout) {
+    return pImpl->compile(from_layout, to_layout);
+}
+
+LayoutHandle KeyBasedLayoutLibrary::resolve_layout(const std::string& layout_id) const {
+    return pImpl->resolve_layout(layout_id);
+}
+
+std::string KeyBasedLayoutLibrary::get_layout_id(LayoutHandle handle) const {
+    return pImpl->get_layout_id(handle);
+}
+
 std::string KeyBasedLayoutLibrary::convert_text(const std::string& text, 
                                               const std::string& from_layout_id, 
                                               const std::string& to_layout_id) {
     return pImpl->convert_text(text, from_layout_id, to_layout_id);
 }
 
+size_t KeyBasedLayoutLibrary::convert_text(std::string_view text, LayoutHandle from_layout,
+                                           LayoutHandle to_layout, char* out, size_t capacity) {
+    return pImpl->convert_text(text, from_layout, to_layout, out, capacity);
+}
+
+size_t KeyBasedLayoutLibrary::convert_text(std::string_view text, LayoutHandle from_layout,
+                                           LayoutHandle to_layout, std::string& out) {
+    return pImpl->convert_text(text, from_layout, to_layout, out);
+}
+
+void KeyBasedLayoutLibrary::convert_batch(const std::vector<std::string_view>& inputs, LayoutHandle from_layout,
+                                          LayoutHandle to_layout, StringBatch& out, unsigned threads) {
+    pImpl->convert_batch(inputs, from_layout, to_layout, out, threads);
+}
+
+void KeyBasedLayoutLibrary::convert_batch(const std::vector<std::string_view>& inputs,
+                                          const std::string& from_layout_id, const std::string& to_layout_id,
+                                          StringBatch& out, unsigned threads) {
+    pImpl->convert_batch(inputs, from_layout_id, to_layout_id, out, threads);
+}
+
+bool KeyBasedLayoutLibrary::convert_file(const std::string& input_path, const std::string& output_path,
+                                         const std::string& from_layout_id, const std::string& to_layout_id,
+                                         unsigned threads) {
+    auto plan = compile(from_layout_id, to_layout_id);
+    return plan && layout_converter::convert_file(plan, input_path, output_path, threads);
+}
+
+void KeyBasedLayoutLibrary::convert_fanout(std::string_view text, LayoutHandle from_layout,
+                                           const std::vector<LayoutHandle>& target_layouts, StringBatch& out) {
+    pImpl->convert_fanout(text, from_layout, target_layouts, out);
+}
+
+void KeyBasedLayoutLibrary::convert_fanout(std::string_view text, const std::string& from_layout_id,
+                                           const std::vector<std::string>& target_layout_ids, StringBatch& out) {
+    std::vector<LayoutHandle> targets;
+    for (const std::string& layout_id : target_layout_ids) {
+        targets.push_back(pImpl->resolve_layout(layout_id));
+    }
+    pImpl->convert_fanout(text, pImpl->resolve_layout(from_layout_id), targets, out);
+}
+
+void KeyBasedLayoutLibrary::convert_fanout(std::string_view text, const std::vector<LayoutHandle>& target_layouts,
+                                           StringBatch& out) {
+    pImpl->convert_fanout(text, target_layouts, out);
+}
+
 std::vector<std::string> KeyBasedLayoutLibrary::detect_likely_layouts(const std::string& text, 
                                                                      const std::string& user_language) {
     return pImpl->detect_likely_layouts(text, user_language);
 }
 
+std::vector<LayoutHypothesis> KeyBasedLayoutLibrary::detect_hypotheses(std::string_view text,
+                                                                       const std::string& user_language,
+                                                                       size_t max_results) {
+    return pImpl->detect_hypotheses(text, user_language, max_results);
+}
+
+void KeyBasedLayoutLibrary::detect_batch(const std::vector<std::string_view>& inputs,
+                                         const std::string& user_language, DetectionBatch& out,
+                                         size_t top_k, unsigned threads) {
+    pImpl->detect_batch(inputs, user_language, out, top_k, threads);
+}
+
+std::string KeyBasedLayoutLibrary::fix_mistyped(std::string_view text,
+                                                const std::vector<std::string>& candidate_layouts) {
+    std::vector<LayoutHandle> candidates;
+    for (const std::string& layout_id : candidate_layouts) {
+        candidates.push_back(pImpl->resolve_layout(layout_id));
+    }
+    std::string result;
+    result.reserve(text.size());
+    pImpl->fix_mistyped(text, candidates, result);
+    return result;
+}
+
+size_t KeyBasedLayoutLibrary::fix_mistyped(std::string_view text, const std::vector<LayoutHandle>& candidate_layouts,
+                                           std::string& out) {
+    return pImpl->fix_mistyped(text, candidate_layouts, out);
+}
+
+IncrementalDetector KeyBasedLayoutLibrary::create_incremental_detector(const std::string& user_language) const {
+    return IncrementalDetector(pImpl->detection_engine(), user_language);
+}
+
 std::vector<std::string> KeyBasedLayoutLibrary::get_loaded_layouts() const {
     return pImpl->get_loaded_layouts();
 }
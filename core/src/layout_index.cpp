@@ -0,0 +1,48 @@
+// Layout Index Implementation
+
+#include "layout_index.h"
+#include <map>
+#include <unordered_map>
+
+namespace layout_converter {
+
+void LayoutIndex::build(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts,
+                        const std::vector<unsigned>& scripts) {
+    words_ = (layouts.size() + 63) / 64;
+    layout_count_ = 0;
+    group_scripts_.clear();
+    group_bits_.clear();
+
+    std::unordered_map<char32_t, std::vector<uint64_t>> sets;
+    for (size_t handle = 0; handle < layouts.size(); ++handle) {
+        if (!layouts[handle]) continue;
+        ++layout_count_;
+        size_t group = 0;
+        while (group < group_scripts_.size() && group_scripts_[group] != scripts[handle]) ++group;
+        if (group == group_scripts_.size()) {
+            group_scripts_.push_back(scripts[handle]);
+            group_bits_.resize(group_bits_.size() + words_, 0);
+        }
+        group_bits_[group * words_ + handle / 64] |= uint64_t(1) << (handle % 64);
+        for (char32_t c : layouts[handle]->key_to_char) {
+            if (!c) continue;
+            std::vector<uint64_t>& set = sets[c];
+            set.resize(words_);
+            set[handle / 64] |= uint64_t(1) << (handle % 64);
+        }
+    }
+
+    // Row 0 stays empty for characters no layout has
+    rows_ = utf8::CodepointTable<uint32_t>();
+    bits_.assign(words_, 0);
+    std::map<std::vector<uint64_t>, uint32_t> row_of_set;
+    for (const auto& [c, set] : sets) {
+        auto [it, added] = row_of_set.emplace(set, static_cast<uint32_t>(row_count()));
+        if (added) {
+            bits_.insert(bits_.end(), set.begin(), set.end());
+        }
+        rows_.set(c, it->second);
+    }
+}
+
+} // namespace layout_converter
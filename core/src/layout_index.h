@@ -0,0 +1,96 @@
+// Layout Index
+// Inverted index from characters to the loaded layouts that have a key for
+// them, used to compute every layout's coverage of a text at once
+
+#ifndef LAYOUT_INDEX_H
+#define LAYOUT_INDEX_H
+
+#include "../include/key_system.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace layout_converter {
+
+// Each character of any loaded layout owns a row: a bitset over layout
+// handles, one bit per layout with a key for it. Characters typed on the
+// same set of layouts (most letters of a script) share one row. Layouts are
+// also grouped by the set of scripts of their letters, so whole groups can
+// be left out of a query.
+class LayoutIndex {
+public:
+    // Build from `layouts` (indexed by LayoutHandle; null entries are not
+    // loaded) and the script set of each layout's letters
+    void build(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts,
+               const std::vector<unsigned>& scripts);
+
+    // 64-bit words of a layout bitset
+    size_t words() const { return words_; }
+
+    // Layouts loaded when built
+    size_t layout_count() const { return layout_count_; }
+
+    // Set in `mask` the layouts of every script set `keep(scripts)` accepts
+    template <typename Keep>
+    void select_scripts(Keep&& keep, uint64_t* mask) const {
+        for (size_t group = 0; group < group_scripts_.size(); ++group) {
+            if (!keep(group_scripts_[group])) continue;
+            const uint64_t* bits = group_bits_.data() + group * words_;
+            for (size_t word = 0; word < words_; ++word) {
+                mask[word] |= bits[word];
+            }
+        }
+    }
+
+    // Add `weight` to totals[handle] of every layout in `mask` with a key
+    // for `c`, and set their bits in `hit`. Costs one word read per 64
+    // layouts plus one add per layout found.
+    template <typename T>
+    void add_to_layouts_with(char32_t c, T weight, const uint64_t* mask, T* totals, uint64_t* hit) const {
+        const uint64_t* row = bits_.data() + rows_.get(c) * words_;
+        for (size_t word = 0; word < words_; ++word) {
+            uint64_t found = row[word] & mask[word];
+            hit[word] |= found;
+            for (uint64_t bits = found; bits; bits &= bits - 1) {
+                totals[word * 64 + lowest_bit(bits)] += weight;
+            }
+        }
+    }
+
+    // Call `visit(handle)` for every layout set in `set`, in handle order
+    template <typename Visit>
+    void for_each(const uint64_t* set, Visit&& visit) const {
+        for (size_t word = 0; word < words_; ++word) {
+            for (uint64_t bits = set[word]; bits; bits &= bits - 1) {
+                visit(word * 64 + lowest_bit(bits));
+            }
+        }
+    }
+
+    size_t row_count() const { return words_ ? bits_.size() / words_ : 0; }
+
+private:
+    static unsigned lowest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+        unsigned bit = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    size_t words_ = 0;                      // 64-bit words per row
+    size_t layout_count_ = 0;
+    utf8::CodepointTable<uint32_t> rows_;   // Codepoint -> row (0 = the empty row)
+    std::vector<uint64_t> bits_;            // [row * words_ + handle / 64]
+    std::vector<unsigned> group_scripts_;   // Script set of each group
+    std::vector<uint64_t> group_bits_;      // [group * words_ + handle / 64]
+};
+
+} // namespace layout_converter
+
+#endif // LAYOUT_INDEX_H
@@ -0,0 +1,158 @@
+// Layout Pack Implementation
+
+#include "../include/layout_pack.h"
+#include "mapped_file.h"
+#include <cstring>
+#include <fstream>
+
+namespace layout_converter {
+namespace LayoutPack {
+
+uint32_t checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+namespace {
+
+class StringTableBuilder {
+public:
+    uint32_t add(const std::string& s) {
+        uint32_t offset = static_cast<uint32_t>(table_.size());
+        table_.append(s);
+        table_.push_back('\0');
+        return offset;
+    }
+    
+    const std::string& data() const { return table_; }
+
+private:
+    std::string table_;
+};
+
+// NUL-terminated string at `offset`, or false if it runs off the table
+bool read_string(const char* table, size_t table_size, uint32_t offset, std::string& out) {
+    if (offset >= table_size) {
+        return false;
+    }
+    const void* terminator = std::memchr(table + offset, '\0', table_size - offset);
+    if (!terminator) {
+        return false;
+    }
+    out.assign(table + offset, static_cast<const char*>(terminator));
+    return true;
+}
+
+} // namespace
+
+bool write(const std::string& path, const std::vector<ConstEntry>& layouts) {
+    StringTableBuilder strings;
+    std::vector<Record> records(layouts.size());
+    
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        const LayoutDefinition& layout = *layouts[i].second;
+        Record& record = records[i];
+        std::memset(&record, 0, sizeof(record));
+        record.frequency_score = layout.frequency_score;
+        record.layout_id = strings.add(layouts[i].first);
+        record.display_id = strings.add(layout.id);
+        record.name = strings.add(layout.name);
+        record.language = strings.add(layout.language);
+        record.family_id = layout.family_id;
+        record.layout_number = layout.layout_id;
+        record.common_word_count = static_cast<uint32_t>(layout.common_words.size());
+        record.common_words = static_cast<uint32_t>(strings.data().size());
+        for (const auto& word : layout.common_words) {
+            strings.add(word);
+        }
+        std::memcpy(record.keys, layout.key_to_char.data(), sizeof(record.keys));
+    }
+    
+    std::string body(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    body += strings.data();
+    
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.layout_count = static_cast<uint32_t>(records.size());
+    header.key_slots = KeyID::MAX_KEY_POSITION + 1;
+    header.records_offset = sizeof(Header);
+    header.string_table_offset = static_cast<uint32_t>(sizeof(Header) + records.size() * sizeof(Record));
+    header.string_table_size = static_cast<uint32_t>(strings.data().size());
+    header.checksum = checksum(body.data(), body.size());
+    
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(body.data(), static_cast<std::streamsize>(body.size()));
+    return static_cast<bool>(file.flush());
+}
+
+bool read(const std::string& path, std::vector<Entry>& layouts) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(Header)) {
+        return false;
+    }
+    const char* data = file.data();
+    
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.key_slots != KeyID::MAX_KEY_POSITION + 1 || header.records_offset != sizeof(Header)) {
+        return false;
+    }
+    
+    size_t records_end = sizeof(Header) + static_cast<size_t>(header.layout_count) * sizeof(Record);
+    if (header.string_table_offset != records_end ||
+        records_end + header.string_table_size != file.size() ||
+        checksum(data + sizeof(Header), file.size() - sizeof(Header)) != header.checksum) {
+        return false;
+    }
+    
+    const char* table = data + header.string_table_offset;
+    size_t table_size = header.string_table_size;
+    std::vector<Entry> loaded;
+    loaded.reserve(header.layout_count);
+    
+    for (uint32_t i = 0; i < header.layout_count; ++i) {
+        Record record;
+        std::memcpy(&record, data + sizeof(Header) + i * sizeof(Record), sizeof(Record));
+        
+        auto layout = std::make_shared<LayoutDefinition>();
+        std::string layout_id;
+        if (!read_string(table, table_size, record.layout_id, layout_id) ||
+            !read_string(table, table_size, record.display_id, layout->id) ||
+            !read_string(table, table_size, record.name, layout->name) ||
+            !read_string(table, table_size, record.language, layout->language)) {
+            return false;
+        }
+        layout->family_id = record.family_id;
+        layout->layout_id = record.layout_number;
+        layout->frequency_score = record.frequency_score;
+        
+        uint32_t offset = record.common_words;
+        layout->common_words.resize(record.common_word_count);
+        for (auto& word : layout->common_words) {
+            if (!read_string(table, table_size, offset, word)) {
+                return false;
+            }
+            offset += static_cast<uint32_t>(word.size() + 1);
+        }
+        
+        for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+            if (record.keys[position]) {
+                layout->set_key(position, record.keys[position]);
+            }
+        }
+        loaded.emplace_back(std::move(layout_id), std::move(layout));
+    }
+    
+    layouts = std::move(loaded);
+    return true;
+}
+
+} // namespace LayoutPack
+} // namespace layout_converter
@@ -0,0 +1,39 @@
+// Mapped File
+// Read-only memory mapping of a whole file, with a buffered fallback
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace layout_converter {
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    
+    // Map `path` read-only. Returns false if the file cannot be opened.
+    bool open(const std::string& path);
+    void close();
+    
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> buffer_;  // Used where mmap is unavailable
+};
+
+} // namespace layout_converter
+
+#endif // MAPPED_FILE_H
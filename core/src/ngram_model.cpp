@@ -0,0 +1,262 @@
+// N-gram Model Implementation
+// Parallel n-gram counting over corpus chunks, linear quantization of the
+// log tables, and validation of mapped model files
+
+#include "../include/ngram_model.h"
+#include "../include/layout_pack.h"
+#include "detection_engine.h"
+#include "mapped_file.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <string_view>
+
+namespace layout_converter {
+
+namespace {
+
+// Corpora are cut at whitespace into chunks of about this size, the unit
+// of work of the counting threads
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+size_t padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+size_t table_bytes(size_t count, unsigned bits) {
+    return (count * bits + 7) / 8;
+}
+
+bool valid_bits(unsigned bits) {
+    return bits == 4 || bits == 8 || bits == 16 || bits == 32;
+}
+
+// Append `values` quantized to `bits` bits, padded to 8 bytes; returns the
+// quantization to decode them with
+NgramModel::Quantization quantize(const std::vector<float>& values, unsigned bits, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + padded(table_bytes(values.size(), bits)), '\0');
+    auto* codes = reinterpret_cast<unsigned char*>(&out[start]);
+    if (bits == 32) {
+        std::memcpy(codes, values.data(), values.size() * sizeof(float));
+        return {0.0f, 1.0f};
+    }
+
+    auto [low, high] = std::minmax_element(values.begin(), values.end());
+    const uint32_t levels = (uint32_t(1) << bits) - 1;
+    NgramModel::Quantization quantization{*low, *high > *low ? (*high - *low) / levels : 1.0f};
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto code = static_cast<uint32_t>(std::lround((values[i] - quantization.offset) / quantization.scale));
+        code = std::min(code, levels);
+        if (bits == 4) {
+            codes[i / 2] |= static_cast<unsigned char>(code << (i % 2 * 4));
+        } else if (bits == 8) {
+            codes[i] = static_cast<unsigned char>(code);
+        } else {
+            auto code16 = static_cast<uint16_t>(code);
+            std::memcpy(codes + i * 2, &code16, sizeof(code16));
+        }
+    }
+    return quantization;
+}
+
+// Split a corpus into chunks that end after an ASCII whitespace byte,
+// which never occurs inside a UTF-8 sequence
+void add_chunks(const MappedFile& file, std::vector<std::string_view>& chunks) {
+    const char* p = file.data();
+    const char* end = p + file.size();
+    while (p < end) {
+        const char* cut = end - p > static_cast<std::ptrdiff_t>(CHUNK_SIZE) ? p + CHUNK_SIZE : end;
+        while (cut < end && static_cast<unsigned char>(cut[-1]) > 0x20) ++cut;
+        chunks.emplace_back(p, static_cast<size_t>(cut - p));
+        p = cut;
+    }
+}
+
+} // namespace
+
+class NgramModel::Impl {
+public:
+    MappedFile file;
+    std::string language;
+    std::vector<char32_t> alphabet;
+    unsigned symbol_count = 1;
+    unsigned bits = 32;
+    unsigned trigram_bits = 0;
+    Table bigram;
+    Table trigram_context;
+    Table trigram;
+};
+
+NgramModel::NgramModel() : pImpl(std::make_unique<Impl>()) {}
+NgramModel::~NgramModel() = default;
+
+bool NgramModel::train(const std::string& path, const std::string& language,
+                       const std::vector<std::string>& corpus_paths, const NgramTrainOptions& options) {
+    if (!valid_bits(options.bits) || options.trigram_bits < MIN_TRIGRAM_BITS ||
+        options.trigram_bits > MAX_TRIGRAM_BITS) {
+        return false;
+    }
+    std::vector<MappedFile> corpora(corpus_paths.size());
+    std::vector<std::string_view> chunks;
+    for (size_t i = 0; i < corpus_paths.size(); ++i) {
+        if (!corpora[i].open(corpus_paths[i])) {
+            return false;
+        }
+        add_chunks(corpora[i], chunks);
+    }
+
+    // Each worker takes chunks until none are left, counting into its own
+    // tables. Counts are whole numbers, so the merged totals do not depend
+    // on how the chunks were shared out.
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(resolve_thread_count(options.threads),
+                                                              std::max<size_t>(chunks.size(), 1)));
+    auto for_each_chunk = [&](auto&& count) {
+        std::atomic<size_t> next{0};
+        parallel_for(workers, workers, [&](size_t worker) {
+            for (size_t i = next++; i < chunks.size(); i = next++) {
+                count(worker, chunks[i]);
+            }
+        });
+    };
+
+    // Pass 1: the alphabet is the most frequent letters, in codepoint order
+    std::vector<std::unordered_map<char32_t, uint64_t>> letter_counts(workers);
+    for_each_chunk([&](size_t worker, std::string_view chunk) {
+        LanguageModelBuilder::count_letters(chunk, letter_counts[worker]);
+    });
+    for (size_t worker = 1; worker < workers; ++worker) {
+        for (const auto& [letter, count] : letter_counts[worker]) {
+            letter_counts[0][letter] += count;
+        }
+    }
+    std::vector<std::pair<char32_t, uint64_t>> letters(letter_counts[0].begin(), letter_counts[0].end());
+    std::sort(letters.begin(), letters.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    letters.resize(std::min<size_t>(letters.size(), MAX_SYMBOLS - 1));
+    std::sort(letters.begin(), letters.end());
+
+    // Pass 2: n-gram counts over that alphabet
+    LanguageModelBuilder alphabet(options.trigram_bits);
+    for (const auto& letter : letters) {
+        alphabet.add_letter(letter.first);
+    }
+    std::vector<LanguageModelBuilder> builders(workers, alphabet);
+    for_each_chunk([&](size_t worker, std::string_view chunk) {
+        builders[worker].add_text(chunk);
+    });
+    for (size_t worker = 1; worker < workers; ++worker) {
+        builders[0].merge(builders[worker]);
+    }
+    LanguageModel model = builders[0].finish();
+
+    Header header{};
+    std::string body = language;
+    body.resize(padded(language.size()), '\0');
+    for (const auto& letter : letters) {
+        auto codepoint = static_cast<uint32_t>(letter.first);
+        body.append(reinterpret_cast<const char*>(&codepoint), sizeof(codepoint));
+    }
+    body.resize(padded(body.size()), '\0');
+    header.bigram = quantize(model.bigram, options.bits, body);
+    header.trigram_context = quantize(model.trigram_context, options.bits, body);
+    header.trigram = quantize(model.trigram, options.bits, body);
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.language_size = static_cast<uint32_t>(language.size());
+    header.symbol_count = model.symbol_count;
+    header.bits = options.bits;
+    header.trigram_bits = options.trigram_bits;
+    header.checksum = LayoutPack::checksum(body.data(), body.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(body.data(), static_cast<std::streamsize>(body.size()));
+    return static_cast<bool>(file.flush());
+}
+
+std::shared_ptr<const NgramModel> NgramModel::open(const std::string& path) {
+    std::shared_ptr<NgramModel> model(new NgramModel);
+    Impl& impl = *model->pImpl;
+    if (!impl.file.open(path) || impl.file.size() < sizeof(Header)) {
+        return nullptr;
+    }
+    const char* data = impl.file.data();
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        !valid_bits(header.bits) || header.symbol_count == 0 || header.symbol_count > MAX_SYMBOLS ||
+        header.trigram_bits < MIN_TRIGRAM_BITS || header.trigram_bits > MAX_TRIGRAM_BITS) {
+        return nullptr;
+    }
+    size_t square = size_t(header.symbol_count) * header.symbol_count;
+    size_t alphabet_offset = sizeof(Header) + padded(header.language_size);
+    size_t bigram_offset = alphabet_offset + padded((header.symbol_count - 1) * sizeof(uint32_t));
+    size_t context_offset = bigram_offset + padded(table_bytes(square, header.bits));
+    size_t trigram_offset = context_offset + padded(table_bytes(square, header.bits));
+    size_t end = trigram_offset + padded(table_bytes(size_t(1) << header.trigram_bits, header.bits));
+    if (end != impl.file.size() ||
+        LayoutPack::checksum(data + sizeof(Header), impl.file.size() - sizeof(Header)) != header.checksum) {
+        return nullptr;
+    }
+
+    impl.language.assign(data + sizeof(Header), header.language_size);
+    for (uint32_t i = 0; i + 1 < header.symbol_count; ++i) {
+        uint32_t codepoint;
+        std::memcpy(&codepoint, data + alphabet_offset + i * sizeof(codepoint), sizeof(codepoint));
+        impl.alphabet.push_back(static_cast<char32_t>(codepoint));
+    }
+    impl.symbol_count = header.symbol_count;
+    impl.bits = header.bits;
+    impl.trigram_bits = header.trigram_bits;
+    auto table = [&](size_t offset, Quantization quantization) {
+        return Table{reinterpret_cast<const unsigned char*>(data + offset), header.bits, quantization};
+    };
+    impl.bigram = table(bigram_offset, header.bigram);
+    impl.trigram_context = table(context_offset, header.trigram_context);
+    impl.trigram = table(trigram_offset, header.trigram);
+    return model;
+}
+
+const std::string& NgramModel::language() const {
+    return pImpl->language;
+}
+
+const std::vector<char32_t>& NgramModel::alphabet() const {
+    return pImpl->alphabet;
+}
+
+unsigned NgramModel::symbol_count() const {
+    return pImpl->symbol_count;
+}
+
+unsigned NgramModel::bits() const {
+    return pImpl->bits;
+}
+
+unsigned NgramModel::trigram_bits() const {
+    return pImpl->trigram_bits;
+}
+
+size_t NgramModel::size_bytes() const {
+    return pImpl->file.size();
+}
+
+const NgramModel::Table& NgramModel::bigram() const {
+    return pImpl->bigram;
+}
+
+const NgramModel::Table& NgramModel::trigram_context() const {
+    return pImpl->trigram_context;
+}
+
+const NgramModel::Table& NgramModel::trigram() const {
+    return pImpl->trigram;
+}
+
+} // namespace layout_converter
@@ -0,0 +1,45 @@
+// Parallel For
+// Minimal fork-join loop shared by the bulk conversion and detection paths
+
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace layout_converter {
+
+// Worker count for a `threads` argument where 0 means hardware concurrency
+inline unsigned resolve_thread_count(unsigned threads) {
+    return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run `work(index)` for every index in [0, count) on up to `threads` workers.
+// The calling thread is one of them.
+template <typename Work>
+void parallel_for(size_t count, unsigned threads, Work work) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+    
+    unsigned extra = count ? static_cast<unsigned>(std::min<size_t>(std::max(threads, 1u), count)) - 1 : 0;
+    std::vector<std::thread> pool;
+    pool.reserve(extra);
+    for (unsigned t = 0; t < extra; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+} // namespace layout_converter
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,168 @@
+// Script Classifier Implementation
+// Byte-range tests on lead bytes, counted with movemask and popcount
+
+#include "script_classifier.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAYOUT_CONVERTER_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace layout_converter {
+namespace Scripts {
+
+namespace {
+
+// Script of the character starting with lead byte `lead` (>= 0xC0);
+// `next` is the byte after it, or 0 at the end of the text
+int lead_script(unsigned char lead, unsigned char next) {
+    if (lead >= 0xC3 && lead <= 0xC9) return KeyID::FAMILY_LATIN;
+    if (lead >= 0xD0 && lead <= 0xD3) return KeyID::FAMILY_CYRILLIC;
+    if (lead >= 0xD8 && lead <= 0xDB) return KeyID::FAMILY_ARABIC;
+    if (lead == 0xE0 && (next == 0xA4 || next == 0xA5)) return KeyID::FAMILY_HINDI;
+    if (lead >= 0xE4 && lead <= 0xE9) return KeyID::FAMILY_CHINESE;
+    return OTHER;
+}
+
+void count_scalar(const unsigned char* s, size_t size, Counts& counts) {
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char b = s[i];
+        if (b < 0x80) {
+            if (static_cast<unsigned char>((b | 0x20) - 'a') < 26) ++counts[KeyID::FAMILY_LATIN];
+        } else if (b >= 0xC0) {
+            ++counts[lead_script(b, i + 1 < size ? s[i + 1] : 0)];
+        }
+    }
+}
+
+// Per-script totals of one vector pass; every non-ASCII lead byte is in
+// `leads`, so whatever no script claimed is OTHER
+struct LeadTotals {
+    uint32_t ascii_letters = 0;
+    uint32_t leads = 0;
+    std::array<uint32_t, SCRIPT_COUNT> scripts{};
+
+    void add_to(Counts& counts) const {
+        uint32_t claimed = 0;
+        for (size_t script = 1; script < SCRIPT_COUNT; ++script) {
+            counts[script] += scripts[script];
+            claimed += scripts[script];
+        }
+        counts[KeyID::FAMILY_LATIN] += ascii_letters;
+        counts[OTHER] += leads - claimed;
+    }
+};
+
+#ifdef LAYOUT_CONVERTER_X86_SIMD
+
+// Each step also loads the block shifted by one byte, so the Devanagari
+// test sees the byte after an E0 lead; the scalar loop finishes the last
+// block. in_range is an unsigned compare: (v - low) <= (high - low).
+
+__attribute__((target("avx2")))
+inline unsigned in_range_avx2(__m256i v, unsigned char low, unsigned char high) {
+    __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(static_cast<char>(low)));
+    __m256i limit = _mm256_set1_epi8(static_cast<char>(high - low));
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(offset, limit), offset)));
+}
+
+__attribute__((target("avx2,popcnt")))
+void count_avx2(const unsigned char* s, size_t size, Counts& counts) {
+    LeadTotals totals;
+    auto& scripts = totals.scripts;
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 33 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        totals.ascii_letters += __builtin_popcount(in_range_avx2(_mm256_or_si256(v, case_bit), 'a', 'z'));
+        if (_mm256_movemask_epi8(v) == 0) {
+            continue;  // ASCII block
+        }
+
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + 1));
+        totals.leads += __builtin_popcount(in_range_avx2(v, 0xC0, 0xFF));
+        scripts[KeyID::FAMILY_LATIN] += __builtin_popcount(in_range_avx2(v, 0xC3, 0xC9));
+        scripts[KeyID::FAMILY_CYRILLIC] += __builtin_popcount(in_range_avx2(v, 0xD0, 0xD3));
+        scripts[KeyID::FAMILY_ARABIC] += __builtin_popcount(in_range_avx2(v, 0xD8, 0xDB));
+        scripts[KeyID::FAMILY_HINDI] += __builtin_popcount(in_range_avx2(v, 0xE0, 0xE0) &
+                                                           in_range_avx2(next, 0xA4, 0xA5));
+        scripts[KeyID::FAMILY_CHINESE] += __builtin_popcount(in_range_avx2(v, 0xE4, 0xE9));
+    }
+    totals.add_to(counts);
+    count_scalar(s + i, size - i, counts);
+}
+
+__attribute__((target("sse2")))
+inline unsigned in_range_sse2(__m128i v, unsigned char low, unsigned char high) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(static_cast<char>(low)));
+    __m128i limit = _mm_set1_epi8(static_cast<char>(high - low));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(offset, limit), offset)));
+}
+
+__attribute__((target("sse2")))
+void count_sse2(const unsigned char* s, size_t size, Counts& counts) {
+    LeadTotals totals;
+    auto& scripts = totals.scripts;
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 17 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        totals.ascii_letters += __builtin_popcount(in_range_sse2(_mm_or_si128(v, case_bit), 'a', 'z'));
+        if (_mm_movemask_epi8(v) == 0) {
+            continue;  // ASCII block
+        }
+
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 1));
+        totals.leads += __builtin_popcount(in_range_sse2(v, 0xC0, 0xFF));
+        scripts[KeyID::FAMILY_LATIN] += __builtin_popcount(in_range_sse2(v, 0xC3, 0xC9));
+        scripts[KeyID::FAMILY_CYRILLIC] += __builtin_popcount(in_range_sse2(v, 0xD0, 0xD3));
+        scripts[KeyID::FAMILY_ARABIC] += __builtin_popcount(in_range_sse2(v, 0xD8, 0xDB));
+        scripts[KeyID::FAMILY_HINDI] += __builtin_popcount(in_range_sse2(v, 0xE0, 0xE0) &
+                                                           in_range_sse2(next, 0xA4, 0xA5));
+        scripts[KeyID::FAMILY_CHINESE] += __builtin_popcount(in_range_sse2(v, 0xE4, 0xE9));
+    }
+    totals.add_to(counts);
+    count_scalar(s + i, size - i, counts);
+}
+
+#endif // LAYOUT_CONVERTER_X86_SIMD
+
+struct Kernel {
+    void (*count)(const unsigned char*, size_t, Counts&);
+    const char* name;
+};
+
+Kernel select_kernel() {
+#ifdef LAYOUT_CONVERTER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return {count_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {count_sse2, "sse2"};
+    }
+#endif
+    return {count_scalar, "scalar"};
+}
+
+const Kernel& kernel() {
+    static const Kernel selected = select_kernel();
+    return selected;
+}
+
+} // namespace
+
+Counts count(const char* data, size_t size) {
+    Counts counts{};
+    kernel().count(reinterpret_cast<const unsigned char*>(data), size, counts);
+    return counts;
+}
+
+const char* active_kernel_name() {
+    return kernel().name;
+}
+
+} // namespace Scripts
+} // namespace layout_converter
@@ -0,0 +1,48 @@
+// Script Classifier
+// Counts the characters of a UTF-8 text by script in one vectorized pass
+
+#ifndef SCRIPT_CLASSIFIER_H
+#define SCRIPT_CLASSIFIER_H
+
+#include "../include/key_system.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace layout_converter {
+namespace Scripts {
+
+// Scripts are indexed like the KeyID::FAMILY_* constants; index 0 holds
+// every other non-ASCII character
+constexpr int OTHER = 0;
+constexpr size_t SCRIPT_COUNT = KeyID::FAMILY_CHINESE + 1;
+
+using Counts = std::array<uint32_t, SCRIPT_COUNT>;
+
+// Script of a letter. The ranges are exactly those of the UTF-8 lead bytes
+// count() looks at, so a letter is always counted under its own script:
+// Latin U+00C0-U+027F (leads C3-C9), Cyrillic U+0400-U+04FF (D0-D3), Arabic
+// U+0600-U+06FF (D8-DB), Devanagari U+0900-U+097F (E0 A4-A5) and CJK
+// U+4000-U+9FFF (E4-E9).
+constexpr int script_of(char32_t c) {
+    if (c < 0x80) return KeyID::FAMILY_LATIN;
+    if (c >= 0xC0 && c <= 0x27F) return KeyID::FAMILY_LATIN;
+    if (c >= 0x400 && c <= 0x4FF) return KeyID::FAMILY_CYRILLIC;
+    if (c >= 0x600 && c <= 0x6FF) return KeyID::FAMILY_ARABIC;
+    if (c >= 0x900 && c <= 0x97F) return KeyID::FAMILY_HINDI;
+    if (c >= 0x4000 && c <= 0x9FFF) return KeyID::FAMILY_CHINESE;
+    return OTHER;
+}
+
+// ASCII letters and non-ASCII characters of `data` by script. Only lead
+// bytes are looked at, so malformed input can only add to the counts.
+// Runs 32 bytes per step with AVX2 or 16 with SSE2, picked at runtime.
+Counts count(const char* data, size_t size);
+
+// Name of the kernel selected for this CPU ("avx2", "sse2" or "scalar")
+const char* active_kernel_name();
+
+} // namespace Scripts
+} // namespace layout_converter
+
+#endif // SCRIPT_CLASSIFIER_H
@@ -0,0 +1,170 @@
+// SIMD Conversion Kernels Implementation
+// pshufb nibble-table translation with runtime CPU dispatch
+
+#include "simd_convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAYOUT_CONVERTER_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace layout_converter {
+namespace simd {
+
+namespace {
+
+void translate_scalar(const unsigned char* table, const char* in, char* out, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = static_cast<char>(table[static_cast<unsigned char>(in[i])]);
+    }
+}
+
+size_t ascii_prefix_scalar(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size && static_cast<unsigned char>(data[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef LAYOUT_CONVERTER_X86_SIMD
+
+// The ASCII half of the table is 8 rows of 16 entries indexed by the high
+// nibble; each row is one pshufb lookup keyed by the low nibble.
+
+__attribute__((target("ssse3")))
+void translate_ssse3(const unsigned char* table, const char* in, char* out, size_t size) {
+    __m128i rows[8];
+    __m128i row_ids[8];
+    for (int h = 0; h < 8; ++h) {
+        rows[h] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + h * 16));
+        row_ids[h] = _mm_set1_epi8(static_cast<char>(h));
+    }
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            translate_scalar(table, in + i, out + i, 16);  // Non-ASCII in block
+            continue;
+        }
+
+        __m128i lo = _mm_and_si128(v, nibble_mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask);
+        __m128i result = _mm_setzero_si128();
+        for (int h = 0; h < 8; ++h) {
+            __m128i looked_up = _mm_shuffle_epi8(rows[h], lo);
+            __m128i in_row = _mm_cmpeq_epi8(hi, row_ids[h]);
+            result = _mm_or_si128(result, _mm_and_si128(looked_up, in_row));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    translate_scalar(table, in + i, out + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void translate_avx2(const unsigned char* table, const char* in, char* out, size_t size) {
+    __m256i rows[8];
+    __m256i row_ids[8];
+    for (int h = 0; h < 8; ++h) {
+        rows[h] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + h * 16)));
+        row_ids[h] = _mm256_set1_epi8(static_cast<char>(h));
+    }
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        if (_mm256_movemask_epi8(v) != 0) {
+            translate_scalar(table, in + i, out + i, 32);  // Non-ASCII in block
+            continue;
+        }
+
+        __m256i lo = _mm256_and_si256(v, nibble_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask);
+        __m256i result = _mm256_setzero_si256();
+        for (int h = 0; h < 8; ++h) {
+            __m256i looked_up = _mm256_shuffle_epi8(rows[h], lo);
+            __m256i in_row = _mm256_cmpeq_epi8(hi, row_ids[h]);
+            result = _mm256_or_si256(result, _mm256_and_si256(looked_up, in_row));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    translate_scalar(table, in + i, out + i, size - i);
+}
+
+__attribute__((target("avx2")))
+size_t ascii_prefix_avx2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(v));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return i + ascii_prefix_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+size_t ascii_prefix_sse2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(v));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return i + ascii_prefix_scalar(data + i, size - i);
+}
+
+#endif // LAYOUT_CONVERTER_X86_SIMD
+
+struct Kernels {
+    void (*translate)(const unsigned char*, const char*, char*, size_t);
+    size_t (*ascii_prefix)(const char*, size_t);
+    const char* name;
+};
+
+Kernels select_kernels() {
+#ifdef LAYOUT_CONVERTER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {translate_avx2, ascii_prefix_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {translate_ssse3, ascii_prefix_sse2, "ssse3"};
+    }
+#endif
+    return {translate_scalar, ascii_prefix_scalar, "scalar"};
+}
+
+const Kernels& kernels() {
+    static const Kernels selected = select_kernels();
+    return selected;
+}
+
+} // namespace
+
+void translate_bytes(const unsigned char* table, const char* in, char* out, size_t size) {
+    // Short inputs are not worth the table setup
+    if (size < 16) {
+        translate_scalar(table, in, out, size);
+        return;
+    }
+    kernels().translate(table, in, out, size);
+}
+
+size_t ascii_prefix_length(const char* data, size_t size) {
+    return kernels().ascii_prefix(data, size);
+}
+
+const char* active_kernel_name() {
+    return kernels().name;
+}
+
+} // namespace simd
+} // namespace layout_converter
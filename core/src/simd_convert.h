@@ -0,0 +1,27 @@
+// SIMD Conversion Kernels
+// Vectorized byte-table translation used by ConversionPlan
+
+#ifndef SIMD_CONVERT_H
+#define SIMD_CONVERT_H
+
+#include <cstddef>
+
+namespace layout_converter {
+namespace simd {
+
+// Translate `size` bytes from `in` to `out` through a 256-entry table.
+// ASCII blocks go through a pshufb nibble lookup (AVX2 or SSSE3, picked at
+// runtime); blocks containing bytes >= 0x80 fall back to scalar loads.
+// `in` and `out` may alias exactly.
+void translate_bytes(const unsigned char* table, const char* in, char* out, size_t size);
+
+// Length of the leading run of ASCII bytes in `data`
+size_t ascii_prefix_length(const char* data, size_t size);
+
+// Name of the kernel selected for this CPU ("avx2", "ssse3" or "scalar")
+const char* active_kernel_name();
+
+} // namespace simd
+} // namespace layout_converter
+
+#endif // SIMD_CONVERT_H
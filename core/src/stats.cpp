@@ -0,0 +1,187 @@
+// Library Statistics Implementation
+// Each thread writes its own shard with plain relaxed stores, so recording
+// never contends; a snapshot sums the shards
+
+#include "stats_recorder.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+namespace layout_converter {
+
+namespace Stats {
+
+namespace {
+
+struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::array<std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS>, OPERATION_COUNT> buckets{};
+    std::array<std::atomic<uint64_t>, OPERATION_COUNT> total_ns{};
+    std::atomic<bool> in_use{false};
+    Shard* next = nullptr;
+};
+
+// Shards are never freed; a thread that exits hands its shard, totals
+// included, to the next thread that needs one
+std::atomic<Shard*> shards{nullptr};
+
+std::mutex baseline_mutex;
+Snapshot baseline;  // Totals at the last reset()
+
+Shard* acquire_shard() {
+    for (Shard* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+        bool expected = false;
+        if (!shard->in_use.load(std::memory_order_relaxed) &&
+            shard->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return shard;
+        }
+    }
+
+    auto* shard = new Shard;
+    shard->in_use.store(true, std::memory_order_relaxed);
+    Shard* head = shards.load(std::memory_order_relaxed);
+    do {
+        shard->next = head;
+    } while (!shards.compare_exchange_weak(head, shard, std::memory_order_release, std::memory_order_relaxed));
+    return shard;
+}
+
+struct ThreadShard {
+    Shard* shard = acquire_shard();
+
+    ~ThreadShard() {
+        shard->in_use.store(false, std::memory_order_release);
+    }
+};
+
+Shard& local_shard() {
+    thread_local ThreadShard thread_shard;
+    return *thread_shard.shard;
+}
+
+// Only the owning thread writes a shard, so a load and a store suffice
+void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+size_t bucket_for(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (nanoseconds >>= 1) ++bucket;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+Snapshot totals() {
+    Snapshot result;
+#ifdef LAYOUT_CONVERTER_STATS
+    result.enabled = true;
+#endif
+    for (Shard* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+        for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+            result.counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+        }
+        for (size_t o = 0; o < OPERATION_COUNT; ++o) {
+            Histogram& histogram = result.latency[o];
+            for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+                uint64_t count = shard->buckets[o][b].load(std::memory_order_relaxed);
+                histogram.buckets[b] += count;
+                histogram.count += count;
+            }
+            histogram.total_ns += shard->total_ns[o].load(std::memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+uint64_t Histogram::quantile_ns(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Nearest rank: the smallest value with at least `quantile` of the samples at or below it
+    double position = std::ceil(quantile * static_cast<double>(count));
+    uint64_t rank = position > 1.0 ? static_cast<uint64_t>(position) - 1 : 0;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return (uint64_t(1) << (b + 1)) - 1;
+        }
+    }
+    return UINT64_MAX;
+}
+
+void add(Counter counter, uint64_t amount) {
+    bump(local_shard().counters[static_cast<size_t>(counter)], amount);
+}
+
+void record_latency(Operation operation, uint64_t nanoseconds) {
+    Shard& shard = local_shard();
+    size_t o = static_cast<size_t>(operation);
+    bump(shard.buckets[o][bucket_for(nanoseconds)], 1);
+    bump(shard.total_ns[o], nanoseconds);
+}
+
+bool enabled() {
+#ifdef LAYOUT_CONVERTER_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Snapshot snapshot() {
+    Snapshot result = totals();
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+    for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+        result.counters[c] -= baseline.counters[c];
+    }
+    for (size_t o = 0; o < OPERATION_COUNT; ++o) {
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+            result.latency[o].buckets[b] -= baseline.latency[o].buckets[b];
+        }
+        result.latency[o].count -= baseline.latency[o].count;
+        result.latency[o].total_ns -= baseline.latency[o].total_ns;
+    }
+    return result;
+}
+
+void reset() {
+    Snapshot current = totals();
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+    baseline = current;
+}
+
+const char* counter_name(Counter counter) {
+    switch (counter) {
+        case Counter::CONVERT_CALLS: return "convert_calls";
+        case Counter::CONVERT_BYTES_IN: return "convert_bytes_in";
+        case Counter::CONVERT_BYTES_OUT: return "convert_bytes_out";
+        case Counter::PASSTHROUGH_CHARACTERS: return "passthrough_characters";
+        case Counter::PLAN_CACHE_HITS: return "plan_cache_hits";
+        case Counter::PLAN_CACHE_MISSES: return "plan_cache_misses";
+        case Counter::DETECT_CALLS: return "detect_calls";
+        case Counter::DETECT_BYTES: return "detect_bytes";
+        case Counter::SOURCES_PRUNED: return "sources_pruned";
+        case Counter::HYPOTHESES_SCORED: return "hypotheses_scored";
+        case Counter::HYPOTHESES_RESCORED: return "hypotheses_rescored";
+        case Counter::LAYOUTS_LOADED: return "layouts_loaded";
+        case Counter::LAYOUT_LOAD_FAILURES: return "layout_load_failures";
+        case Counter::COUNT: break;
+    }
+    return "unknown";
+}
+
+const char* operation_name(Operation operation) {
+    switch (operation) {
+        case Operation::CONVERT: return "convert";
+        case Operation::DETECT: return "detect";
+        case Operation::LOAD_LAYOUT: return "load_layout";
+        case Operation::COUNT: break;
+    }
+    return "unknown";
+}
+
+} // namespace Stats
+
+} // namespace layout_converter
@@ -0,0 +1,59 @@
+// Statistics Recorder
+// Recording side of stats.h. Every macro expands to nothing unless the
+// library is built with LAYOUT_CONVERTER_STATS, so call sites cost nothing
+// in a normal build.
+
+#ifndef STATS_RECORDER_H
+#define STATS_RECORDER_H
+
+#include "../include/stats.h"
+#include <chrono>
+
+namespace layout_converter {
+
+namespace Stats {
+    // Add to a counter of the calling thread's shard
+    void add(Counter counter, uint64_t amount);
+    
+    void record_latency(Operation operation, uint64_t nanoseconds);
+    
+    // Records the lifetime of the object as one operation's latency
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Operation operation)
+            : operation_(operation), start_(std::chrono::steady_clock::now()) {}
+        
+        ~ScopedTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            record_latency(operation_, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+        
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    
+    private:
+        Operation operation_;
+        std::chrono::steady_clock::time_point start_;
+    };
+}
+
+} // namespace layout_converter
+
+#ifdef LAYOUT_CONVERTER_STATS
+#define LC_STATS_CONCAT_(a, b) a##b
+#define LC_STATS_CONCAT(a, b) LC_STATS_CONCAT_(a, b)
+#define LC_STATS_ADD(counter, amount) \
+    ::layout_converter::Stats::add(::layout_converter::Stats::Counter::counter, (amount))
+#define LC_STATS_TIME(operation) \
+    ::layout_converter::Stats::ScopedTimer LC_STATS_CONCAT(stats_timer_, __LINE__)( \
+        ::layout_converter::Stats::Operation::operation)
+// Code only needed to compute a statistic
+#define LC_STATS_ONLY(...) __VA_ARGS__
+#else
+#define LC_STATS_ADD(counter, amount) ((void)0)
+#define LC_STATS_TIME(operation) ((void)0)
+#define LC_STATS_ONLY(...)
+#endif
+
+#endif // STATS_RECORDER_H
@@ -0,0 +1,61 @@
+// Stream Converter Implementation
+
+#include "../include/stream_converter.h"
+#include <istream>
+#include <ostream>
+
+namespace layout_converter {
+
+StreamConverter::StreamConverter(std::shared_ptr<const ConversionPlan> plan, size_t chunk_size)
+    : plan_(std::move(plan)), chunk_size_(chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE) {}
+
+void StreamConverter::feed(std::string_view input, std::string& out) {
+    // Complete a sequence held from the previous call first
+    while (!carry_.empty() && !input.empty()) {
+        carry_ += input.front();
+        input.remove_prefix(1);
+        if (utf8::complete_prefix_length(carry_.data(), carry_.size()) == carry_.size()) {
+            plan_->append_to(carry_, out);
+            carry_.clear();
+        }
+    }
+    
+    size_t complete = utf8::complete_prefix_length(input.data(), input.size());
+    plan_->append_to(input.substr(0, complete), out);
+    carry_.append(input.substr(complete));
+}
+
+void StreamConverter::finish(std::string& out) {
+    if (!carry_.empty()) {
+        plan_->append_to(carry_, out);
+        carry_.clear();
+    }
+}
+
+bool StreamConverter::convert(std::istream& in, std::ostream& out) {
+    std::vector<char> input(chunk_size_);
+    std::string output;
+    output.reserve(plan_->max_converted_size(chunk_size_ + carry_.size()));
+    
+    while (in) {
+        in.read(input.data(), static_cast<std::streamsize>(input.size()));
+        std::streamsize count = in.gcount();
+        if (count <= 0) break;
+        
+        output.clear();
+        feed(std::string_view(input.data(), static_cast<size_t>(count)), output);
+        if (!out.write(output.data(), static_cast<std::streamsize>(output.size()))) {
+            return false;
+        }
+    }
+    if (in.bad()) {
+        return false;
+    }
+    
+    output.clear();
+    finish(output);
+    out.write(output.data(), static_cast<std::streamsize>(output.size()));
+    return static_cast<bool>(out.flush());
+}
+
+} // namespace layout_converter
@@ -0,0 +1,311 @@
+// Word Dictionary Implementation
+// Incremental construction of the minimal automaton from sorted words
+// (Daciuk et al.), then a flat arc array that is used straight from the
+// mapping
+
+#include "../include/word_dictionary.h"
+#include "../include/layout_pack.h"
+#include "../include/utf8.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace layout_converter {
+
+namespace {
+
+constexpr uint32_t LABEL_MASK = 0xFF;
+constexpr uint32_t FINAL_ARC = 1u << 8;
+constexpr uint32_t LAST_ARC = 1u << 9;
+constexpr unsigned TARGET_SHIFT = 10;
+
+size_t padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// 64-bit FNV-1a; the Bloom filter derives all its probes from it
+uint64_t word_hash(std::string_view word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Probe i of a word is h1 + i * h2 (double hashing)
+template <typename Visit>
+void for_each_probe(std::string_view word, uint64_t bits, uint32_t hashes, Visit visit) {
+    uint64_t hash = word_hash(word);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < hashes; ++i) {
+        visit((h1 + i * h2) % bits);
+    }
+}
+
+// Lowercase UTF-8, or false for malformed input
+bool lowercase(const std::string& word, std::string& out) {
+    out.clear();
+    const char* p = word.data();
+    const char* end = p + word.size();
+    while (p < end) {
+        char32_t c;
+        p += utf8::decode(p, end, c);
+        if (c == utf8::INVALID_CODEPOINT) return false;
+        utf8::EncodedChar encoded = utf8::encode(utf8::to_lower(c));
+        out.append(encoded.bytes, encoded.length);
+    }
+    return true;
+}
+
+// Automaton under construction. States are only ever appended; states
+// replaced by an equivalent registered one are left unreachable.
+class AutomatonBuilder {
+public:
+    AutomatonBuilder() { states_.emplace_back(); }
+
+    // Words must come in sorted order
+    void add(const std::string& word) {
+        size_t common = 0;
+        while (common < word.size() && common < previous_.size() && word[common] == previous_[common]) {
+            ++common;
+        }
+        minimize(common);
+
+        path_.resize(common + 1);
+        for (size_t i = common; i < word.size(); ++i) {
+            uint32_t state = static_cast<uint32_t>(states_.size());
+            states_.emplace_back();
+            states_[path_[i]].arcs.push_back({static_cast<unsigned char>(word[i]), state});
+            path_.push_back(state);
+        }
+        states_[path_[word.size()]].final = true;
+        previous_ = word;
+    }
+
+    // Lay the reachable states out as arc runs. Returns false if there are
+    // more arcs than the target field can address.
+    bool finish(std::vector<uint32_t>& arcs, uint32_t& root) {
+        minimize(0);
+        arcs.assign(1, 0);  // Index 0 means "no arcs"
+        std::vector<uint32_t> first_arc(states_.size(), 0);
+        root = layout(0, arcs, first_arc);
+        return arcs.size() <= WordDictionary::MAX_ARCS;
+    }
+
+private:
+    struct Arc {
+        unsigned char label;
+        uint32_t target;
+    };
+
+    struct State {
+        bool final = false;
+        std::vector<Arc> arcs;
+    };
+
+    // Replace the states of the previous word below depth `depth` with
+    // registered equivalents, deepest first
+    void minimize(size_t depth) {
+        for (size_t i = previous_.size(); i > depth; --i) {
+            uint32_t child = path_[i];
+            std::string key = signature(states_[child]);
+            auto [it, added] = register_.emplace(std::move(key), child);
+            if (!added) {
+                states_[path_[i - 1]].arcs.back().target = it->second;
+            }
+        }
+        path_.resize(std::min(path_.size(), depth + 1));
+        previous_.resize(std::min(previous_.size(), depth));
+    }
+
+    // Children are registered before their parents, so equal signatures
+    // mean equal right languages
+    static std::string signature(const State& state) {
+        std::string key(1, state.final ? '\1' : '\0');
+        for (const Arc& arc : state.arcs) {
+            key.push_back(static_cast<char>(arc.label));
+            key.append(reinterpret_cast<const char*>(&arc.target), sizeof(arc.target));
+        }
+        return key;
+    }
+
+    // Children first, so the target of every arc is known when it is written
+    uint32_t layout(uint32_t state, std::vector<uint32_t>& arcs, std::vector<uint32_t>& first_arc) {
+        const State& current = states_[state];
+        if (current.arcs.empty() || first_arc[state]) {
+            return first_arc[state];
+        }
+        std::vector<uint32_t> words;
+        for (const Arc& arc : current.arcs) {
+            uint32_t target = layout(arc.target, arcs, first_arc);
+            words.push_back(arc.label | (states_[arc.target].final ? FINAL_ARC : 0) | target << TARGET_SHIFT);
+        }
+        words.back() |= LAST_ARC;
+        first_arc[state] = static_cast<uint32_t>(arcs.size());
+        arcs.insert(arcs.end(), words.begin(), words.end());
+        return first_arc[state];
+    }
+
+    std::vector<State> states_;
+    std::unordered_map<std::string, uint32_t> register_;
+    std::vector<uint32_t> path_{0};  // States along the previous word, root first
+    std::string previous_;
+};
+
+} // namespace
+
+class WordDictionary::Impl {
+public:
+    MappedFile file;
+    std::string language;
+    size_t word_count = 0;
+};
+
+WordDictionary::WordDictionary() : pImpl(std::make_unique<Impl>()) {}
+WordDictionary::~WordDictionary() = default;
+
+bool WordDictionary::write(const std::string& path, const std::string& language, std::vector<std::string> words,
+                           unsigned bloom_bits_per_word) {
+    std::string lower;
+    for (std::string& word : words) {
+        if (lowercase(word, lower)) {
+            word.swap(lower);
+        } else {
+            word.clear();
+        }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    if (!words.empty() && words.front().empty()) {
+        words.erase(words.begin());
+    }
+
+    AutomatonBuilder builder;
+    for (const std::string& word : words) {
+        builder.add(word);
+    }
+    std::vector<uint32_t> arcs;
+    Header header{};
+    if (!builder.finish(arcs, header.root)) {
+        return false;
+    }
+
+    // ~0.7 probes per bit of density minimizes the false positive rate
+    std::vector<uint64_t> bloom;
+    if (bloom_bits_per_word && !words.empty()) {
+        bloom.assign((words.size() * bloom_bits_per_word + 63) / 64, 0);
+        header.bloom_hashes = std::max(1u, std::min(16u, (bloom_bits_per_word * 7 + 5) / 10));
+        for (const std::string& word : words) {
+            for_each_probe(word, bloom.size() * 64, header.bloom_hashes, [&](uint64_t bit) {
+                bloom[bit / 64] |= uint64_t(1) << (bit % 64);
+            });
+        }
+    }
+
+    std::string body = language;
+    body.resize(padded(language.size()), '\0');
+    body.append(reinterpret_cast<const char*>(bloom.data()), bloom.size() * sizeof(uint64_t));
+    body.append(reinterpret_cast<const char*>(arcs.data()), arcs.size() * sizeof(uint32_t));
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.word_count = static_cast<uint32_t>(words.size());
+    header.language_size = static_cast<uint32_t>(language.size());
+    header.bloom_words = static_cast<uint32_t>(bloom.size());
+    header.arc_count = static_cast<uint32_t>(arcs.size());
+    header.checksum = LayoutPack::checksum(body.data(), body.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(body.data(), static_cast<std::streamsize>(body.size()));
+    return static_cast<bool>(file.flush());
+}
+
+std::shared_ptr<const WordDictionary> WordDictionary::open(const std::string& path) {
+    std::shared_ptr<WordDictionary> dictionary(new WordDictionary);
+    MappedFile& file = dictionary->pImpl->file;
+    if (!file.open(path) || file.size() < sizeof(Header)) {
+        return nullptr;
+    }
+    const char* data = file.data();
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        return nullptr;
+    }
+    size_t bloom_offset = sizeof(Header) + padded(header.language_size);
+    size_t arcs_offset = bloom_offset + size_t(header.bloom_words) * sizeof(uint64_t);
+    if (arcs_offset + size_t(header.arc_count) * sizeof(uint32_t) != file.size() || header.arc_count == 0 ||
+        header.root >= header.arc_count ||
+        LayoutPack::checksum(data + sizeof(Header), file.size() - sizeof(Header)) != header.checksum) {
+        return nullptr;
+    }
+
+    dictionary->pImpl->language.assign(data + sizeof(Header), header.language_size);
+    dictionary->pImpl->word_count = header.word_count;
+    dictionary->arcs_ = reinterpret_cast<const uint32_t*>(data + arcs_offset);
+    dictionary->root_ = header.root;
+    if (header.bloom_words) {
+        dictionary->bloom_ = reinterpret_cast<const uint64_t*>(data + bloom_offset);
+        dictionary->bloom_bits_ = uint64_t(header.bloom_words) * 64;
+        dictionary->bloom_hashes_ = header.bloom_hashes;
+    }
+
+    // Every target must start inside the arc array and end on a last arc,
+    // so lookups need no bounds checks
+    for (uint32_t i = 1; i < header.arc_count; ++i) {
+        uint32_t target = dictionary->arcs_[i] >> TARGET_SHIFT;
+        if (target >= header.arc_count) {
+            return nullptr;
+        }
+    }
+    if (header.arc_count > 1 && !(dictionary->arcs_[header.arc_count - 1] & LAST_ARC)) {
+        return nullptr;
+    }
+    return dictionary;
+}
+
+bool WordDictionary::contains(std::string_view word) const {
+    if (bloom_) {
+        bool present = true;
+        for_each_probe(word, bloom_bits_, bloom_hashes_, [&](uint64_t bit) {
+            present &= (bloom_[bit / 64] >> (bit % 64)) & 1;
+        });
+        if (!present) return false;
+    }
+
+    uint32_t state = root_;
+    uint32_t arc = 0;
+    for (char c : word) {
+        if (!state) return false;
+        auto label = static_cast<unsigned char>(c);
+        const uint32_t* run = arcs_ + state;
+        // Arcs are sorted by label
+        while ((*run & LABEL_MASK) < label && !(*run & LAST_ARC)) {
+            ++run;
+        }
+        arc = *run;
+        if ((arc & LABEL_MASK) != label) return false;
+        state = arc >> TARGET_SHIFT;
+    }
+    return !word.empty() && (arc & FINAL_ARC);
+}
+
+const std::string& WordDictionary::language() const {
+    return pImpl->language;
+}
+
+size_t WordDictionary::word_count() const {
+    return pImpl->word_count;
+}
+
+size_t WordDictionary::size_bytes() const {
+    return pImpl->file.size();
+}
+
+} // namespace layout_converter
@@ -0,0 +1,138 @@
+// Common Word Matcher Implementation
+// Trie of key-position words completed into a DFA, so scanning is one
+// table load per typed character
+
+#include "word_matcher.h"
+#include <algorithm>
+#include <string>
+
+namespace layout_converter {
+
+namespace {
+
+constexpr uint32_t NO_STATE = UINT32_MAX;
+
+} // namespace
+
+void WordMatcher::build(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts) {
+    // Each pattern is WORD_BREAK, the word's key positions, WORD_BREAK
+    struct Pattern {
+        LayoutHandle layout;
+        std::vector<unsigned char> positions;
+    };
+    std::vector<Pattern> patterns;
+    for (size_t handle = 0; handle < layouts.size(); ++handle) {
+        if (!layouts[handle]) continue;
+        const LayoutDefinition& layout = *layouts[handle];
+        std::vector<std::string> words = layout.common_words;
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+
+        for (const std::string& word : words) {
+            Pattern pattern{static_cast<LayoutHandle>(handle), {WORD_BREAK}};
+            const char* p = word.data();
+            const char* end = p + word.size();
+            while (p < end) {
+                char32_t cp;
+                p += utf8::decode(p, end, cp);
+                int position = layout.key_position_for(utf8::to_lower(cp));
+                if (!position) break;
+                pattern.positions.push_back(static_cast<unsigned char>(position));
+            }
+            if (p < end || pattern.positions.size() < 2) continue;  // Not typeable on this layout
+            pattern.positions.push_back(WORD_BREAK);
+            patterns.push_back(std::move(pattern));
+        }
+    }
+
+    symbols_.fill(OTHER_KEY);
+    symbols_[WORD_BREAK] = 0;
+    symbol_count_ = 2;
+    for (const Pattern& pattern : patterns) {
+        for (unsigned char position : pattern.positions) {
+            if (position != WORD_BREAK && symbols_[position] == OTHER_KEY) {
+                symbols_[position] = static_cast<unsigned char>(symbol_count_++);
+            }
+        }
+    }
+
+    // Trie
+    transitions_.assign(symbol_count_, NO_STATE);
+    std::vector<std::vector<Output>> state_outputs(1);
+    for (const Pattern& pattern : patterns) {
+        uint32_t state = 0;
+        for (unsigned char position : pattern.positions) {
+            uint32_t& next = transitions_[state * symbol_count_ + symbols_[position]];
+            if (next == NO_STATE) {
+                next = static_cast<uint32_t>(state_outputs.size());
+                state_outputs.emplace_back();
+                transitions_.resize(transitions_.size() + symbol_count_, NO_STATE);
+            }
+            state = transitions_[state * symbol_count_ + symbols_[position]];
+        }
+        state_outputs[state].push_back({pattern.layout, static_cast<uint32_t>(pattern.positions.size() - 2)});
+    }
+
+    // Failure links, breadth first, folded into the transition table so
+    // every state has a move on every symbol
+    const size_t state_count = state_outputs.size();
+    std::vector<uint32_t> failure(state_count, 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(state_count);
+    for (unsigned symbol = 0; symbol < symbol_count_; ++symbol) {
+        uint32_t& next = transitions_[symbol];
+        if (next == NO_STATE) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        const std::vector<Output>& inherited = state_outputs[failure[state]];
+        state_outputs[state].insert(state_outputs[state].end(), inherited.begin(), inherited.end());
+        for (unsigned symbol = 0; symbol < symbol_count_; ++symbol) {
+            uint32_t fallback = transitions_[failure[state] * symbol_count_ + symbol];
+            uint32_t& next = transitions_[state * symbol_count_ + symbol];
+            if (next == NO_STATE) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    output_offsets_.assign(state_count + 1, 0);
+    outputs_.clear();
+    for (size_t state = 0; state < state_count; ++state) {
+        output_offsets_[state] = static_cast<uint32_t>(outputs_.size());
+        outputs_.insert(outputs_.end(), state_outputs[state].begin(), state_outputs[state].end());
+    }
+    output_offsets_[state_count] = static_cast<uint32_t>(outputs_.size());
+}
+
+void WordMatcher::scan(const unsigned char* positions, size_t count, Matches& matches) const {
+    if (outputs_.empty()) {
+        return;
+    }
+    uint32_t state = step(START_STATE, WORD_BREAK, matches);
+    for (size_t i = 0; i < count; ++i) {
+        state = step(state, positions[i], matches);
+    }
+    step(state, WORD_BREAK, matches);
+}
+
+uint32_t WordMatcher::step(uint32_t state, unsigned char position, Matches& matches) const {
+    if (outputs_.empty()) {
+        return START_STATE;
+    }
+    state = transitions_[state * symbol_count_ + symbols_[position]];
+    for (uint32_t i = output_offsets_[state]; i < output_offsets_[state + 1]; ++i) {
+        ++matches.words[outputs_[i].layout];
+        matches.characters[outputs_[i].layout] += outputs_[i].length;
+    }
+    return state;
+}
+
+} // namespace layout_converter
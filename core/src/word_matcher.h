@@ -0,0 +1,71 @@
+// Common Word Matcher
+// Aho-Corasick automaton over key positions that finds the common words of
+// every loaded layout in one scan of a typed text
+
+#ifndef WORD_MATCHER_H
+#define WORD_MATCHER_H
+
+#include "../include/key_system.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace layout_converter {
+
+// Words are stored as the key positions that type them, framed by word
+// breaks, so a single scan of the positions a text was typed with finds the
+// words of every intended layout at once, and "the" never matches inside
+// "other".
+class WordMatcher {
+public:
+    // Position value that separates words in the scanned sequence
+    static constexpr unsigned char WORD_BREAK = 0;
+
+    // Per-layout totals of one scan, indexed by LayoutHandle
+    struct Matches {
+        std::vector<uint32_t> words;
+        std::vector<uint32_t> characters;
+
+        void reset(size_t layout_count) {
+            words.assign(layout_count, 0);
+            characters.assign(layout_count, 0);
+        }
+    };
+
+    // Build the automaton from the common words of `layouts` (indexed by
+    // LayoutHandle; null entries are not loaded). Words with a character
+    // the layout cannot type are skipped.
+    void build(const std::vector<std::shared_ptr<const LayoutDefinition>>& layouts);
+
+    // Scan key positions (WORD_BREAK between words) and add every match
+    // to `matches`. The sequence is treated as framed by word breaks.
+    void scan(const unsigned char* positions, size_t count, Matches& matches) const;
+
+    // Incremental form of scan(): feed positions one at a time, starting
+    // from START_STATE followed by a WORD_BREAK. A word is counted when the
+    // break after it is fed.
+    static constexpr uint32_t START_STATE = 0;
+    uint32_t step(uint32_t state, unsigned char position, Matches& matches) const;
+
+    size_t state_count() const { return symbol_count_ ? transitions_.size() / symbol_count_ : 0; }
+
+private:
+    // Symbols: 0 = word break, 1 = key no word uses, 2.. = keys used by words
+    static constexpr unsigned char OTHER_KEY = 1;
+
+    struct Output {
+        LayoutHandle layout;
+        uint32_t length;  // Characters in the word
+    };
+
+    std::array<unsigned char, KeyID::MAX_KEY_POSITION + 1> symbols_{};
+    unsigned symbol_count_ = 0;
+    std::vector<uint32_t> transitions_;     // [state * symbol_count_ + symbol] -> state
+    std::vector<uint32_t> output_offsets_;  // Outputs of state s: [offsets[s], offsets[s + 1])
+    std::vector<Output> outputs_;
+};
+
+} // namespace layout_converter
+
+#endif // WORD_MATCHER_H
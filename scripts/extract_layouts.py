@@ -148,18 +148,25 @@ class LayoutExtractor:
         return cyrillic_layouts
     
     def generate_cpp_mappings(self, layouts: Dict[str, Any]) -> str:
-        """Generate C++ mapping code from extracted layouts"""
+        """Generate C++ mapping code from extracted layouts.
+
+        Emits constexpr arrays indexed by QWERTY letter ('a' = 0), so the
+        tables need no dynamic initialization.
+        """
         print("🔧 Generating C++ mappings...")
         
         cpp_code = "// Auto-generated layout mappings\n"
-        cpp_code += "#include <unordered_map>\n\n"
+        cpp_code += "#include <array>\n\n"
         
         for layout_id, layout_data in layouts.items():
             if "mapping" in layout_data:
-                cpp_code += f"const std::unordered_map<char, char> qwerty_to_{layout_id} = {{\n"
+                table = [0] * 26
                 for qwerty_char, mapped_char in layout_data["mapping"].items():
-                    cpp_code += f"    {{'{qwerty_char}', '{mapped_char}'}},\n"
-                cpp_code += "};\n\n"
+                    table[ord(qwerty_char) - ord("a")] = ord(mapped_char)
+                cpp_code += f"constexpr std::array<char32_t, 26> qwerty_to_{layout_id} = {{{{\n"
+                for start in range(0, 26, 13):
+                    cpp_code += "    " + ", ".join("0x%04X" % c for c in table[start:start + 13]) + ",\n"
+                cpp_code += "}};\n\n"
         
         return cpp_code
     
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""
+Built-in Layout Generator
+Turns layout JSON files into constexpr tables compiled into the core library
+"""
+
+import argparse
+import json
+import os
+import re
+from typing import Any, Dict, List
+
+# Mirrors the KeyID namespace in core/include/key_system.h
+PHYSICAL_KEY_COUNT = 48
+LEVEL_BASE, LEVEL_SHIFT, LEVEL_ALTGR = 0, 1, 2
+LEVEL_COUNT = 4
+MAX_KEY_POSITION = LEVEL_COUNT * PHYSICAL_KEY_COUNT
+
+# Mirrors KeyUtils::KEY_NAMES: W3C key codes by physical key
+KEY_NAMES = (
+    [""]
+    + ["Key" + c for c in "QWERTYUIOPASDFGHJKLZXCVBNM"]
+    + ["Backquote"]
+    + ["Digit%d" % d for d in (1, 2, 3, 4, 5, 6, 7, 8, 9, 0)]
+    + ["Minus", "Equal", "BracketLeft", "BracketRight", "Backslash", "Semicolon", "Quote",
+       "Comma", "Period", "Slash", "IntlBackslash"]
+)
+assert len(KEY_NAMES) == PHYSICAL_KEY_COUNT + 1
+
+# Mirrors KeyUtils::default_language_for_family
+FAMILY_LANGUAGES = {1: "en", 2: "ru", 3: "hi", 4: "ar", 5: "zh"}
+
+
+def c_string(text: str) -> str:
+    """C string literal; non-ASCII bytes use octal escapes (never ambiguous)"""
+    out = []
+    for byte in text.encode("utf-8"):
+        ch = chr(byte)
+        if ch in '"\\':
+            out.append("\\" + ch)
+        elif 0x20 <= byte < 0x7F:
+            out.append(ch)
+        else:
+            out.append("\\%03o" % byte)
+    return '"' + "".join(out) + '"'
+
+
+def enum_name(layout_id: str) -> str:
+    return re.sub(r"[^A-Za-z0-9]", "_", layout_id).upper()
+
+
+def language(layout: Dict[str, Any]) -> str:
+    return layout.get("language") or FAMILY_LANGUAGES.get(int(layout.get("family_id", 0)), "")
+
+
+def key_position(name: str) -> int:
+    """Mirrors KeyUtils::key_position_from_name"""
+    if name.isdigit():
+        position = int(name) % 100  # Legacy decimal key ID
+        return position if position <= PHYSICAL_KEY_COUNT else 0
+    level = LEVEL_BASE
+    if name.startswith("Shift+"):
+        level |= LEVEL_SHIFT
+        name = name[len("Shift+"):]
+    if name.startswith("AltGr+"):
+        level |= LEVEL_ALTGR
+        name = name[len("AltGr+"):]
+    if name not in KEY_NAMES[1:]:
+        return 0
+    return level * PHYSICAL_KEY_COUNT + KEY_NAMES.index(name)
+
+
+def key_table(layout: Dict[str, Any]) -> List[int]:
+    keys = [0] * (MAX_KEY_POSITION + 1)
+    for key_name, character in layout["key_mappings"].items():
+        position = key_position(key_name)
+        if not position:
+            raise ValueError(f"{layout['id']}: unknown key {key_name}")
+        if character:
+            if len(character) != 1:
+                raise ValueError(f"{layout['id']}: key {key_name} maps to more than one character")
+            keys[position] = ord(character)
+    return keys
+
+
+def generate_header(layouts: List[Dict[str, Any]]) -> str:
+    lines = [
+        "// Built-in layout tables",
+        "// Auto-generated by scripts/generate_builtin_layouts.py from data/layouts/*.json. Do not edit.",
+        "",
+        "#ifndef BUILTIN_LAYOUTS_DATA_H",
+        "#define BUILTIN_LAYOUTS_DATA_H",
+        "",
+        "namespace layout_converter {",
+        "namespace Builtin {",
+        "",
+        "enum class Layout : int {",
+    ]
+    for index, layout in enumerate(layouts):
+        lines.append(f"    {enum_name(layout['layout_key'])} = {index},")
+    lines += ["};", "", f"constexpr size_t LAYOUT_COUNT = {len(layouts)};", "", "namespace detail {"]
+
+    for layout in layouts:
+        words = ", ".join(c_string(w) for w in layout.get("common_words", [])) or "nullptr"
+        lines.append(f"inline constexpr const char* {enum_name(layout['layout_key'])}_WORDS[] = {{{words}}};")
+    lines += ["} // namespace detail", "", "inline constexpr std::array<LayoutData, LAYOUT_COUNT> LAYOUTS = {{"]
+
+    for layout in layouts:
+        name = enum_name(layout["layout_key"])
+        keys = key_table(layout)
+        key_rows = []
+        for start in range(0, len(keys), 10):
+            key_rows.append("        " + ", ".join("0x%04X" % k for k in keys[start:start + 10]))
+        lines += [
+            "    {",
+            f"        {c_string(layout['layout_key'])}, {c_string(layout['id'])}, {c_string(layout['name'])}, {c_string(language(layout))},",
+            f"        {int(layout.get('family_id', 0))}, {int(layout.get('layout_id', 0))}, {float(layout['frequency_score'])!r},",
+            f"        detail::{name}_WORDS, {len(layout.get('common_words', []))},",
+            "        {{",
+            ",\n".join(key_rows),
+            "        }}",
+            "    },",
+        ]
+    lines += [
+        "}};",
+        "",
+        "} // namespace Builtin",
+        "} // namespace layout_converter",
+        "",
+        "#endif // BUILTIN_LAYOUTS_DATA_H",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--output", required=True, help="Header to write")
+    parser.add_argument("layouts", nargs="+", help="Layout JSON files")
+    args = parser.parse_args()
+
+    layouts = []
+    for path in sorted(args.layouts):
+        with open(path, encoding="utf-8") as f:
+            text = f.read().strip()
+        if not text:
+            continue  # Placeholder files
+        layout = json.loads(text)
+        layout["layout_key"] = os.path.splitext(os.path.basename(path))[0]
+        layouts.append(layout)
+
+    header = generate_header(layouts)
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
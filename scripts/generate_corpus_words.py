@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Corpus Word Count Generator
+Turns plain-text corpora (data/corpora/<language>.txt) into word frequency
+tables compiled into the core library to seed the detection models
+"""
+
+import argparse
+import os
+import re
+from collections import Counter
+from typing import Dict, List
+
+WORD = re.compile(r"[^\W\d_]+")
+
+
+def c_string(text: str) -> str:
+    """C string literal; non-ASCII bytes use octal escapes (never ambiguous)"""
+    out = []
+    for byte in text.encode("utf-8"):
+        ch = chr(byte)
+        if ch in '"\\':
+            out.append("\\" + ch)
+        elif 0x20 <= byte < 0x7F:
+            out.append(ch)
+        else:
+            out.append("\\%03o" % byte)
+    return '"' + "".join(out) + '"'
+
+
+def count_words(path: str) -> Counter:
+    with open(path, encoding="utf-8") as f:
+        return Counter(word.lower() for word in WORD.findall(f.read()))
+
+
+def generate_header(corpora: Dict[str, Counter]) -> str:
+    lines = [
+        "// Corpus word counts",
+        "// Auto-generated by scripts/generate_corpus_words.py from data/corpora/*.txt. Do not edit.",
+        "",
+        "#ifndef CORPUS_WORDS_DATA_H",
+        "#define CORPUS_WORDS_DATA_H",
+        "",
+        "namespace layout_converter {",
+        "namespace CorpusWords {",
+        "",
+        "namespace detail {",
+    ]
+    names: List[str] = []
+    for language, counts in corpora.items():
+        name = re.sub(r"[^A-Za-z0-9]", "_", language).upper() + "_WORDS"
+        names.append(name)
+        lines.append(f"inline constexpr WordCount {name}[] = {{")
+        for word, count in sorted(counts.items(), key=lambda item: (-item[1], item[0])):
+            lines.append(f"    {{{c_string(word)}, {count}}},")
+        lines.append("};")
+    lines += ["} // namespace detail", ""]
+
+    lines.append(f"inline constexpr std::array<Language, {len(corpora)}> LANGUAGES = {{{{")
+    for (language, counts), name in zip(corpora.items(), names):
+        lines.append(f"    {{{c_string(language)}, detail::{name}, {len(counts)}}},")
+    lines += [
+        "}};",
+        "",
+        "} // namespace CorpusWords",
+        "} // namespace layout_converter",
+        "",
+        "#endif // CORPUS_WORDS_DATA_H",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--output", required=True, help="Header to write")
+    parser.add_argument("corpora", nargs="*", help="Corpus text files named <language>.txt")
+    args = parser.parse_args()
+
+    corpora = {}
+    for path in sorted(args.corpora):
+        counts = count_words(path)
+        if counts:
+            corpora[os.path.splitext(os.path.basename(path))[0]] = counts
+
+    header = generate_header(corpora)
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,26 @@
+# CLI test: --fix reads --input line by line and writes --output
+# Run with -DCLI=<layout_converter executable> -DWORK_DIR=<scratch directory>
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(input "${WORK_DIR}/fix_input.txt")
+set(output "${WORK_DIR}/fix_output.txt")
+file(WRITE "${input}" "hello ghbdtn world\nrfr ltkf\n")
+file(REMOVE "${output}")
+
+execute_process(
+    COMMAND "${CLI}" --fix qwerty,russian --input "${input}" --output "${output}"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE stdout
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "--fix with --input/--output exited with ${result}")
+endif()
+if(NOT stdout STREQUAL "")
+    message(FATAL_ERROR "--fix with --output also wrote to stdout: '${stdout}'")
+endif()
+
+file(READ "${output}" fixed)
+set(expected "hello привет world\nкак дела\n")
+if(NOT fixed STREQUAL expected)
+    message(FATAL_ERROR "unexpected --fix output: '${fixed}'")
+endif()
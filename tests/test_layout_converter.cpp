@@ -2,10 +2,31 @@
 // Simple unit tests for the key ID layout conversion functionality
 
 #include "../core/include/key_system.h"
+#include "../core/include/batch_converter.h"
+#include "../core/include/builtin_layouts.h"
+#include "../core/include/file_converter.h"
+#include "../core/include/incremental_detector.h"
+#include "../core/include/layout_pack.h"
+#include "../core/include/ngram_model.h"
+#include "../core/include/stats.h"
+#include "../core/include/stream_converter.h"
+#include "../core/include/word_dictionary.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#ifndef LAYOUT_DATA_DIR
+#define LAYOUT_DATA_DIR "data/layouts"
+#endif
 
 class KeyIDSystemTest {
 public:
@@ -15,30 +36,75 @@ public:
         
         test_key_id_generation();
         test_key_id_components();
+        test_key_positions();
         test_basic_conversion();
         test_same_layout_conversion();
         test_layout_detection();
         test_cyrillic_detection();
+        test_script_pruning();
         test_invalid_layouts();
         test_case_preservation();
         test_non_alphabetic_characters();
+        test_conversion_plan_cache();
+        test_bulk_conversion();
+        test_utf8_codec();
+        test_cyrillic_conversion();
+        test_buffer_conversion();
+        test_stream_conversion();
+        test_file_conversion();
+        test_layout_pack();
+        test_builtin_layouts();
+        test_common_word_matching();
+        test_concurrent_reload();
+        test_directory_watch();
+        test_batch_conversion();
+        test_fanout_conversion();
+        test_batch_detection();
+        test_statistics();
+        test_incremental_detection();
+        test_fix_mistyped();
+        test_word_dictionary();
+        test_ngram_model();
         
-        std::cout << "\n✅ All tests completed!\n";
+        if (failures_ > 0) {
+            std::cout << "\n❌ " << failures_ << " test(s) failed\n";
+        } else {
+            std::cout << "\n✅ All tests completed!\n";
+        }
     }
+    
+    static int failures() { return failures_; }
 
 private:
+    static inline int failures_ = 0;
+    
+    static void fail(const std::string& message) {
+        std::cout << "FAILED (" << message << ")\n";
+        ++failures_;
+    }
+    
+    static std::string layout_path(const std::string& layout_id) {
+        return std::string(LAYOUT_DATA_DIR) + "/" + layout_id + ".json";
+    }
+    
+    // Library with the in-tree QWERTY and Workman layouts loaded
+    static bool load_latin_layouts(layout_converter::KeyBasedLayoutLibrary& library) {
+        return library.load_layout("qwerty", layout_path("qwerty")) &&
+               library.load_layout("workman", layout_path("workman"));
+    }
+
     static void test_key_id_generation() {
         std::cout << "Testing Key ID Generation... ";
         
         int key_id = layout_converter::generate_key_id(1, 1, 5);  // QWERTY, key 5
         if (key_id != 1105) {
-            std::cout << "FAILED (expected 1105, got " << key_id << ")\n";
+            fail("expected 1105, got " + std::to_string(key_id));
             return;
         }
         
         key_id = layout_converter::generate_key_id(2, 1, 10);  // Russian, key 10
         if (key_id != 2110) {
-            std::cout << "FAILED (expected 2110, got " << key_id << ")\n";
+            fail("expected 2110, got " + std::to_string(key_id));
             return;
         }
         
@@ -50,7 +116,94 @@ private:
         
         layout_converter::KeyIDComponents components(1105);
         if (components.family_id != 1 || components.layout_id != 1 || components.key_position != 5) {
-            std::cout << "FAILED\n";
+            fail("wrong components for 1105");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_key_positions() {
+        std::cout << "Testing Key Positions... ";
+        namespace KeyID = layout_converter::KeyID;
+        namespace KeyUtils = layout_converter::KeyUtils;
+        
+        // Dense positions round-trip through (physical key, level)
+        for (int position = 1; position <= KeyID::MAX_KEY_POSITION; ++position) {
+            if (KeyID::key_position(KeyID::physical_key(position), KeyID::level(position)) != position) {
+                fail("position " + std::to_string(position) + " does not round-trip");
+                return;
+            }
+        }
+        if (KeyID::key_position(KeyID::KEY_COMMA, KeyID::LEVEL_SHIFT) != KeyID::PHYSICAL_KEY_COUNT + 45 ||
+            KeyID::level(KeyID::MAX_KEY_POSITION) != KeyID::LEVEL_SHIFT_ALTGR) {
+            fail("unexpected dense key positions");
+            return;
+        }
+        
+        // Key names: W3C codes and legacy decimal IDs
+        if (KeyUtils::key_position_from_name("KeyQ") != KeyID::KEY_Q ||
+            KeyUtils::key_position_from_name("Comma") != KeyID::KEY_COMMA ||
+            KeyUtils::key_position_from_name("Digit0") != KeyID::KEY_DIGIT_0 ||
+            KeyUtils::key_position_from_name("2111") != KeyID::KEY_A ||
+            KeyUtils::key_position_from_name("Shift+Digit1") != KeyID::key_position(KeyID::KEY_DIGIT_1, KeyID::LEVEL_SHIFT) ||
+            KeyUtils::key_position_from_name("AltGr+KeyE") != KeyID::key_position(KeyID::KEY_E, KeyID::LEVEL_ALTGR) ||
+            KeyUtils::key_position_from_name("Shift+AltGr+KeyE") != KeyID::key_position(KeyID::KEY_E, KeyID::LEVEL_SHIFT_ALTGR) ||
+            KeyUtils::key_position_from_name("AltGr+Shift+KeyE") != 0 || KeyUtils::key_position_from_name("Shift+1101") != 0 ||
+            KeyUtils::key_position_from_name("keyq") != 0 || KeyUtils::key_position_from_name("1199") != 0 ||
+            std::string(KeyUtils::key_name(KeyID::KEY_INTL_BACKSLASH)) != "IntlBackslash" ||
+            KeyUtils::char_to_key_position('H') != KeyID::KEY_H || KeyUtils::key_position_to_char(KeyID::KEY_M) != 'm') {
+            fail("key names do not resolve");
+            return;
+        }
+        
+        // Punctuation keys and layout numbers past the old one-digit limit
+        auto dir = std::filesystem::temp_directory_path();
+        std::string latin = (dir / "layout_converter_keys_latin.json").string();
+        std::string cyrillic = (dir / "layout_converter_keys_cyrillic.json").string();
+        std::string broken = (dir / "layout_converter_keys_broken.json").string();
+        std::ofstream(latin) << R"({"id": "latin", "name": "Latin", "family_id": 1, "layout_id": 42,
+            "frequency_score": 0.1, "key_mappings": {"KeyQ": "q", "KeyA": "a", "Comma": ",", "Digit1": "1",
+            "Shift+Digit1": "!", "AltGr+KeyA": "\u00e1"}})";
+        std::ofstream(cyrillic) << R"({"id": "cyrillic", "name": "Cyrillic", "family_id": 2, "layout_id": 12,
+            "frequency_score": 0.1, "key_mappings": {"KeyQ": "\u0439", "Comma": "\u0431", "2111": "\u0444",
+            "Shift+Digit1": "\u2116", "AltGr+KeyA": "\u0451"}})";
+        std::ofstream(broken) << R"({"id": "broken", "name": "Broken", "family_id": 1, "layout_id": 1,
+            "frequency_score": 0.1, "key_mappings": {"NoSuchKey": "q"}})";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        bool loaded = library.load_layout("latin", latin) && library.load_layout("cyrillic", cyrillic);
+        bool rejected = !library.load_layout("broken", broken);
+        std::filesystem::remove(latin);
+        std::filesystem::remove(cyrillic);
+        std::filesystem::remove(broken);
+        if (!loaded || !rejected) {
+            fail("layouts with key names did not load as expected");
+            return;
+        }
+        if (library.convert_text("qa,1", "latin", "cyrillic") != "\u0439\u0444\u0431" "1") {
+            fail("punctuation key not converted");
+            return;
+        }
+        
+        // Explicit levels map to the same level; unset Shift levels take
+        // the uppercase of the unshifted character
+        if (library.convert_text("QA!\u00e1\u00c1", "latin", "cyrillic") != "\u0419\u0424\u2116\u0451\u0401") {
+            fail("modifier levels not converted");
+            return;
+        }
+        
+        // Reassigning a key takes its character off the layout, unless the
+        // character is on another key too
+        layout_converter::LayoutDefinition layout;
+        layout.set_key(KeyID::KEY_Q, 'q');
+        layout.set_key(KeyID::KEY_W, 'w');
+        layout.set_key(KeyID::KEY_E, 'w');
+        layout.set_key(KeyID::KEY_Q, 'x');
+        layout.set_key(KeyID::KEY_E, 'e');
+        if (layout.key_position_for('q') != 0 || layout.key_position_for('x') != KeyID::KEY_Q ||
+            layout.key_position_for('w') != KeyID::KEY_W) {
+            fail("stale key assignments");
             return;
         }
         
@@ -60,43 +213,1323 @@ private:
     static void test_basic_conversion() {
         std::cout << "Testing Basic Conversion... ";
         
-        // Note: This test requires the library to be properly initialized with layouts
-        // For now, we'll just test the function signature
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts from " LAYOUT_DATA_DIR);
+            return;
+        }
+        
+        std::string converted = library.convert_text("hello", "qwerty", "workman");
+        if (converted != "ywoo;") {
+            fail("expected 'ywoo;', got '" + converted + "'");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_same_layout_conversion() {
         std::cout << "Testing Same Layout Conversion... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        std::string converted = library.convert_text("hello world", "qwerty", "qwerty");
+        if (converted != "hello world") {
+            fail("got '" + converted + "'");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_layout_detection() {
         std::cout << "Testing Layout Detection... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        auto qwerty = library.resolve_layout("qwerty");
+        auto workman = library.resolve_layout("workman");
+        
+        auto detected = library.detect_likely_layouts("how are you doing");
+        if (detected.empty() || detected.front() != "qwerty" ||
+            std::find(detected.begin(), detected.end(), "russian") != detected.end()) {
+            fail("plain English should be detected as typed on QWERTY only");
+            return;
+        }
+        
+        auto best = library.detect_hypotheses("how are you doing", "en", 1);
+        if (best.size() != 1 || best[0].typed_layout != qwerty || best[0].intended_layout != qwerty) {
+            fail("best hypothesis for plain English is not qwerty -> qwerty");
+            return;
+        }
+        
+        // English typed with the Workman layout active
+        std::string mistyped = library.convert_text("she has the new one", "qwerty", "workman");
+        best = library.detect_hypotheses(mistyped, "en", 1);
+        if (best.empty() || best[0].typed_layout != workman || best[0].intended_layout != qwerty) {
+            fail("'" + mistyped + "' not detected as English typed on Workman");
+            return;
+        }
+        
+        if (!library.detect_hypotheses("12345 !!!").empty() || library.get_layout_id(workman) != "workman") {
+            fail("text without letters produced hypotheses");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_cyrillic_detection() {
         std::cout << "Testing Cyrillic Detection... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        auto qwerty = library.resolve_layout("qwerty");
+        auto russian = library.resolve_layout("russian");
+        if (library.get_layout("russian")->language != "ru" || library.get_layout("qwerty")->language != "en") {
+            fail("layout languages not loaded");
+            return;
+        }
+        
+        auto detected = library.detect_likely_layouts("привет как дела", "ru");
+        if (detected.size() != 1 || detected.front() != "russian") {
+            fail("Cyrillic text should only be typed on the Russian layout");
+            return;
+        }
+        
+        // Russian typed with QWERTY active, and English typed with Russian active
+        auto best = library.detect_hypotheses("Ghbdtn, rfr ltkf?", "en", 1);
+        if (best.empty() || best[0].typed_layout != qwerty || best[0].intended_layout != russian) {
+            fail("'Ghbdtn, rfr ltkf?' not detected as Russian typed on QWERTY");
+            return;
+        }
+        best = library.detect_hypotheses("ыру рфы еру туц щту", "ru", 1);
+        if (best.empty() || best[0].typed_layout != russian || best[0].intended_layout != qwerty) {
+            fail("'ыру рфы еру туц щту' not detected as English typed on Russian");
+            return;
+        }
+        
+        // Emoji and symbols are not letters: they neither dilute coverage nor
+        // count as letters missing from the layouts
+        best = library.detect_hypotheses("ghbdtn \U0001F600\U0001F600\U0001F600\U0001F600\U0001F600\U0001F600\U0001F600\U0001F600",
+                                      "en", 1);
+        if (best.empty() || best[0].typed_layout != qwerty || best[0].intended_layout != russian ||
+            library.detect_likely_layouts("ghbdtn \u20AC\u2014\u201C\u3002").empty()) {
+            fail("symbols and emoji ruled out every layout");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_script_pruning() {
+        std::cout << "Testing Script Pruning... ";
+        namespace KeyID = layout_converter::KeyID;
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        auto script_layout = [&](const std::string& layout_id, int family_id, const std::string& language,
+                                 char32_t first_letter) {
+            auto layout = std::make_shared<layout_converter::LayoutDefinition>();
+            layout->name = layout_id;
+            layout->family_id = family_id;
+            layout->language = language;
+            for (int key = 1; key <= 26; ++key) {
+                layout->set_key(key, first_letter + key - 1);
+            }
+            library.add_layout(layout_id, layout);
+            return library.resolve_layout(layout_id);
+        };
+        auto hindi = script_layout("devanagari_test", KeyID::FAMILY_HINDI, "hi", U'\u0915');
+        auto arabic = script_layout("arabic_test", KeyID::FAMILY_ARABIC, "ar", U'\u0628');
+        auto chinese = script_layout("cjk_test", KeyID::FAMILY_CHINESE, "zh", U'\u4e00');
+        
+        auto typed_on = [&](const std::string& text, layout_converter::LayoutHandle layout) {
+            for (const auto& hypothesis : library.detect_hypotheses(text)) {
+                if (hypothesis.typed_layout == layout) return true;
+            }
+            return false;
+        };
+        
+        // Every lead byte position relative to the 16- and 32-byte blocks
+        const std::pair<std::string, layout_converter::LayoutHandle> samples[] = {
+            {"\u0915\u0916\u0917 \u0918\u0919", hindi},
+            {"\u0628\u0629\u062a \u062b\u062c", arabic},
+            {"\u4e00\u4e01\u4e02 \u4e03", chinese},
+            {"\u043f\u0440\u0438\u0432\u0435\u0442", library.resolve_layout("russian")},
+        };
+        for (const auto& [word, layout] : samples) {
+            for (size_t padding = 0; padding <= 40; ++padding) {
+                std::string text = std::string(padding, '.') + word + " " + word;
+                if (!typed_on(text, layout)) {
+                    fail("layout pruned although it types the text (padding " + std::to_string(padding) + ")");
+                    return;
+                }
+            }
+        }
+        
+        // Latin text rules out every layout without Latin letters
+        std::string latin = "the quick brown fox jumps over the lazy dog, twice over";
+        if (typed_on(latin, hindi) || typed_on(latin, arabic) || typed_on(latin, chinese) ||
+            !typed_on(latin, library.resolve_layout("qwerty"))) {
+            fail("wrong typed layouts for Latin text");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_invalid_layouts() {
         std::cout << "Testing Invalid Layouts... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_layout("missing", layout_path("does_not_exist"))) {
+            fail("loading a missing file succeeded");
+            return;
+        }
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        if (library.convert_text("hello", "qwerty", "missing") != "hello") {
+            fail("unknown target layout should return input unchanged");
+            return;
+        }
+        if (library.compile("missing", "qwerty") != nullptr) {
+            fail("compiling an unknown layout should return nullptr");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_case_preservation() {
         std::cout << "Testing Case Preservation... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        std::string converted = library.convert_text("Hello", "qwerty", "workman");
+        if (converted != "Ywoo;") {
+            fail("expected 'Ywoo;', got '" + converted + "'");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
     }
     
     static void test_non_alphabetic_characters() {
         std::cout << "Testing Non-Alphabetic Characters... ";
-        std::cout << "SKIPPED (requires layout initialization)\n";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        std::string converted = library.convert_text("h1 e!", "qwerty", "workman");
+        if (converted != "y1 w!") {
+            fail("expected 'y1 w!', got '" + converted + "'");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_conversion_plan_cache() {
+        std::cout << "Testing Conversion Plan Cache... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        auto plan = library.compile("qwerty", "workman");
+        if (!plan || plan->convert("hello") != "ywoo;" || plan->convert_char('H') != 'Y') {
+            fail("compiled plan converts incorrectly");
+            return;
+        }
+        if (library.compile("qwerty", "workman") != plan) {
+            fail("plan was not reused from cache");
+            return;
+        }
+        
+        // Reloading a layout must invalidate compiled plans
+        library.load_layout("workman", layout_path("workman"));
+        if (library.compile("qwerty", "workman") == plan) {
+            fail("stale plan returned after reload");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_bulk_conversion() {
+        std::cout << "Testing Bulk Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        auto plan = library.compile("qwerty", "workman");
+        
+        // Long enough for the vector kernels, with non-ASCII bytes mid-block
+        std::string text;
+        for (int i = 0; i < 200; ++i) {
+            text += "The quick brown fox, 42! ";
+            if (i % 7 == 3) text += "\xD0\xBF\xD1\x80";
+        }
+        
+        std::string expected;
+        for (char c : text) {
+            expected += plan->convert_char(c);
+        }
+        
+        for (size_t length : {text.size(), size_t(15), size_t(33), size_t(100)}) {
+            std::string input = text.substr(0, length);
+            if (library.convert_text(input, "qwerty", "workman") != expected.substr(0, length)) {
+                fail("mismatch against scalar table at length " + std::to_string(length));
+                return;
+            }
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_utf8_codec() {
+        std::cout << "Testing UTF-8 Codec... ";
+        
+        using namespace layout_converter;
+        const std::string text = "a\xD0\xBF\xE2\x82\xAC\xF0\x9F\x98\x80\xD0";  // a п € 😀 + truncated lead
+        const char* p = text.data();
+        const char* end = p + text.size();
+        std::vector<char32_t> decoded;
+        while (p < end) {
+            char32_t cp;
+            size_t length = utf8::decode(p, end, cp);
+            utf8::EncodedChar reencoded = utf8::encode(cp);
+            if (cp != utf8::INVALID_CODEPOINT && std::string(reencoded.bytes, reencoded.length) != std::string(p, length)) {
+                fail("round trip mismatch");
+                return;
+            }
+            decoded.push_back(cp);
+            p += length;
+        }
+        
+        std::vector<char32_t> expected = {U'a', 0x043F, 0x20AC, 0x1F600, utf8::INVALID_CODEPOINT};
+        if (decoded != expected) {
+            fail("unexpected codepoints");
+            return;
+        }
+        if (utf8::to_upper(0x043F) != 0x041F || utf8::to_lower(0x0401) != 0x0451) {
+            fail("Cyrillic case mapping");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_cyrillic_conversion() {
+        std::cout << "Testing Cyrillic Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library) || !library.load_layout("russian", layout_path("russian"))) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        std::string converted = library.convert_text("Ghbdtn? vbh!", "qwerty", "russian");
+        if (converted != "Привет, мир!") {
+            fail("qwerty -> russian got '" + converted + "'");
+            return;
+        }
+        converted = library.convert_text("Привет, мир!", "russian", "qwerty");
+        if (converted != "Ghbdtn? vbh!") {
+            fail("russian -> qwerty got '" + converted + "'");
+            return;
+        }
+        converted = library.convert_text("ПРИВЕТ ёж", "russian", "workman");
+        if (converted != "GYVHJK `;") {
+            fail("russian -> workman got '" + converted + "'");
+            return;
+        }
+        
+        // Punctuation keys carry letters, and Shift maps level to level
+        converted = library.convert_text("<f,eirf ;bdtn? ult [jxtn/", "qwerty", "russian");
+        if (converted != "Бабушка живет, где хочет.") {
+            fail("full-keyboard qwerty -> russian got '" + converted + "'");
+            return;
+        }
+        converted = library.convert_text("Бабушка живет, где хочет.", "russian", "qwerty");
+        if (converted != "<f,eirf ;bdtn? ult [jxtn/") {
+            fail("full-keyboard russian -> qwerty got '" + converted + "'");
+            return;
+        }
+        
+        auto russian = library.get_layout("russian");
+        if (layout_converter::KeyUtils::get_key_id_for_char(0x0439, *russian) != 2101) {  // й
+            fail("key ID lookup for Cyrillic character");
+            return;
+        }
+        
+        // Legacy IDs cover base-level physical keys only, in both directions
+        layout_converter::LayoutDefinition custom;
+        custom.family_id = 0;
+        custom.layout_id = 0;
+        custom.set_key(1, U'q');
+        custom.set_key(layout_converter::KeyID::key_position(1, layout_converter::KeyID::LEVEL_SHIFT), U'Q');
+        if (layout_converter::KeyUtils::get_char_for_key_id(-5, custom) != 0 ||
+            layout_converter::KeyUtils::get_char_for_key_id(99, custom) != 0 ||
+            layout_converter::KeyUtils::get_char_for_key_id(1, custom) != U'q' ||
+            layout_converter::KeyUtils::get_key_id_for_char(U'Q', custom) != 0) {
+            fail("legacy key IDs outside the base-level physical keys");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_buffer_conversion() {
+        std::cout << "Testing Buffer Conversion... ";
+        
+        using layout_converter::ConversionPlan;
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library) || !library.load_layout("russian", layout_path("russian"))) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        auto qwerty = library.resolve_layout("qwerty");
+        auto russian = library.resolve_layout("russian");
+        if (qwerty == layout_converter::INVALID_LAYOUT_HANDLE ||
+            library.resolve_layout("missing") != layout_converter::INVALID_LAYOUT_HANDLE) {
+            fail("layout handle resolution");
+            return;
+        }
+        
+        char out[64];
+        size_t written = library.convert_text("Ghbdtn", qwerty, russian, out, sizeof(out));
+        if (written == ConversionPlan::npos || std::string(out, written) != "Привет") {
+            fail("convert into caller buffer");
+            return;
+        }
+        
+        // Exactly-sized buffer takes the checked path; one byte short must fail
+        if (library.convert_text("Ghbdtn", qwerty, russian, out, 12) != 12 ||
+            library.convert_text("Ghbdtn", qwerty, russian, out, 11) != ConversionPlan::npos) {
+            fail("capacity checks");
+            return;
+        }
+        
+        std::string buffer = "> ";
+        library.convert_text("ghbdtn", qwerty, russian, buffer);
+        library.convert_text(" vbh", qwerty, russian, buffer);
+        if (buffer != "> привет мир") {
+            fail("append got '" + buffer + "'");
+            return;
+        }
+        
+        // Handles stay stable across reloads and cache clears
+        library.clear_cache();
+        library.load_layout("qwerty", layout_path("qwerty"));
+        library.load_layout("russian", layout_path("russian"));
+        if (library.resolve_layout("qwerty") != qwerty || library.resolve_layout("russian") != russian) {
+            fail("handles changed after reload");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_stream_conversion() {
+        std::cout << "Testing Stream Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        auto plan = library.compile("russian", "qwerty");
+        
+        std::string text;
+        for (int i = 0; i < 50; ++i) {
+            text += "Привет, мир! ёж € ";
+        }
+        std::string expected = plan->convert(text);
+        
+        // Tiny chunks split nearly every multibyte character
+        for (size_t chunk_size : {size_t(1), size_t(2), size_t(3), size_t(7), size_t(4096)}) {
+            layout_converter::StreamConverter converter(plan, chunk_size);
+            std::istringstream in(text);
+            std::ostringstream out;
+            if (!converter.convert(in, out) || out.str() != expected) {
+                fail("chunk size " + std::to_string(chunk_size));
+                return;
+            }
+        }
+        
+        // Truncated sequence at end of input passes through on finish()
+        layout_converter::StreamConverter converter(plan, 16);
+        std::string out;
+        converter.feed("ghbdtn \xD0", out);
+        converter.finish(out);
+        if (out != plan->convert("ghbdtn \xD0")) {
+            fail("unterminated sequence not flushed");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_file_conversion() {
+        std::cout << "Testing File Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        
+        auto dir = std::filesystem::temp_directory_path();
+        std::string input_path = (dir / "layout_converter_test_in.txt").string();
+        std::string output_path = (dir / "layout_converter_test_out.txt").string();
+        
+        std::string text;
+        for (int i = 0; i < 300; ++i) {
+            text += "Ghbdtn, vbh! Привет ";
+        }
+        std::ofstream(input_path, std::ios::binary) << text;
+        
+        // Tiny chunks on several threads exercise boundary alignment and the
+        // prefix-sum placement of width-changing output
+        for (const auto& [from, to] : {std::pair<std::string, std::string>{"qwerty", "russian"},
+                                       {"russian", "qwerty"}, {"qwerty", "workman"}}) {
+            auto plan = library.compile(from, to);
+            if (!layout_converter::convert_file(plan, input_path, output_path, 4, 7)) {
+                fail("convert_file " + from + " -> " + to + " returned false");
+                return;
+            }
+            std::ifstream in(output_path, std::ios::binary);
+            std::string converted((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (converted != plan->convert(text)) {
+                fail("output mismatch for " + from + " -> " + to);
+                return;
+            }
+        }
+        
+        if (library.convert_file(input_path, output_path, "qwerty", "missing")) {
+            fail("unknown layout accepted");
+            return;
+        }
+        
+        // Converting a file onto itself would truncate it before reading it
+        for (unsigned threads : {1u, 4u}) {
+            if (library.convert_file(input_path, input_path, "qwerty", "russian", threads)) {
+                fail("same input and output path accepted");
+                return;
+            }
+        }
+        std::ifstream kept(input_path, std::ios::binary);
+        if (std::string((std::istreambuf_iterator<char>(kept)), std::istreambuf_iterator<char>()) != text) {
+            fail("input changed by a rejected same-path conversion");
+            return;
+        }
+        
+        std::filesystem::remove(input_path);
+        std::filesystem::remove(output_path);
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_layout_pack() {
+        std::cout << "Testing Layout Pack... ";
+        
+        layout_converter::KeyBasedLayoutLibrary source;
+        if (source.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        std::string pack_path = (std::filesystem::temp_directory_path() / "layout_converter_test.lcpack").string();
+        if (!source.save_pack(pack_path)) {
+            fail("save_pack failed");
+            return;
+        }
+        
+        layout_converter::KeyBasedLayoutLibrary packed;
+        if (!packed.load_pack(pack_path) || packed.get_loaded_layouts() != source.get_loaded_layouts()) {
+            fail("load_pack did not restore the same layouts");
+            return;
+        }
+        auto russian = packed.get_layout("russian");
+        if (russian->name != "Russian" || russian->language != "ru" || russian->common_words != source.get_layout("russian")->common_words ||
+            packed.convert_text("Ghbdtn", "qwerty", "russian") != "Привет") {
+            fail("packed layout contents differ");
+            return;
+        }
+        
+        // A flipped byte must be caught by the checksum
+        {
+            std::fstream file(pack_path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(sizeof(layout_converter::LayoutPack::Header) + 20);
+            file.put('\x7F');
+        }
+        layout_converter::KeyBasedLayoutLibrary corrupt;
+        if (corrupt.load_pack(pack_path) || !corrupt.get_loaded_layouts().empty()) {
+            fail("corrupted pack was accepted");
+            return;
+        }
+        
+        std::filesystem::remove(pack_path);
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_builtin_layouts() {
+        std::cout << "Testing Built-in Layouts... ";
+        
+        using namespace layout_converter;
+        static_assert(Builtin::StaticPlan<Builtin::Layout::QWERTY, Builtin::Layout::WORKMAN>::byte_only,
+                      "Latin pairs should compile to a byte table");
+        static_assert(!Builtin::StaticPlan<Builtin::Layout::QWERTY, Builtin::Layout::RUSSIAN>::byte_only,
+                      "Latin -> Cyrillic widens characters");
+        
+        KeyBasedLayoutLibrary builtin;
+        KeyBasedLayoutLibrary from_json;
+        if (builtin.load_builtin_layouts() != Builtin::LAYOUT_COUNT || from_json.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        const std::string latin = "Ghbdtn, vbh! Hello";
+        const std::string cyrillic = "Привет, мир! ёж";
+        if (Builtin::convert<Builtin::Layout::QWERTY, Builtin::Layout::RUSSIAN>(latin) !=
+                from_json.convert_text(latin, "qwerty", "russian") ||
+            Builtin::convert<Builtin::Layout::RUSSIAN, Builtin::Layout::QWERTY>(cyrillic) !=
+                from_json.convert_text(cyrillic, "russian", "qwerty") ||
+            Builtin::convert<Builtin::Layout::QWERTY, Builtin::Layout::WORKMAN>(latin) !=
+                from_json.convert_text(latin, "qwerty", "workman")) {
+            fail("compile-time conversion differs from JSON layouts");
+            return;
+        }
+        if (builtin.convert_text(cyrillic, "russian", "workman") != from_json.convert_text(cyrillic, "russian", "workman") ||
+            builtin.get_layout("russian")->common_words != from_json.get_layout("russian")->common_words) {
+            fail("built-in layouts differ from JSON layouts");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_common_word_matching() {
+        std::cout << "Testing Common Word Matching... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        auto qwerty = library.resolve_layout("qwerty");
+        auto russian = library.resolve_layout("russian");
+        
+        auto find = [](const std::vector<layout_converter::LayoutHypothesis>& hypotheses,
+                       layout_converter::LayoutHandle typed, layout_converter::LayoutHandle intended) {
+            for (const auto& hypothesis : hypotheses) {
+                if (hypothesis.typed_layout == typed && hypothesis.intended_layout == intended) {
+                    return hypothesis.common_words;
+                }
+            }
+            return uint32_t(-1);
+        };
+        
+        // "the" inside "other" and "out" inside "outer" are not words
+        auto hypotheses = library.detect_hypotheses("The other day, outer space... THE END");
+        if (find(hypotheses, qwerty, qwerty) != 3) {
+            fail("expected 3 common words, got " + std::to_string(find(hypotheses, qwerty, qwerty)));
+            return;
+        }
+        
+        // Words are matched by key, so mistyped Russian finds Russian words
+        hypotheses = library.detect_hypotheses("Ghbdtn? rfr ltkf& yt pyf. ");
+        if (find(hypotheses, qwerty, russian) != 3 || find(hypotheses, qwerty, qwerty) != 0) {
+            fail("common words not matched through the keys pressed");
+            return;
+        }
+        
+        // Word lists are re-read when a layout is replaced
+        auto custom = std::make_shared<layout_converter::LayoutDefinition>(*library.get_layout("qwerty"));
+        custom->common_words = {"other"};
+        library.add_layout("qwerty", custom);
+        hypotheses = library.detect_hypotheses("the other day");
+        if (find(hypotheses, qwerty, qwerty) != 1) {
+            fail("automaton not rebuilt after the word list changed");
+            return;
+        }
+        
+        // The library keeps its own copy of an added layout
+        custom->common_words.clear();
+        hypotheses = library.detect_hypotheses("the other day");
+        if (find(hypotheses, qwerty, qwerty) != 1 || library.get_layout("qwerty").get() == custom.get()) {
+            fail("added layout shared with the caller");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_concurrent_reload() {
+        std::cout << "Testing Concurrent Reload... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        auto qwerty = library.resolve_layout("qwerty");
+        auto workman = library.resolve_layout("workman");
+        auto workman_layout = library.get_layout("workman");
+        
+        // Readers see either the old or the new registry, never a torn one
+        std::atomic<bool> done{false};
+        std::atomic<int> bad_results{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                std::string out;
+                while (!done.load()) {
+                    out.clear();
+                    library.convert_text("hello", qwerty, workman, out);
+                    if (out != "ywoo;" && out != "hello") {
+                        ++bad_results;
+                    }
+                    if (library.convert_text("hello", "qwerty", "workman").size() != 5) {
+                        ++bad_results;
+                    }
+                    library.detect_hypotheses("ghbdtn");
+                }
+            });
+        }
+        
+        for (int i = 0; i < 200; ++i) {
+            library.add_layout("workman", workman_layout);
+            if (i % 10 == 0) {
+                library.clear_cache();
+                load_latin_layouts(library);
+            }
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        
+        if (bad_results.load() != 0) {
+            fail(std::to_string(bad_results.load()) + " conversions saw an inconsistent registry");
+            return;
+        }
+        if (library.convert_text("hello", "qwerty", "workman") != "ywoo;" ||
+            library.resolve_layout("workman") != workman) {
+            fail("registry wrong after reloads");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    // Poll `condition` until it holds or a few seconds have passed
+    template <typename Condition>
+    static bool wait_for(Condition condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+    
+    static void test_directory_watch() {
+        std::cout << "Testing Directory Watch... ";
+        
+        auto dir = std::filesystem::temp_directory_path() / "layout_converter_watch_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::filesystem::copy_file(layout_path("qwerty"), dir / "qwerty.json");
+        std::filesystem::copy_file(layout_path("workman"), dir / "workman.json");
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        library.load_directory(dir.string());
+        if (!library.watch_directory(dir.string())) {
+            std::cout << "SKIPPED (no file notifications)\n";
+            std::filesystem::remove_all(dir);
+            return;
+        }
+        
+        // A fixed layout is swapped in
+        std::ifstream in(layout_path("workman"));
+        std::string workman((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string fixed = workman;
+        std::string key = "\"KeyH\": \"y\"";
+        fixed.replace(fixed.find(key), key.size(), "\"KeyH\": \"x\"");
+        std::ofstream(dir / "workman.json") << fixed;
+        if (!wait_for([&] { return library.convert_text("h", "qwerty", "workman") == "x"; })) {
+            fail("changed layout was not reloaded");
+            return;
+        }
+        
+        // A broken file is rejected and the working version kept
+        std::ofstream(dir / "workman.json") << "{ \"id\": ";
+        if (!wait_for([&] { return library.get_reload_stats().failed_validations == 1; }) ||
+            library.convert_text("h", "qwerty", "workman") != "x") {
+            fail("invalid layout not rejected");
+            return;
+        }
+        
+        // So is a well-formed edit that lost most of the keys
+        std::ofstream(dir / "workman.json") << workman.substr(0, workman.find("\"KeyU\"")) << "\"KeyU\": \"u\" } }";
+        if (!wait_for([&] { return library.get_reload_stats().failed_validations == 2; }) ||
+            library.convert_text("h", "qwerty", "workman") != "x") {
+            fail("truncated layout not rejected");
+            return;
+        }
+        
+        // New files are picked up, deleted ones unloaded
+        std::filesystem::copy_file(layout_path("russian"), dir / "russian.json");
+        std::filesystem::remove(dir / "workman.json");
+        if (!wait_for([&] { return library.convert_text("ghbdtn", "qwerty", "russian") == "привет" &&
+                                   library.get_layout("workman") == nullptr; })) {
+            fail("added or removed files not applied");
+            return;
+        }
+        
+        library.stop_watching();
+        auto stats = library.get_reload_stats();
+        if (stats.reloads < 2 || stats.layouts_reloaded < 2 || stats.layouts_removed != 1 ||
+            stats.max_latency_us < stats.last_latency_us) {
+            fail("unexpected reload stats");
+            return;
+        }
+        
+        std::filesystem::remove_all(dir);
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_batch_conversion() {
+        std::cout << "Testing Batch Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (!load_latin_layouts(library) || !library.load_layout("russian", layout_path("russian"))) {
+            fail("could not load layouts");
+            return;
+        }
+        
+        std::vector<std::string> storage;
+        for (int i = 0; i < 500; ++i) {
+            storage.push_back(i % 3 == 0 ? "Ghbdtn? vbh!" : i % 3 == 1 ? "Привет" : "");
+        }
+        std::vector<std::string_view> inputs(storage.begin(), storage.end());
+        
+        // Small chunks on several threads exercise the compaction of
+        // width-changing output across chunk regions
+        layout_converter::StringBatch batch;
+        for (const auto& [from, to] : {std::pair<std::string, std::string>{"qwerty", "russian"},
+                                       {"russian", "qwerty"}, {"qwerty", "workman"}}) {
+            auto plan = library.compile(from, to);
+            layout_converter::convert_batch(*plan, inputs.data(), inputs.size(), batch, 4, 64);
+            if (batch.size() != inputs.size() || batch.offsets.back() != batch.arena.size()) {
+                fail("malformed batch for " + from + " -> " + to);
+                return;
+            }
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                if (batch[i] != plan->convert(inputs[i])) {
+                    fail("batch output mismatch for " + from + " -> " + to);
+                    return;
+                }
+            }
+        }
+        
+        library.convert_batch(inputs, library.resolve_layout("qwerty"), library.resolve_layout("russian"), batch);
+        if (batch[0] != "Привет, мир!" || batch[2] != "") {
+            fail("handle-based batch converted incorrectly");
+            return;
+        }
+        library.convert_batch(inputs, "qwerty", "missing", batch);
+        if (batch.size() != inputs.size() || batch[0] != inputs[0] || batch[1] != inputs[1]) {
+            fail("unknown layout did not copy the batch unchanged");
+            return;
+        }
+        library.convert_batch({}, "qwerty", "russian", batch);
+        if (batch.size() != 0 || !batch.arena.empty()) {
+            fail("empty batch not empty");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_fanout_conversion() {
+        std::cout << "Testing Fan-out Conversion... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        
+        // Every output matches the pairwise conversion; unknown layouts copy
+        const std::string text = "Ghbdtn? vbh! \u041f\u0440\u0438\u0432\u0435\u0442 \xff 42";
+        const std::vector<std::string> targets = {"russian", "qwerty", "missing", "workman", "dvorak"};
+        layout_converter::StringBatch batch;
+        library.convert_fanout(text, "qwerty", targets, batch);
+        if (batch.size() != targets.size() || batch.offsets.back() != batch.arena.size()) {
+            fail("malformed fan-out batch");
+            return;
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (batch[i] != library.convert_text(text, "qwerty", targets[i])) {
+                fail("fan-out to " + targets[i] + " differs from convert_text");
+                return;
+            }
+        }
+        
+        // All sources: indexed by source handle, then by target
+        std::vector<layout_converter::LayoutHandle> handles;
+        for (const std::string& target : targets) {
+            handles.push_back(library.resolve_layout(target));
+        }
+        library.convert_fanout(text, handles, batch);
+        const std::vector<std::string> loaded = library.get_loaded_layouts();
+        if (batch.size() != loaded.size() * handles.size()) {
+            fail("all-source fan-out has " + std::to_string(batch.size()) + " outputs");
+            return;
+        }
+        for (const std::string& source : loaded) {
+            auto from = library.resolve_layout(source);
+            for (size_t i = 0; i < targets.size(); ++i) {
+                if (batch[from * handles.size() + i] != library.convert_text(text, source, targets[i])) {
+                    fail("all-source fan-out " + source + " -> " + targets[i] + " differs from convert_text");
+                    return;
+                }
+            }
+        }
+        
+        library.convert_fanout("", "qwerty", targets, batch);
+        if (batch.size() != targets.size() || !batch.arena.empty()) {
+            fail("empty text did not give empty outputs");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_batch_detection() {
+        std::cout << "Testing Batch Detection... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        
+        const std::vector<std::string> texts = {"Ghbdtn, rfr ltkf?", "hello world", "12345", "привет", ""};
+        std::vector<std::string_view> inputs;
+        for (int i = 0; i < 600; ++i) {
+            inputs.push_back(texts[i % texts.size()]);
+        }
+        
+        // Several blocks on several threads give the same top-k as one call per text
+        layout_converter::DetectionBatch batch;
+        library.detect_batch(inputs, "en", batch, 2, 4);
+        if (batch.size() != inputs.size()) {
+            fail("wrong batch size");
+            return;
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            auto expected = library.detect_hypotheses(inputs[i], "en", 2);
+            if (static_cast<size_t>(batch.end(i) - batch.begin(i)) != expected.size() ||
+                !std::equal(expected.begin(), expected.end(), batch.begin(i),
+                            [](const auto& a, const auto& b) {
+                                return a.typed_layout == b.typed_layout &&
+                                       a.intended_layout == b.intended_layout && a.score == b.score;
+                            })) {
+                fail("batch result differs for input " + std::to_string(i));
+                return;
+            }
+        }
+        if (batch.begin(0)->intended_layout != library.resolve_layout("russian") || batch.end(2) != batch.begin(2)) {
+            fail("unexpected batch detection");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_statistics() {
+        std::cout << "Testing Statistics... ";
+        namespace Stats = layout_converter::Stats;
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        Stats::reset();
+        if (!load_latin_layouts(library)) {
+            fail("could not load layouts");
+            return;
+        }
+        library.load_layout("missing", layout_path("does_not_exist"));
+        library.convert_text("hello!", "qwerty", "workman");
+        library.convert_text("hello!", "qwerty", "workman");
+        library.detect_likely_layouts("hello");
+        
+        Stats::Snapshot stats = Stats::snapshot();
+        if (stats.enabled != Stats::enabled()) {
+            fail("snapshot disagrees with enabled()");
+            return;
+        }
+        if (!stats.enabled) {
+            // Built without statistics: nothing may be recorded
+            if (stats[Stats::Counter::CONVERT_CALLS] != 0 || stats[Stats::Operation::CONVERT].count != 0) {
+                fail("counters recorded in a build without statistics");
+                return;
+            }
+            std::cout << "PASSED (disabled)\n";
+            return;
+        }
+        
+        using C = Stats::Counter;
+        if (stats[C::CONVERT_CALLS] != 2 || stats[C::CONVERT_BYTES_IN] != 12 || stats[C::CONVERT_BYTES_OUT] != 12 ||
+            stats[C::PASSTHROUGH_CHARACTERS] != 2 || stats[C::PLAN_CACHE_MISSES] != 1 ||
+            stats[C::PLAN_CACHE_HITS] != 1) {
+            fail("wrong conversion counters");
+            return;
+        }
+        if (stats[C::LAYOUTS_LOADED] != 2 || stats[C::LAYOUT_LOAD_FAILURES] != 1 ||
+            stats[Stats::Operation::LOAD_LAYOUT].count != 3) {
+            fail("wrong load counters");
+            return;
+        }
+        if (stats[C::DETECT_CALLS] != 1 || stats[C::HYPOTHESES_SCORED] == 0 ||
+            stats[Stats::Operation::DETECT].count != 1 || stats[Stats::Operation::CONVERT].count != 2) {
+            fail("wrong detection counters");
+            return;
+        }
+        const Stats::Histogram& latency = stats[Stats::Operation::CONVERT];
+        if (latency.quantile_ns(0.0) > latency.quantile_ns(1.0) || latency.quantile_ns(1.0) == 0) {
+            fail("inconsistent latency histogram");
+            return;
+        }
+        
+        Stats::reset();
+        if (Stats::snapshot()[C::CONVERT_CALLS] != 0) {
+            fail("reset did not clear the counters");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_incremental_detection() {
+        std::cout << "Testing Incremental Detection... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        
+        // Fed one byte at a time, the ranking matches a full rescore at every prefix
+        const std::string text = "  Ghbdtn, rfr ltkf?  ghbdtn \u043c\u0438\u0440 12 hello";
+        auto detector = library.create_incremental_detector("en");
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i > 0) detector.append(text.substr(i - 1, 1));
+            if (i < text.size() && (static_cast<unsigned char>(text[i]) & 0xC0) == 0x80) continue;
+            auto expected = library.detect_hypotheses(text.substr(0, i), "en");
+            auto ranking = detector.ranking();
+            if (ranking.size() != expected.size()) {
+                fail("ranking size differs at prefix " + std::to_string(i));
+                return;
+            }
+            for (size_t h = 0; h < ranking.size(); ++h) {
+                if (std::abs(ranking[h].score - expected[h].score) > 1e-4 ||
+                    ranking[h].common_words != expected[h].common_words) {
+                    fail("ranking differs at prefix " + std::to_string(i));
+                    return;
+                }
+            }
+        }
+        
+        // A few words are enough to decide; nothing is decided before any text
+        detector.reset();
+        if (detector.decide().decided || !detector.ranking().empty()) {
+            fail("reset detector still has text");
+            return;
+        }
+        detector.append("Ghbdtn rfr ltkf");
+        auto decision = detector.decide();
+        if (!decision.decided || decision.best.typed_layout != library.resolve_layout("qwerty") ||
+            decision.best.intended_layout != library.resolve_layout("russian") || detector.size() != 13) {
+            fail("expected an early decision for qwerty -> russian");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+    
+    static void test_fix_mistyped() {
+        std::cout << "Testing Mistyped Span Correction... ";
+        
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3) {
+            fail("could not load layout directory");
+            return;
+        }
+        
+        // Only the mistyped words change; spacing is kept byte for byte
+        const std::vector<std::string> candidates = {"qwerty", "russian"};
+        struct Case {
+            const char* input;
+            const char* expected;
+        };
+        for (const Case& c : {Case{"hello ghbdtn world", "hello \u043f\u0440\u0438\u0432\u0435\u0442 world"},
+                              Case{"Ghbdtn? rfr ltkf& I am fine",
+                                   "\u041f\u0440\u0438\u0432\u0435\u0442, \u043a\u0430\u043a "
+                                   "\u0434\u0435\u043b\u0430? I am fine"},
+                              Case{"  the quick  brown fox\n", "  the quick  brown fox\n"},
+                              Case{"\u043f\u0440\u0438\u0432\u0435\u0442 \u043c\u0438\u0440",
+                                   "\u043f\u0440\u0438\u0432\u0435\u0442 \u043c\u0438\u0440"},
+                              Case{"ghbdtn vbh \u21165", "\u043f\u0440\u0438\u0432\u0435\u0442 \u043c\u0438\u0440 \u21165"},
+                              Case{"", ""}}) {
+            std::string fixed = library.fix_mistyped(c.input, candidates);
+            if (fixed != c.expected) {
+                fail("fix_mistyped(\"" + std::string(c.input) + "\") gave \"" + fixed + "\"");
+                return;
+            }
+        }
+        
+        // Handle overload appends; unknown candidates leave the text alone
+        std::string out = "> ";
+        std::vector<layout_converter::LayoutHandle> handles = {library.resolve_layout("qwerty"),
+                                                               library.resolve_layout("russian")};
+        size_t written = library.fix_mistyped("rfr", handles, out);
+        if (out != "> \u043a\u0430\u043a" || written != out.size() - 2) {
+            fail("handle overload did not append the correction");
+            return;
+        }
+        if (library.fix_mistyped("ghbdtn", {"qwerty", "missing"}) != "ghbdtn") {
+            fail("unknown candidate layout changed the text");
+            return;
+        }
+        
+        // Too many candidates: the text is left as written
+        std::vector<std::string> many(layout_converter::KeyBasedLayoutLibrary::MAX_FIX_CANDIDATES + 1, "qwerty");
+        many.back() = "russian";
+        if (library.fix_mistyped("ghbdtn", many) != "ghbdtn") {
+            fail("oversized candidate list was searched");
+            return;
+        }
+        
+        std::cout << "PASSED\n";
+    }
+
+    static void test_word_dictionary() {
+        std::cout << "Testing Word Dictionary... ";
+        using layout_converter::WordDictionary;
+        
+        std::string path = (std::filesystem::temp_directory_path() / "layout_converter_test.lcdict").string();
+        const std::vector<std::string> words = {"\u0437\u043e\u043d\u0442\u0438\u043a",  // зонтик
+                                                "\u0437\u043e\u043d\u0442",              // зонт
+                                                "\u041a\u043e\u0442",                     // Кот
+                                                "\u043a\u0438\u0442", "\u043a\u0438\u0442", ""};
+        for (unsigned bloom_bits : {0u, 10u}) {
+            if (!WordDictionary::write(path, "ru", words, bloom_bits)) {
+                fail("write failed");
+                return;
+            }
+            auto dictionary = WordDictionary::open(path);
+            if (!dictionary || dictionary->language() != "ru" || dictionary->word_count() != 4) {
+                fail("dictionary did not open with its language and 4 distinct words");
+                return;
+            }
+            for (const char* word : {"\u0437\u043e\u043d\u0442\u0438\u043a", "\u0437\u043e\u043d\u0442",
+                                     "\u043a\u043e\u0442", "\u043a\u0438\u0442"}) {
+                if (!dictionary->contains(word)) {
+                    fail("word missing from the dictionary (Bloom bits " + std::to_string(bloom_bits) + ")");
+                    return;
+                }
+            }
+            // Prefixes, extensions and other words are absent
+            for (const char* word : {"", "\u0437\u043e\u043d", "\u0437\u043e\u043d\u0442\u0438",
+                                     "\u043a\u043e\u0442\u044b", "\u043a\u0430\u0442", "kot"}) {
+                if (dictionary->contains(word)) {
+                    fail("dictionary contains a word it was not built from");
+                    return;
+                }
+            }
+        }
+        
+        // A flipped byte must be caught by the checksum
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(sizeof(WordDictionary::Header) + 4);
+            file.put('\x7F');
+        }
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (WordDictionary::open(path) || library.load_dictionary(path)) {
+            fail("corrupted dictionary was accepted");
+            return;
+        }
+        
+        // "pjynbr" is зонтик typed on QWERTY; the dictionary raises that reading
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3 || !WordDictionary::write(path, "ru", words)) {
+            fail("could not set up detection");
+            return;
+        }
+        auto qwerty = library.resolve_layout("qwerty");
+        auto russian = library.resolve_layout("russian");
+        auto score_of = [&](const std::vector<layout_converter::LayoutHypothesis>& hypotheses) {
+            for (const auto& hypothesis : hypotheses) {
+                if (hypothesis.typed_layout == qwerty && hypothesis.intended_layout == russian) {
+                    return hypothesis.score;
+                }
+            }
+            return -std::numeric_limits<double>::infinity();
+        };
+        double without = score_of(library.detect_hypotheses("pjynbr", "en"));
+        if (!library.load_dictionary(path)) {
+            fail("load_dictionary failed");
+            return;
+        }
+        auto with = library.detect_hypotheses("pjynbr", "en");
+        if (!(score_of(with) > without)) {
+            fail("dictionary word did not raise the qwerty -> russian score");
+            return;
+        }
+        
+        // Typing the text key by key gives the same scores
+        auto detector = library.create_incremental_detector("en");
+        detector.append("pjynbr");
+        if (std::abs(score_of(detector.ranking()) - score_of(with)) > 1e-6) {
+            fail("incremental detection disagrees with detect_hypotheses");
+            return;
+        }
+        
+        std::filesystem::remove(path);
+        std::cout << "PASSED\n";
+    }
+
+    static void test_ngram_model() {
+        std::cout << "Testing N-gram Model Training... ";
+        using layout_converter::NgramModel;
+        
+        // A corpus of several counting chunks, so the threads share the work
+        auto temp = std::filesystem::temp_directory_path();
+        std::string corpus = (temp / "layout_converter_test_corpus.txt").string();
+        {
+            std::ofstream out(corpus, std::ios::binary);
+            const char* sentences[] = {"\u041f\u0440\u0438\u0432\u0435\u0442, \u043a\u0430\u043a \u0434\u0435\u043b\u0430? ",
+                                       "\u0414\u0435\u043b\u0430 \u0445\u043e\u0440\u043e\u0448\u043e, "
+                                       "\u0441\u043f\u0430\u0441\u0438\u0431\u043e.\n"};
+            for (int i = 0; i < 40000; ++i) {
+                out << sentences[i % 2];
+            }
+        }
+        std::string paths[3];
+        for (unsigned threads : {1u, 3u}) {
+            layout_converter::NgramTrainOptions options;
+            options.threads = threads;
+            paths[threads / 2] = (temp / ("layout_converter_test_" + std::to_string(threads) + ".lcmodel")).string();
+            if (!NgramModel::train(paths[threads / 2], "ru", {corpus}, options)) {
+                fail("train failed");
+                return;
+            }
+        }
+        auto read = [](const std::string& path) {
+            std::ifstream in(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), {});
+        };
+        if (read(paths[0]) != read(paths[1])) {
+            fail("model depends on the thread count");
+            return;
+        }
+        
+        // Same model at 4 bits: a smaller file with close values
+        layout_converter::NgramTrainOptions coarse;
+        coarse.bits = 4;
+        paths[2] = (temp / "layout_converter_test_4.lcmodel").string();
+        if (!NgramModel::train(paths[2], "ru", {corpus}, coarse)) {
+            fail("4-bit train failed");
+            return;
+        }
+        auto model = NgramModel::open(paths[0]);
+        auto small = NgramModel::open(paths[2]);
+        if (!model || !small || model->language() != "ru" || model->bits() != 8 || small->bits() != 4 ||
+            model->symbol_count() != 16 || model->alphabet().front() != U'\u0430' ||
+            small->size_bytes() >= model->size_bytes()) {
+            fail("trained models have the wrong header or size");
+            return;
+        }
+        for (size_t i = 0; i < model->symbol_count() * model->symbol_count(); ++i) {
+            if (std::abs(model->bigram()[i] - small->bigram()[i]) > small->bigram().quantization.scale) {
+                fail("4-bit values off by more than one step");
+                return;
+            }
+        }
+        
+        layout_converter::NgramTrainOptions invalid;
+        invalid.bits = 5;
+        if (NgramModel::train(paths[2], "ru", {corpus}, invalid) ||
+            NgramModel::train(paths[2], "ru", {corpus + ".missing"})) {
+            fail("invalid options or a missing corpus were accepted");
+            return;
+        }
+        
+        // A flipped byte must be caught by the checksum
+        std::string corrupt = (temp / "layout_converter_test_corrupt.lcmodel").string();
+        std::filesystem::copy_file(paths[0], corrupt, std::filesystem::copy_options::overwrite_existing);
+        {
+            std::fstream file(corrupt, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(sizeof(NgramModel::Header) + 20);
+            file.put('\x7F');
+        }
+        layout_converter::KeyBasedLayoutLibrary library;
+        if (NgramModel::open(corrupt) || library.load_language_model(corrupt)) {
+            fail("corrupted model was accepted");
+            return;
+        }
+        
+        // Detection reads Russian through the loaded model
+        if (library.load_directory(LAYOUT_DATA_DIR) < 3 || !library.load_language_model(paths[0])) {
+            fail("could not load the trained model");
+            return;
+        }
+        auto best = library.detect_hypotheses("Ghbdtn, rfr ltkf?", "en", 1);
+        if (best.empty() || best[0].typed_layout != library.resolve_layout("qwerty") ||
+            best[0].intended_layout != library.resolve_layout("russian")) {
+            fail("'Ghbdtn, rfr ltkf?' not detected as Russian typed on QWERTY with the trained model");
+            return;
+        }
+        
+        for (const std::string& path : {corpus, corrupt, paths[0], paths[1], paths[2]}) {
+            std::filesystem::remove(path);
+        }
+        std::cout << "PASSED\n";
     }
 };
 
 int main() {
     KeyIDSystemTest::run_all_tests();
-    return 0;
-} 
\ No newline at end of file
+    return KeyIDSystemTest::failures() > 0 ? 1 : 0;
+}